@@ -0,0 +1,205 @@
+#include "adjoint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <omp.h>
+
+#include "steady.h"
+
+namespace adjoint {
+
+namespace {
+
+using steady::vars;
+
+constexpr double ks_weight = 10.0;      // Sharpness of the peak_T aggregate [1/K]
+
+// J and dJ/dq at the state q
+double objective(const Solver& s, const Objective& o, const std::vector<double>& q, std::vector<double>& dJ) {
+
+    const int N = s.N;
+    std::fill(dJ.begin(), dJ.end(), 0.0);
+
+    if (o.name == "pressure_drop") {
+        dJ[1] = 1.0;
+        dJ[vars * (N - 1) + 1] = -1.0;
+        return q[1] - q[vars * (N - 1) + 1];
+    }
+
+    // Kreisselmeier-Steinhauser aggregate: smooth where the hottest cells
+    // trade places, at most ln(N) / ks_weight above the hottest cell
+    if (o.name == "peak_T") {
+
+        double T_max = q[2];
+        for (int i = 1; i < N; ++i) T_max = std::max(T_max, q[vars * i + 2]);
+
+        double sum = 0.0;
+        for (int i = 0; i < N; ++i) {
+            dJ[vars * i + 2] = std::exp(ks_weight * (q[vars * i + 2] - T_max));
+            sum += dJ[vars * i + 2];
+        }
+        for (int i = 0; i < N; ++i) dJ[vars * i + 2] /= sum;
+
+        return T_max + std::log(sum) / ks_weight;
+    }
+
+    // Probe, interpolated as Solver::probe
+    const int v = o.field == 'u' ? 0 : o.field == 'p' ? 1 : 2;
+    const double c = std::min(std::max(o.z / s.dz - 0.5, 0.0), N - 1.0);
+    const int i = std::min(static_cast<int>(c), N - 2);
+    const double w = c - i;
+
+    dJ[vars * i + v] = 1.0 - w;
+    dJ[vars * (i + 1) + v] = w;
+    return (1.0 - w) * q[vars * i + v] + w * q[vars * (i + 1) + v];
+}
+}
+
+Objective parseObjective(const std::string& text) {
+
+    Objective o;
+    o.name = text;
+
+    if (text == "pressure_drop" || text == "peak_T") return o;
+
+    const auto at = text.find('@');
+    if (at == 1 && (text[0] == 'u' || text[0] == 'p' || text[0] == 'T')) {
+        o.field = text[0];
+        o.z = std::stod(text.substr(2));
+        return o;
+    }
+
+    throw std::runtime_error("Adjoint: objective must be pressure_drop, peak_T or u@z, p@z, T@z, got: " + text);
+}
+
+Gradient gradient(const Solver& s, const Objective& o) {
+
+    const int N = s.N;
+    const std::vector<double> q = steady::state(s);
+
+    Gradient g;
+
+    // How steady the state is, in the solver's residual units
+    std::vector<double> r;
+    steady::residual(s, q, r);
+    const steady::Norms n = steady::norms(s, r);
+
+    g.momentum_residual = n.momentum;
+    g.continuity_residual = n.continuity;
+    g.energy_residual = n.energy;
+
+    // J^T lambda = dJ/dq
+    std::vector<double> lambda(vars * N);
+    g.J = objective(s, o, q, lambda);
+
+    steady::solve(steady::jacobian(s, q), lambda, true);
+
+    // dR/dS_m = -dz A on the continuity row, dR/dS_h = -dz A on the energy
+    // row; the boundary rows hold no source
+    g.dS_m.assign(N, 0.0);
+    g.dS_h.assign(N, 0.0);
+
+    for (int i = 1; i < N - 1; ++i) {
+        g.dS_m[i] = lambda[vars * i + steady::continuity] * s.dz * s.area[i];
+        g.dS_h[i] = lambda[vars * i + steady::energy] * s.dz * s.area[i];
+    }
+
+    return g;
+}
+
+int run(const Input& in, const std::string& caseName, const std::string& objectiveText, int checks) {
+
+    if (in.Nr > 1)
+        throw std::runtime_error("--adjoint is for the 1D solver (Nr = 1)");
+    if (in.inlet_lumped.type != "none" || in.outlet_lumped.type != "none")
+        throw std::runtime_error("--adjoint needs plain boundary conditions, not lumped components");
+
+    const Objective o = parseObjective(objectiveText);
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    const double tol = 1e-12;                           // Steady: relative change per step
+
+    Solver s(in);
+
+    if (!s.eos_density)
+        throw std::runtime_error("--adjoint needs the density on the equation of state: set eos_density = 1");
+
+    std::cout << "Discrete adjoint of " << caseName << ", objective " << o.name << "\n";
+
+    const double start = omp_get_wtime();
+    for (int n = 0; n <= time_steps; ++n)
+        s.step();
+    const int extra = steady::settle(s, 10 * (time_steps + 1), tol);
+    const double forward = omp_get_wtime() - start;
+
+    if (extra < 0)
+        std::cout << "# warning: not steady after " << 11 * (time_steps + 1) << " steps, the gradient is of an unconverged state\n";
+
+    const double t0 = omp_get_wtime();
+    const Gradient g = gradient(s, o);
+    const double backward = omp_get_wtime() - t0;
+
+    std::cout << std::scientific << std::setprecision(3)
+        << "Steady residuals: momentum " << g.momentum_residual << " N/m2, continuity " << g.continuity_residual
+        << " kg/(m2 s), energy " << g.energy_residual << " W/m2\n"
+        << std::defaultfloat << std::setprecision(10)
+        << "J = " << g.J << "\n" << std::setprecision(4)
+        << "Forward run " << forward << " s (" << time_steps + 1 + std::max(extra, 0) << " steps), adjoint "
+        << backward * 1e3 << " ms\n";
+
+    const std::filesystem::path outputDir = std::filesystem::path("output") / caseName;
+    std::filesystem::create_directories(outputDir);
+
+    std::ofstream csv(outputDir / "adjoint.csv");
+    csv << std::setprecision(10) << "# " << o.name << " = " << g.J << "\nz,dJ_dS_m,dJ_dS_h\n";
+    for (int i = 0; i < s.N; ++i)
+        csv << (i + 0.5) * s.dz << "," << g.dS_m[i] << "," << g.dS_h[i] << "\n";
+
+    std::cout << "Gradient written to " << (outputDir / "adjoint.csv").string() << std::endl;
+
+    if (checks <= 0) return 0;
+
+    // Central differences from the steady state, one source cell at a time
+    double S_m_scale = 0.0, S_h_scale = 0.0;
+    for (int i = 0; i < s.N; ++i) {
+        S_m_scale = std::max(S_m_scale, std::fabs(s.S_m[i]));
+        S_h_scale = std::max(S_h_scale, std::fabs(s.S_h[i]));
+    }
+
+    const double h_m = S_m_scale > 0.0 ? 1e-3 * S_m_scale : 1e-6;
+    const double h_h = S_h_scale > 0.0 ? 1e-3 * S_h_scale : 1e-3;
+
+    std::cout << "\nCentral differences, steady runs with one source cell perturbed\n"
+        << std::setw(6) << "cell" << std::setw(16) << "dJ/dS_m adj" << std::setw(16) << "dJ/dS_m fd"
+        << std::setw(16) << "dJ/dS_h adj" << std::setw(16) << "dJ/dS_h fd" << "\n";
+
+    std::vector<double> dJ(vars * s.N);
+
+    const auto steady_J = [&](heap::vector<double> Solver::* source, int i, double h) {
+
+        Solver t = s;
+        (t.*source)[i] += h;
+        steady::settle(t, 20 * (time_steps + 1), 0.1 * tol);
+
+        return objective(t, o, steady::state(t), dJ);
+    };
+
+    for (int c = 1; c <= checks; ++c) {
+
+        const int i = std::min(std::max(1, c * s.N / (checks + 1)), s.N - 2);
+
+        const double fd_m = (steady_J(&Solver::S_m, i, h_m) - steady_J(&Solver::S_m, i, -h_m)) / (2.0 * h_m);
+        const double fd_h = (steady_J(&Solver::S_h, i, h_h) - steady_J(&Solver::S_h, i, -h_h)) / (2.0 * h_h);
+
+        std::cout << std::setw(6) << i << std::scientific << std::setprecision(6)
+            << std::setw(16) << g.dS_m[i] << std::setw(16) << fd_m
+            << std::setw(16) << g.dS_h[i] << std::setw(16) << fd_h << std::defaultfloat << "\n";
+    }
+
+    return 0;
+}
+}
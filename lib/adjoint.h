@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "input.h"
+#include "solver.h"
+
+namespace adjoint {
+
+    // Scalar objectives of the steady state:
+    //
+    //   pressure_drop   p[0] - p[N-1] [Pa]
+    //   peak_T          smooth maximum of the cell temperatures [K]:
+    //                   T_max + ln(sum exp(10 (T_i - T_max))) / 10
+    //   u@z, p@z, T@z   field at z [m], linear between cell centres
+    struct Objective {
+        std::string name = "pressure_drop";
+        char field = 0;                     // u, p or T for a probe
+        double z = 0.0;                     // Probe position [m]
+    };
+
+    Objective parseObjective(const std::string& text);
+
+    struct Gradient {
+        double J = 0.0;                     // Objective
+        double momentum_residual = 0.0;     // Largest steady momentum residual [N/m2]
+        double continuity_residual = 0.0;   // Largest steady continuity residual [kg/(m2 s)]
+        double energy_residual = 0.0;       // Largest steady energy residual [W/m2]
+        std::vector<double> dS_m;           // dJ/dS_m[i], per cell [J / (kg/(m3 s))]
+        std::vector<double> dS_h;           // dJ/dS_h[i], per cell [J / (W/m3)]
+    };
+
+    // Discrete adjoint of the steady state the solver has converged to:
+    // the exact Jacobian of the steady residuals (see steady.h) is
+    // transposed and solved once by block Thomas for the adjoint lambda,
+    // and dJ/dS = -lambda^T dR/dS gives the gradient for every cell at
+    // once, that of the discrete solution and not of a continuous model.
+    //
+    // The steady state is the one of the discrete scheme, with density on
+    // the equation of state: the case needs eos_density = 1 (or variable
+    // area). The residuals show how steady the solver state actually is.
+    Gradient gradient(const Solver& s, const Objective& objective);
+
+    // rhoPISO --adjoint <input file> [objective] [check cells]: runs the
+    // case to simulation_time and on until steady, computes the gradient,
+    // writes it to output/<case>/adjoint.csv and compares `check` cells
+    // with central differences of perturbed steady runs
+    int run(const Input& in, const std::string& caseName, const std::string& objective, int checks);
+}
@@ -0,0 +1,310 @@
+#include "affinity.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <omp.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace affinity {
+
+namespace {
+
+std::mutex mutex_;
+Policy policy_ = Policy::none;
+std::vector<int> team_;             // CPU each team thread was pinned to, -1 if refused
+
+// CPU list from sysfs, e.g. "0-3,8-11"; empty if the file is missing
+std::vector<int> read_list(const std::string& file) {
+
+    std::ifstream f(file);
+    std::string list;
+    std::vector<int> ids;
+    if (!(f >> list)) return ids;
+
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+
+        const auto dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+        for (int n = first; n <= last; ++n) ids.push_back(n);
+    }
+    return ids;
+}
+
+int read_int(const std::string& file, int fallback) {
+
+    std::ifstream f(file);
+    int value;
+    return f >> value ? value : fallback;
+}
+
+Topology read_topology() {
+
+    Topology t;
+    const std::string cpu_dir = "/sys/devices/system/cpu/";
+
+    std::vector<int> online = read_list(cpu_dir + "online");
+    if (online.empty())
+        for (int n = 0; n < static_cast<int>(std::max(1u, std::thread::hardware_concurrency())); ++n)
+            online.push_back(n);
+
+    // Node of each CPU from the nodes' cpulists
+    std::map<int, int> node_of;
+    std::vector<int> nodes = read_list("/sys/devices/system/node/online");
+    int nodes_with_cpus = 0;
+
+    for (int node : nodes) {
+        const std::vector<int> cpus = read_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        for (int c : cpus) node_of[c] = node;
+        if (!cpus.empty()) ++nodes_with_cpus;
+    }
+
+    // Cores keyed by (package, core_id); core_id is only unique per package
+    std::map<std::pair<int, int>, std::vector<int>> cores;
+    std::map<int, int> packages;
+
+    for (int id : online) {
+
+        const std::string dir = cpu_dir + "cpu" + std::to_string(id) + "/topology/";
+
+        Cpu c;
+        c.id = id;
+        c.package = read_int(dir + "physical_package_id", 0);
+        c.node = node_of.count(id) ? node_of[id] : 0;
+
+        cores[{ c.package, read_int(dir + "core_id", id) }].push_back(id);
+        packages[c.package] = 1;
+        t.cpus.push_back(c);
+    }
+
+    for (auto& entry : cores) {
+        std::sort(entry.second.begin(), entry.second.end());
+        for (int id : entry.second)
+            for (Cpu& c : t.cpus)
+                if (c.id == id) c.core = static_cast<int>(t.cores.size());
+        t.cores.push_back(entry.second);
+    }
+
+    t.packages = static_cast<int>(packages.size());
+    t.nodes = std::max(1, nodes_with_cpus);
+    return t;
+}
+
+const Cpu& find(const Topology& t, int id) {
+
+    for (const Cpu& c : t.cpus)
+        if (c.id == id) return c;
+    return t.cpus.front();
+}
+
+// CPUs in the order slots take them under policy p
+std::vector<int> order(const Topology& t, Policy p) {
+
+    std::vector<int> cpus;
+
+    if (p == Policy::compact) {
+        for (const std::vector<int>& core : t.cores)
+            cpus.insert(cpus.end(), core.begin(), core.end());
+    }
+    else if (p == Policy::scatter) {
+
+        // Cores of each package, then round-robin over the packages, one
+        // hyperthread rank at a time
+        std::map<int, std::vector<int>> by_package;
+        for (int k = 0; k < static_cast<int>(t.cores.size()); ++k)
+            by_package[find(t, t.cores[k].front()).package].push_back(k);
+
+        std::size_t ranks = 0, depth = 0;
+        for (const std::vector<int>& core : t.cores) ranks = std::max(ranks, core.size());
+        for (const auto& entry : by_package) depth = std::max(depth, entry.second.size());
+
+        for (std::size_t h = 0; h < ranks; ++h)
+            for (std::size_t j = 0; j < depth; ++j)
+                for (const auto& entry : by_package)
+                    if (j < entry.second.size() && h < t.cores[entry.second[j]].size())
+                        cpus.push_back(t.cores[entry.second[j]][h]);
+    }
+    else if (p == Policy::case_per_core) {
+        for (const std::vector<int>& core : t.cores) cpus.push_back(core.front());
+    }
+
+    return cpus;
+}
+}
+
+const Topology& topology() {
+
+    static const Topology t = read_topology();
+    return t;
+}
+
+Policy policy(const std::string& name) {
+
+    if (name == "none") return Policy::none;
+    if (name == "compact") return Policy::compact;
+    if (name == "scatter") return Policy::scatter;
+    if (name == "case_per_core") return Policy::case_per_core;
+    throw std::runtime_error("affinity must be none, compact, scatter or case_per_core, got: " + name);
+}
+
+const char* name(Policy p) {
+
+    switch (p) {
+    case Policy::compact: return "compact";
+    case Policy::scatter: return "scatter";
+    case Policy::case_per_core: return "case_per_core";
+    default: return "none";
+    }
+}
+
+void configure(Policy p) {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = p;
+    team_.clear();
+}
+
+Policy current() {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_;
+}
+
+int cpu(int slot) {
+
+    const std::vector<int> cpus = order(topology(), current());
+    return cpus.empty() ? -1 : cpus[slot % cpus.size()];
+}
+
+int io_cpu(int slot) {
+
+    if (current() != Policy::case_per_core) return -1;
+
+    const Topology& t = topology();
+    const std::vector<int>& core = t.cores[find(t, cpu(slot)).core];
+    return core.size() > 1 ? core[1] : core[0];
+}
+
+bool pin(int cpu) {
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (cpu >= 0) {
+        if (cpu >= CPU_SETSIZE) return false;
+        CPU_SET(cpu, &set);
+    }
+    else {
+        for (const Cpu& c : topology().cpus)
+            if (c.id < CPU_SETSIZE) CPU_SET(c.id, &set);
+    }
+
+    // pid 0: the calling thread, not the whole process
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+void pin_team() {
+
+    if (current() == Policy::none) return;
+
+    std::vector<int> team(omp_get_max_threads(), -1);
+
+    #pragma omp parallel
+    {
+        const int t = omp_get_thread_num(), c = cpu(t);
+        if (pin(c)) team[t] = c;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    team_ = team;
+}
+
+void pin_worker(int slot) {
+
+    if (current() != Policy::none) pin(cpu(slot));
+}
+
+IoCpus io_cpus(int slot) {
+
+    IoCpus io;
+    io.pin = current() != Policy::none;
+    if (!io.pin) return io;
+
+    const int c = io_cpu(slot);
+    if (c >= 0) io.cpus.push_back(c);
+    else for (const Cpu& cpu : topology().cpus) io.cpus.push_back(cpu.id);
+
+    return io;
+}
+
+void pin_io(const IoCpus& io) {
+
+#ifdef __linux__
+    if (!io.pin) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : io.cpus)
+        if (c < CPU_SETSIZE) CPU_SET(c, &set);
+
+    sched_setaffinity(0, sizeof(set), &set);
+#else
+    (void)io;
+#endif
+}
+
+void report(std::ostream& os) {
+
+    const Topology& t = topology();
+    const Policy p = current();
+
+    std::vector<int> team;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        team = team_;
+    }
+
+    os << "Affinity: " << name(p);
+
+    if (!team.empty()) {
+        os << ", threads on CPUs";
+        for (std::size_t k = 0; k < team.size(); ++k) {
+            os << (k == 0 ? " " : ",");
+            if (team[k] < 0) os << "?";
+            else os << team[k];
+        }
+        os << " (nodes";
+        for (std::size_t k = 0; k < team.size(); ++k) {
+            os << (k == 0 ? " " : ",");
+            if (team[k] < 0) os << "?";
+            else os << find(t, team[k]).node;
+        }
+        os << ")";
+        if (p == Policy::case_per_core) os << ", I/O on CPU " << io_cpu(0);
+    }
+
+    os << "; " << t.packages << (t.packages == 1 ? " package, " : " packages, ")
+        << t.cores.size() << (t.cores.size() == 1 ? " core, " : " cores, ")
+        << t.cpus.size() << (t.cpus.size() == 1 ? " CPU, " : " CPUs, ")
+        << t.nodes << (t.nodes == 1 ? " node" : " nodes") << std::endl;
+}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace affinity {
+
+    // Hardware thread as listed in /sys/devices/system/cpu
+    struct Cpu {
+        int id = 0;                     // Logical CPU number [-]
+        int core = 0;                   // Index into Topology::cores [-]
+        int package = 0;                // physical_package_id (socket) [-]
+        int node = 0;                   // NUMA node, 0 without /sys/devices/system/node [-]
+    };
+
+    struct Topology {
+        std::vector<Cpu> cpus;                  // Online CPUs, by id
+        std::vector<std::vector<int>> cores;    // Hardware threads of each core, by package and core_id
+        int packages = 1;                       // Sockets [-]
+        int nodes = 1;                          // NUMA nodes with CPUs [-]
+    };
+
+    // Read from sysfs on first use; one CPU per core, one package and one
+    // node where the files are missing
+    const Topology& topology();
+
+    // Order in which solver threads, or the workers of a batch, take CPUs:
+    //
+    //     compact        the hyperthreads of a core, then the next core,
+    //                    filling package 0 before package 1
+    //     scatter        one hyperthread per core, alternating between
+    //                    packages; second hyperthreads only after all cores
+    //     case_per_core  one hyperthread per core, in compact core order;
+    //                    its sibling hyperthread takes that slot's I/O
+    //
+    // Slots beyond the CPUs wrap around. With none nothing is pinned and
+    // the operating system places the threads.
+    enum class Policy { none, compact, scatter, case_per_core };
+
+    Policy policy(const std::string& name);
+    const char* name(Policy p);
+
+    // Applies to the pin calls from then on
+    void configure(Policy p);
+    Policy current();
+
+    // CPU of solver thread or worker `slot`; -1 with none
+    int cpu(int slot);
+
+    // CPU of the I/O of `slot`: its sibling hyperthread with case_per_core
+    // (the slot's own CPU without SMT), -1 (any online CPU) otherwise
+    int io_cpu(int slot);
+
+    // Pins the calling thread to `cpu`, or with -1 lets it run on every
+    // online CPU again; false where the kernel refuses or off Linux
+    bool pin(int cpu);
+
+    // Thread t of the OpenMP team to cpu(t). Call before the solver is
+    // built, so that first-touch and local placement find each thread on
+    // its final CPU; the runtime keeps the team's threads for later
+    // parallel regions.
+    void pin_team();
+
+    // The calling thread as batch worker `slot`; no-op with none
+    void pin_worker(int slot);
+
+    // CPUs of the I/O of `slot` (io_cpu, or every online CPU), worked out
+    // in advance for pin_io: a fork()ed checkpoint writer may only make
+    // async-signal-safe calls, and pin_io makes one system call and does
+    // not allocate. pin_io is a no-op with none.
+    struct IoCpus {
+        bool pin = false;                   // A policy other than none
+        std::vector<int> cpus;
+    };
+    IoCpus io_cpus(int slot);
+    void pin_io(const IoCpus& io);
+
+    // One line: policy, CPU and node of every pinned team thread, topology
+    void report(std::ostream& os);
+}
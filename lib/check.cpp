@@ -0,0 +1,178 @@
+#include "check.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <omp.h>
+
+#include "solver.h"
+#include "surrogate.h"
+
+namespace check {
+
+namespace {
+
+const int steps = 5;
+
+void advance(Solver& s) {
+    for (int n = 0; n < steps; ++n) s.step();
+}
+
+bool identical(const heap::vector<double>& a, const heap::vector<double>& b) {
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(double)) == 0;
+}
+
+bool identical(const Solver& a, const Solver& b) {
+    return identical(a.u_v, b.u_v) && identical(a.p_v, b.p_v)
+        && identical(a.T_v, b.T_v) && identical(a.rho_v, b.rho_v);
+}
+
+bool report(const std::string& name, bool ok, const std::string& detail) {
+    std::cout << "  " << (ok ? "ok      " : "FAILED  ") << name << ": " << detail << std::endl;
+    return ok;
+}
+
+// One Solver through lean -> large non-lean -> lean (float) cases, every
+// one compared with a cold Solver of the same case
+bool warm_reset(const Input& base) {
+
+    Input lean = base;
+    lean.N = 50;
+    lean.memory_lean = true;
+    lean.lean_float = false;
+
+    Input large = base;
+    large.N = std::max(500, base.N);
+    large.memory_lean = false;
+
+    Input lean_float = lean;
+    lean_float.lean_float = true;
+
+    bool ok = true;
+    Solver warm(lean);
+
+    for (const Input* in : { &lean, &large, &lean_float, &large }) {
+
+        if (in != &lean) warm.reset(*in);
+        advance(warm);
+
+        Solver cold(*in);
+        advance(cold);
+
+        ok = ok && identical(warm, cold);
+    }
+
+    return report("warm reset", ok, "N 50 lean -> " + std::to_string(large.N) + " -> 50 lean float -> "
+        + std::to_string(large.N) + ", against cold solvers");
+}
+
+// The case on 2048 cells or more, so that the loops run in parallel, in
+// deterministic mode on 1 thread and on 2, 3 and 4
+bool thread_count(const Input& base) {
+
+    Input in = base;
+    in.N = std::max(2048, base.N);
+    in.deterministic = true;
+
+    const int threads = omp_get_max_threads();
+    bool ok = true;
+
+    omp_set_num_threads(1);
+    Solver one(in);
+    advance(one);
+
+    for (int t = 2; t <= 4; ++t) {
+
+        omp_set_num_threads(t);
+        Solver many(in);
+        advance(many);
+
+        ok = ok && identical(one, many);
+    }
+
+    omp_set_num_threads(threads);
+
+    return report("thread count", ok, "N " + std::to_string(in.N) + " deterministic, 1 thread against 2, 3 and 4");
+}
+
+// A small surrogate of the case over mu and cp, written and read back:
+// the loaded model must give the same outputs and error estimates, bit
+// for bit, at random points
+bool surrogate_file(const Input& base, const std::string& inputFile) {
+
+    auto keys = readKeyValues(inputFile);
+    std::ostringstream end;
+    end.precision(17);
+    end << steps * base.dt_user;
+    keys["simulation_time"] = end.str();
+
+    surrogate::Spec spec;
+    spec.base_input = inputFile;
+    spec.parameters = { "mu", "cp" };
+    for (double v : { base.mu, base.cp }) {
+        spec.lower.push_back(v > 0.0 ? 0.9 * v : 0.0);
+        spec.upper.push_back(v > 0.0 ? 1.1 * v : 1.0e-3);
+    }
+    spec.outputs = { { 'T', 0.5 * base.L }, { 'p', -1.0 } };
+    spec.tolerance = 0.0;
+    spec.max_level = 3;
+    spec.max_points = 9;
+
+    const std::filesystem::path dir = std::filesystem::path("output") / "check";
+    std::filesystem::create_directories(dir);
+    const std::string file = (dir / "surrogate.sg").string();
+
+    std::ostringstream log;
+    const surrogate::Model built = surrogate::Model::build(spec, keys, log);
+    built.save(file);
+    const surrogate::Model loaded = surrogate::Model::load(file);
+
+    bool ok = loaded.points() == built.points() && loaded.components() == built.components()
+        && loaded.parameters() == built.parameters() && loaded.labels() == built.labels();
+
+    std::mt19937 rng(1);
+    std::vector<double> p(spec.parameters.size());
+    std::vector<double> out[2], err[2];
+
+    for (int trial = 0; trial < 8 && ok; ++trial) {
+
+        for (std::size_t d = 0; d < p.size(); ++d)
+            p[d] = std::uniform_real_distribution<double>(spec.lower[d], spec.upper[d])(rng);
+
+        int k = 0;
+        for (const surrogate::Model* m : { &built, &loaded }) {
+            out[k].assign(m->components(), 0.0);
+            err[k].assign(m->components(), 0.0);
+            m->evaluate(p.data(), out[k].data(), err[k].data());
+            ++k;
+        }
+
+        ok = std::memcmp(out[0].data(), out[1].data(), out[0].size() * sizeof(double)) == 0
+            && std::memcmp(err[0].data(), err[1].data(), err[0].size() * sizeof(double)) == 0;
+    }
+
+    return report("surrogate file", ok, std::to_string(built.points()) + " points over mu and cp, saved to "
+        + file + " and loaded, against the built model");
+}
+
+}
+
+int run(const Input& base, const std::string& inputFile) {
+
+    std::cout << "Regression checks on " << std::filesystem::path(inputFile).filename().string()
+        << ", " << steps << " steps each\n";
+
+    bool ok = true;
+    ok = warm_reset(base) && ok;
+    ok = thread_count(base) && ok;
+    ok = surrogate_file(base, inputFile) && ok;
+
+    std::cout << (ok ? "All checks passed" : "Checks FAILED") << std::endl;
+    return ok ? 0 : 1;
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "input.h"
+
+namespace check {
+
+    // Regression checks of guarantees the drivers rely on, each run on a
+    // few steps of the case `base`, and reported as one line on stdout:
+    //
+    //   warm reset   a Solver reset() from a memory-lean case to a larger
+    //                case without it, and back, gives bit for bit the
+    //                fields of a Solver built for that case
+    //   thread count the case on 2048 cells in deterministic mode gives the
+    //                same fields, bit for bit, on 1, 2, 3 and 4 threads
+    //   surrogate    a small surrogate of the case, saved and loaded,
+    //   file         evaluates bit for bit as the model that was built
+    //
+    // `base` is read from `inputFile`. Returns 1 if any check fails.
+    int run(const Input& base, const std::string& inputFile);
+}
@@ -0,0 +1,364 @@
+#include "checkpoint.h"
+
+#include "affinity.h"
+#include "input.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <omp.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace checkpoint {
+
+namespace {
+
+const char magic[8] = { 'R', 'H', 'O', 'P', 'I', 'S', 'O', '1' };
+
+template <typename T>
+void put(std::vector<char>& out, const T& value) {
+    const char* p = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T get(std::ifstream& in) {
+    T value{};
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+
+// Bytes of the file in order: the header and field descriptions, which
+// live in `head`, alternating with the field arrays, which are not copied
+struct Layout {
+    std::vector<char> head;
+    std::vector<std::pair<const char*, std::size_t>> pieces;
+};
+
+Layout layout(int step, double time, double dt, const std::vector<Field>& fields) {
+
+    Layout l;
+    std::vector<std::size_t> cut;           // End of the description of each field in head
+
+    l.head.insert(l.head.end(), magic, magic + sizeof(magic));
+    put<std::int32_t>(l.head, step);
+    put<double>(l.head, time);
+    put<double>(l.head, dt);
+    put<std::uint32_t>(l.head, static_cast<std::uint32_t>(fields.size()));
+
+    for (const Field& f : fields) {
+        put<std::uint32_t>(l.head, static_cast<std::uint32_t>(f.name.size()));
+        l.head.insert(l.head.end(), f.name.begin(), f.name.end());
+        put<std::uint64_t>(l.head, f.size);
+        cut.push_back(l.head.size());
+    }
+
+    // Only now is head at its final address
+    std::size_t from = 0;
+    for (std::size_t k = 0; k < fields.size(); ++k) {
+        l.pieces.emplace_back(l.head.data() + from, cut[k] - from);
+        l.pieces.emplace_back(reinterpret_cast<const char*>(fields[k].data), fields[k].size * sizeof(double));
+        from = cut[k];
+    }
+    l.pieces.emplace_back(l.head.data() + from, l.head.size() - from);
+
+    return l;
+}
+
+#ifdef __linux__
+// Writes `tmp`, syncs it and renames it over `file` with system calls
+// only: no allocation, locks or stdio, so a fork()ed child of a threaded
+// process may call it. 0 on success.
+int save(const char* tmp, const char* file, const Layout& l) {
+
+    const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return 1;
+
+    for (const auto& piece : l.pieces) {
+
+        const char* p = piece.first;
+        std::size_t left = piece.second;
+
+        while (left > 0) {
+            const ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                close(fd);
+                return 1;
+            }
+            p += n;
+            left -= static_cast<std::size_t>(n);
+        }
+    }
+
+    if (fsync(fd) != 0) {
+        close(fd);
+        return 1;
+    }
+    if (close(fd) != 0) return 1;
+
+    return rename(tmp, file) == 0 ? 0 : 1;
+}
+
+// fsync of a file or directory by path: a written file's data, or a
+// directory's entries after a rename in it. True on success.
+bool sync(const std::filesystem::path& path) {
+
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    const bool ok = fsync(fd) == 0;
+    return close(fd) == 0 && ok;
+}
+#endif
+
+}
+
+void write(
+    const std::filesystem::path& file,
+    int step,
+    double time,
+    double dt,
+    const std::vector<Field>& fields)
+{
+    std::filesystem::path tmp = file;
+    tmp += ".tmp";
+
+    const Layout l = layout(step, time, dt, fields);
+
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Checkpoint: cannot open " + tmp.string());
+
+        for (const auto& piece : l.pieces)
+            out.write(piece.first, piece.second);
+
+        if (!out)
+            throw std::runtime_error("Checkpoint: write failed for " + tmp.string());
+    }
+
+    std::filesystem::rename(tmp, file);
+}
+
+Snapshot read(const std::filesystem::path& file) {
+
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+        throw std::runtime_error("Checkpoint: cannot open " + file.string());
+
+    char header[sizeof(magic)];
+    in.read(header, sizeof(header));
+    if (!in || !std::equal(header, header + sizeof(header), magic))
+        throw std::runtime_error("Checkpoint: bad header in " + file.string());
+
+    Snapshot s;
+    s.step = get<std::int32_t>(in);
+    s.time = get<double>(in);
+    s.dt = get<double>(in);
+
+    const std::uint32_t count = get<std::uint32_t>(in);
+
+    for (std::uint32_t k = 0; k < count; ++k) {
+
+        std::string name(get<std::uint32_t>(in), '\0');
+        in.read(name.data(), name.size());
+
+        std::vector<double> data(get<std::uint64_t>(in));
+        in.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(double));
+
+        s.fields[name] = std::move(data);
+    }
+
+    if (!in)
+        throw std::runtime_error("Checkpoint: truncated file " + file.string());
+
+    return s;
+}
+
+std::filesystem::path resolve(const std::filesystem::path& file) {
+
+    if (file.extension() != ".manifest")
+        return file;
+
+    if (!std::filesystem::exists(file))
+        throw std::runtime_error("Checkpoint: cannot open " + file.string());
+
+    auto dict = readKeyValues(file.string());
+    if (!dict.count("file"))
+        throw std::runtime_error("Checkpoint: no file entry in " + file.string());
+
+    return file.parent_path() / dict["file"];
+}
+
+Writer::Writer(const std::filesystem::path& dir, bool async) : dir_(dir) {
+
+#ifdef __linux__
+    async_ = async;
+#else
+    (void)async;
+#endif
+
+    // A restarted case takes over the checkpoint its manifest names, so
+    // that the first new one replaces it
+    const std::filesystem::path manifest = dir_ / "checkpoint.manifest";
+    if (async_ && std::filesystem::exists(manifest)) {
+        try {
+            committed_ = resolve(manifest);
+        }
+        catch (const std::exception&) {}
+    }
+}
+
+Writer::~Writer() {
+    finish();
+}
+
+double Writer::write(int step, double time, double dt, const std::vector<Field>& fields) {
+
+    const double start = omp_get_wtime();
+
+    if (!async_) {
+        checkpoint::write(dir_ / "checkpoint.bin", step, time, dt, fields);
+        return omp_get_wtime() - start;
+    }
+
+#ifdef __linux__
+    finish();
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "checkpoint_%06d.bin", step);
+
+    // Everything the child needs is prepared here: after fork() in a
+    // threaded process it may only make async-signal-safe calls, and
+    // another thread may have held the allocator's or a stream's lock
+    // at fork()
+    const std::string file = (dir_ / name).string();
+    const std::string tmp = file + ".tmp";
+    const Layout l = layout(step, time, dt, fields);
+
+    // Off the solver's CPU, which the child inherits with the main thread
+    const affinity::IoCpus io = affinity::io_cpus(0);
+
+    // Nothing buffered in the parent may be written twice
+    std::cout.flush();
+    std::fflush(nullptr);
+
+    const pid_t pid = fork();
+
+    if (pid == 0) {
+
+        // Child: one thread, the fields as they were at fork(). _exit()
+        // skips the destructors and buffers inherited from the parent.
+        affinity::pin_io(io);
+        _exit(save(tmp.c_str(), file.c_str(), l));
+    }
+
+    if (pid < 0) {
+        std::cout << "[checkpoint] step " << step << ": fork failed, writing synchronously" << std::endl;
+        checkpoint::write(dir_ / "checkpoint.bin", step, time, dt, fields);
+        return omp_get_wtime() - start;
+    }
+
+    pending_.pid = pid;
+    pending_.step = step;
+    pending_.time = time;
+    pending_.dt = dt;
+    pending_.started = omp_get_wtime();
+    pending_.file = dir_ / name;
+#endif
+
+    return omp_get_wtime() - start;
+}
+
+void Writer::poll() {
+
+#ifdef __linux__
+    if (pending_.pid < 0) return;
+
+    int status = 0;
+    if (waitpid(pending_.pid, &status, WNOHANG) == pending_.pid)
+        commit(status);
+#endif
+}
+
+void Writer::finish() {
+
+#ifdef __linux__
+    if (pending_.pid < 0) return;
+
+    int status = 0;
+    while (waitpid(pending_.pid, &status, 0) < 0 && errno == EINTR) {}
+    commit(status);
+#endif
+}
+
+void Writer::commit(int status) {
+
+#ifdef __linux__
+    const Pending p = pending_;
+    pending_ = Pending();
+
+    std::error_code ec;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::filesystem::path tmp = p.file;
+        tmp += ".tmp";
+        std::filesystem::remove(tmp, ec);
+        std::filesystem::remove(p.file, ec);
+        std::cout << "[checkpoint] step " << p.step << ": writer failed, "
+            << (committed_.empty() ? "no checkpoint kept" : committed_.filename().string() + " kept") << std::endl;
+        return;
+    }
+
+    const std::filesystem::path manifest = dir_ / "checkpoint.manifest";
+    std::filesystem::path tmp = manifest;
+    tmp += ".tmp";
+
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out.precision(17);
+        out << "file = " << p.file.filename().string() << "\n"
+            << "step = " << p.step << "\n"
+            << "time = " << p.time << "\n"
+            << "dt = " << p.dt << "\n";
+
+        out.close();
+        if (!out || !sync(tmp)) {
+            std::cout << "[checkpoint] step " << p.step << ": cannot write " << tmp.string() << std::endl;
+            return;
+        }
+    }
+
+    // The manifest's data is on disk before it replaces the old one, and the
+    // directory entries of both renames (checkpoint and manifest) before the
+    // old checkpoint is removed
+    std::filesystem::rename(tmp, manifest, ec);
+    if (ec || !sync(dir_)) {
+        std::cout << "[checkpoint] step " << p.step << ": cannot commit " << manifest.string() << std::endl;
+        return;
+    }
+
+    if (!committed_.empty() && committed_ != p.file)
+        std::filesystem::remove(committed_, ec);
+    committed_ = p.file;
+
+    std::cout << "[checkpoint] step " << p.step << ": " << p.file.filename().string()
+        << " complete after " << omp_get_wtime() - p.started << " s" << std::endl;
+#else
+    (void)status;
+#endif
+}
+
+}
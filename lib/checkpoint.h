@@ -0,0 +1,91 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace checkpoint {
+
+    // Non-owning view of a solver array to be saved
+    struct Field {
+        std::string name;
+        const double* data;
+        std::size_t size;
+    };
+
+    struct Snapshot {
+        int step = 0;                   // Last completed time step [-]
+        double time = 0.0;              // Simulated time [s]
+        double dt = 0.0;                // Time step in use [s]
+        std::unordered_map<std::string, std::vector<double>> fields;
+    };
+
+    // Writes to `file`.tmp and renames it over `file`, so a crash never
+    // leaves a truncated checkpoint behind
+    void write(
+        const std::filesystem::path& file,
+        int step,
+        double time,
+        double dt,
+        const std::vector<Field>& fields
+    );
+
+    Snapshot read(const std::filesystem::path& file);
+
+    // A restart target: a checkpoint file, or a manifest naming one
+    std::filesystem::path resolve(const std::filesystem::path& file);
+
+    // Checkpoints of a running case in `dir`.
+    //
+    // Synchronous: write() saves checkpoint.bin before returning.
+    //
+    // Asynchronous (Linux): write() fork()s, and the child saves its
+    // copy-on-write view of the fields to checkpoint_<step>.bin and exits,
+    // while the parent goes on with the next step. The child only makes
+    // system calls (open, write, fsync, rename, _exit) on a layout the
+    // parent built before fork(). The parent keeps at most
+    // one child in flight: a new request first waits for the previous one.
+    // poll() reaps a finished child; on a zero exit status the parent
+    // renames checkpoint.manifest.tmp over checkpoint.manifest, which names
+    // the last complete checkpoint, and only then removes the one before.
+    // A crash at any point leaves a manifest naming a complete file. A
+    // Writer on a directory that already has a manifest (a restart) treats
+    // the file it names as the previous checkpoint.
+    class Writer {
+    public:
+        Writer(const std::filesystem::path& dir, bool async);
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        // Checkpoint of `step`. Returns the time the caller was held up [s]
+        double write(int step, double time, double dt, const std::vector<Field>& fields);
+
+        // Reaps a finished child without blocking; call once per step
+        void poll();
+
+        // Waits for the child in flight, if any
+        void finish();
+
+        bool async() const { return async_; }
+
+    private:
+        struct Pending {
+            int pid = -1;                       // Child in flight, -1 for none
+            int step = 0;
+            double time = 0.0;
+            double dt = 0.0;
+            double started = 0.0;               // Wall clock at fork() [s]
+            std::filesystem::path file;
+        };
+
+        void commit(int status);
+
+        std::filesystem::path dir_;
+        bool async_ = false;
+        Pending pending_;
+        std::filesystem::path committed_;       // File named by the manifest
+    };
+}
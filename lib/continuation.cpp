@@ -0,0 +1,289 @@
+#include "continuation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <omp.h>
+
+#include "solver.h"
+#include "schedule.h"
+#include "steady.h"
+
+namespace continuation {
+
+namespace {
+
+using steady::vars;
+using Parameter = schedule::Target;
+
+constexpr int newton_max = 8;           // Corrector iterations before the step is halved [-]
+constexpr double newton_tol = 1e-10;    // Scaled Newton update that ends the corrector [-]
+constexpr double grow = 1.5;            // Step growth after an easy corrector [-]
+constexpr int max_points = 500;         // Points traced at most [-]
+
+// Point of the branch: state, parameter and unit tangent
+struct Point {
+    std::vector<double> q;
+    double lambda = 0.0;
+    std::vector<double> t_q;
+    double t_lambda = 0.0;
+};
+
+// Inner product of the arclength, every variable scaled by its magnitude
+struct Metric {
+    double w[vars] = {};                            // 1 / scale of u, p, T, bVU
+    double w_lambda = 1.0;                          // 1 / scale of the parameter
+
+    double dot(const std::vector<double>& a, double a_lambda, const std::vector<double>& b, double b_lambda) const {
+        double sum = w_lambda * w_lambda * a_lambda * b_lambda;
+        for (std::size_t k = 0; k < a.size(); ++k)
+            sum += w[k % vars] * w[k % vars] * a[k] * b[k];
+        return sum;
+    }
+};
+
+// dR/dlambda by central differences: R is linear in the sources and the
+// boundary values, so this is exact to round-off
+std::vector<double> residual_lambda(const Parameter& p, Solver& s, const std::vector<double>& q, double lambda) {
+
+    const double h = 1e-6 * std::max(std::fabs(lambda), 1.0);
+    std::vector<double> r_plus, r_minus;
+
+    schedule::set(p, s, lambda + h);
+    steady::residual(s, q, r_plus);
+    schedule::set(p, s, lambda - h);
+    steady::residual(s, q, r_minus);
+    schedule::set(p, s, lambda);
+
+    for (std::size_t k = 0; k < r_plus.size(); ++k)
+        r_plus[k] = (r_plus[k] - r_minus[k]) / (2.0 * h);
+
+    return r_plus;
+}
+
+// Unit tangent at a converged point, J z = -dR/dlambda, oriented along
+// `previous` (or towards increasing lambda times `sign`)
+void tangent(const Parameter& p, Solver& s, const Metric& m, Point& x, const Point* previous, double sign) {
+
+    const steady::Jacobian J = steady::jacobian(s, x.q);
+    std::vector<double> z = residual_lambda(p, s, x.q, x.lambda);
+    for (double& v : z) v = -v;
+    steady::solve(J, z);
+
+    double norm = std::sqrt(m.dot(z, 1.0, z, 1.0));
+    double orient = previous ? m.dot(z, 1.0, previous->t_q, previous->t_lambda) : sign;
+    if (orient < 0.0) norm = -norm;
+
+    x.t_q = z;
+    for (double& v : x.t_q) v /= norm;
+    x.t_lambda = 1.0 / norm;
+}
+
+// Newton corrector from the prediction x on the steady residuals and the
+// arclength condition, or at fixed lambda for the landing on the end
+// value; returns the iterations, or -1
+int correct(const Parameter& p, Solver& s, const Metric& m, const Point& from, Point& x, bool fixed) {
+
+    const std::vector<double> q_pred = x.q;
+    const double lambda_pred = x.lambda;
+
+    std::vector<double> r, dq(x.q.size());
+
+    for (int it = 1; it <= newton_max; ++it) {
+
+        schedule::set(p, s, x.lambda);
+
+        steady::residual(s, x.q, r);
+        const steady::Jacobian J = steady::jacobian(s, x.q);
+
+        // Bordering: x1 = -J^-1 R, x2 = -J^-1 dR/dlambda, then the
+        // arclength row fixes dlambda
+        std::vector<double> x1 = r;
+        for (double& v : x1) v = -v;
+        steady::solve(J, x1);
+
+        std::vector<double> x2(x1.size(), 0.0);
+        double d_lambda = 0.0;
+
+        if (!fixed) {
+            x2 = residual_lambda(p, s, x.q, x.lambda);
+            for (double& v : x2) v = -v;
+            steady::solve(J, x2);
+
+            for (std::size_t k = 0; k < dq.size(); ++k) dq[k] = x.q[k] - q_pred[k];
+            const double g = m.dot(from.t_q, from.t_lambda, dq, x.lambda - lambda_pred);
+
+            d_lambda = -(g + m.dot(from.t_q, 0.0, x1, 0.0)) / (m.dot(from.t_q, from.t_lambda, x2, 1.0));
+        }
+
+        for (std::size_t k = 0; k < dq.size(); ++k) dq[k] = x1[k] + d_lambda * x2[k];
+        for (std::size_t k = 0; k < dq.size(); ++k) x.q[k] += dq[k];
+        x.lambda += d_lambda;
+
+        const double update = std::sqrt(m.dot(dq, d_lambda, dq, d_lambda));
+
+        if (!std::isfinite(update)) return -1;
+        if (update < newton_tol) return it;
+    }
+
+    return -1;
+}
+
+double pressure_drop(const std::vector<double>& q, int N) {
+    return q[1] - q[vars * (N - 1) + 1];
+}
+
+double peak_T(const std::vector<double>& q, int N) {
+    double T = q[2];
+    for (int i = 1; i < N; ++i) T = std::max(T, q[vars * i + 2]);
+    return T;
+}
+}
+
+int run(const Input& in, const std::string& caseName, const std::string& name, double end, double step) {
+
+    if (in.Nr > 1)
+        throw std::runtime_error("--continuation is for the 1D solver (Nr = 1)");
+    if (in.inlet_lumped.type != "none" || in.outlet_lumped.type != "none")
+        throw std::runtime_error("--continuation needs plain boundary conditions, not lumped components");
+
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+
+    Solver s(in);
+
+    if (!s.eos_density)
+        throw std::runtime_error("--continuation needs the density on the equation of state: set eos_density = 1");
+
+    const Parameter p = schedule::target(in, s, name);
+    const double start = in.*p.key;
+
+    if (end == start)
+        throw std::runtime_error("--continuation: the end value equals the start value");
+    if (step == 0.0) step = (end - start) / 20.0;
+
+    const double direction = end > start ? 1.0 : -1.0;
+
+    std::cout << "Continuation of " << caseName << " in " << name << " from " << start << " to " << end << "\n";
+
+    // First point: the transient run from the initial state
+    const double t0 = omp_get_wtime();
+    for (int n = 0; n <= time_steps; ++n)
+        s.step();
+    const int extra = steady::settle(s, 10 * (time_steps + 1), 1e-12);
+    const double transient = omp_get_wtime() - t0;
+
+    if (extra < 0)
+        std::cout << "# warning: the first point is not steady after " << 11 * (time_steps + 1) << " steps\n";
+
+    Point x;
+    x.q = steady::state(s);
+    x.lambda = start;
+
+    Metric m;
+    for (int v = 0; v < vars; ++v) {
+        double scale = 0.0;
+        for (int i = 0; i < s.N; ++i) scale = std::max(scale, std::fabs(x.q[vars * i + v]));
+        m.w[v] = 1.0 / std::max(scale, 1e-30);
+    }
+    m.w_lambda = 1.0 / std::max(std::fabs(start), std::fabs(end - start));
+
+    tangent(p, s, m, x, nullptr, direction);
+
+    // Arclength step from the parameter step of a straight branch
+    double ds = std::fabs(step / x.t_lambda);
+    const double ds_max = 10.0 * ds;
+    const double ds_min = 1e-6 * ds;
+
+    const std::filesystem::path outputDir = std::filesystem::path("output") / caseName;
+    std::filesystem::create_directories(outputDir);
+
+    std::ofstream csv(outputDir / "continuation.csv");
+    csv << std::setprecision(12) << "point," << name << ",pressure_drop,peak_T,newton,ds,turning,wall_s\n";
+
+    const auto report = [&](int k, const Point& pt, int newton, bool turning, double wall) {
+
+        csv << k << "," << pt.lambda << "," << pressure_drop(pt.q, s.N) << "," << peak_T(pt.q, s.N) << ","
+            << newton << "," << ds << "," << turning << "," << wall << "\n";
+
+        std::cout << std::setw(5) << k << std::setw(16) << std::setprecision(8) << pt.lambda
+            << std::setw(16) << pressure_drop(pt.q, s.N) << std::setw(14) << peak_T(pt.q, s.N)
+            << std::setw(8) << newton << std::setw(12) << std::setprecision(3) << wall * 1e3
+            << (turning ? "   turning point" : "") << "\n";
+    };
+
+    std::cout << "First point: " << transient << " s, " << time_steps + 1 + std::max(extra, 0) << " time steps\n\n"
+        << std::setw(5) << "point" << std::setw(16) << name << std::setw(16) << "dp [Pa]" << std::setw(14) << "peak T [K]"
+        << std::setw(8) << "newton" << std::setw(12) << "wall [ms]" << "\n";
+
+    report(0, x, 0, false, transient);
+
+    int points = 0, turning_points = 0, newton_total = 0;
+    double wall_total = 0.0;
+
+    while (points < max_points) {
+
+        const double t1 = omp_get_wtime();
+
+        // Last step lands on the end value while the branch heads there
+        bool last = false;
+        if (x.t_lambda * direction > 0.0 && (x.lambda + ds * x.t_lambda - end) * direction >= 0.0) {
+            ds = (end - x.lambda) / x.t_lambda;
+            last = true;
+        }
+
+        Point next;
+        next.q = x.q;
+        for (std::size_t k = 0; k < next.q.size(); ++k) next.q[k] += ds * x.t_q[k];
+        next.lambda = x.lambda + ds * x.t_lambda;
+
+        const int newton = correct(p, s, m, x, next, last);
+
+        if (newton < 0) {
+            ds *= 0.5;
+            if (ds >= ds_min) continue;
+
+            // Typically an upwind switch: the residuals are not smooth there
+            std::cout << "# the corrector fails even at the smallest step: branch ends at "
+                << name << " = " << x.lambda << "\n";
+            break;
+        }
+
+        tangent(p, s, m, next, &x, direction);
+
+        const bool turning = next.t_lambda * x.t_lambda < 0.0;
+        if (turning) ++turning_points;
+
+        const double wall = omp_get_wtime() - t1;
+        wall_total += wall;
+        newton_total += newton;
+
+        x = std::move(next);
+        report(++points, x, newton, turning, wall);
+
+        if (last || (x.lambda - end) * direction >= 0.0) break;
+
+        if (newton <= 3) ds = std::min(ds * grow, ds_max);
+        else if (newton >= 6) ds *= 0.5;
+    }
+
+    // Final state into the solver for its residual report
+    schedule::set(p, s, x.lambda);
+    std::vector<double> r;
+    steady::residual(s, x.q, r);
+    const steady::Norms n = steady::norms(s, r);
+
+    std::cout << "\n" << points << " points, " << newton_total << " Newton iterations, "
+        << std::setprecision(3) << wall_total << " s (" << wall_total / std::max(points, 1) * 1e3 << " ms per point), "
+        << turning_points << " turning points\n" << std::scientific
+        << "Last point residuals: momentum " << n.momentum << " N/m2, continuity " << n.continuity
+        << " kg/(m2 s), energy " << n.energy << " W/m2\n" << std::defaultfloat
+        << "Branch written to " << (outputDir / "continuation.csv").string() << std::endl;
+
+    return 0;
+}
+}
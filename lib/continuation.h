@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include "input.h"
+
+namespace continuation {
+
+    // Steady operating map by pseudo-arclength continuation:
+    // rhoPISO --continuation <input file> <parameter> <end value> [step].
+    //
+    // The parameter is S_m_cell or S_h_cell (the source zones of the input
+    // scaled as a whole) or one of the boundary values u/T/p_inlet/outlet_value.
+    // The first point is the case run from its initial state to
+    // simulation_time and on until steady. From there the branch (q, lambda)
+    // of steady solutions (see steady.h) is traced: an Euler predictor along
+    // the unit tangent, then a Newton corrector on the steady residuals
+    // together with the arclength condition t . (x - x_pred) = 0, in the
+    // inner product scaled by the magnitude of every variable. The bordered
+    // Newton system is solved with two block Thomas solves of the Jacobian.
+    //
+    // The step grows by 1.5 after a corrector of at most 3 iterations and
+    // halves after one of 6 or more; a corrector that fails is retried with
+    // half the step. A sign change of dlambda/ds along the tangent is
+    // reported as a turning point (fold), where the branch turns back and a
+    // natural-parameter sweep would lose it. Every point is written to
+    // output/<case>/continuation.csv with the pressure drop and peak T.
+    int run(const Input& in, const std::string& caseName, const std::string& parameter, double end, double step);
+}
@@ -0,0 +1,116 @@
+#include "control.h"
+
+#include "input.h"
+
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace control {
+
+namespace {
+
+template <typename T>
+bool update(int step, const std::string& key, T& target, T value) {
+
+    if (value == target)
+        return false;
+
+    std::cout << "[control] step " << step << ": " << key << " = " << value
+        << " (was " << target << ")" << std::endl;
+
+    target = value;
+    return true;
+}
+
+void reject(int step, const std::string& key, const std::string& value) {
+    std::cout << "[control] step " << step << ": ignored " << key << " = " << value << std::endl;
+}
+
+// Request entry: true, and logged, only when it turns on
+bool request(int step, const std::string& key, bool& last, bool value) {
+
+    const bool fire = value && !last;
+    last = value;
+
+    if (fire) std::cout << "[control] step " << step << ": " << key << " requested" << std::endl;
+    return fire;
+}
+
+}
+
+Poller::Poller(const std::string& file, int every)
+    : file_(file), every_(every > 0 ? every : 1), enabled_(!file.empty())
+{
+    std::error_code ec;
+    if (!enabled_ || !std::filesystem::exists(file_, ec))
+        return;
+
+    stamp_ = std::filesystem::last_write_time(file_, ec);
+
+    // Requests left in the file from an earlier run are not new
+    for (const auto& [key, value] : readKeyValues(file_.string())) {
+        try {
+            if (key == "stop") stop_ = std::stoi(value) != 0;
+            else if (key == "checkpoint") checkpoint_ = std::stoi(value) != 0;
+        }
+        catch (const std::exception&) {}
+    }
+}
+
+bool Poller::poll(int step, Settings& s) {
+
+    std::error_code ec;
+    const auto stamp = std::filesystem::last_write_time(file_, ec);
+    if (ec || stamp == stamp_)
+        return false;
+
+    stamp_ = stamp;
+    bool changed = false;
+    bool stop = false, checkpoint = false;  // Entries present in the file
+
+    for (const auto& [key, value] : readKeyValues(file_.string())) {
+
+        try {
+            if (key == "piso_outer_tol" && std::stod(value) > 0.0)
+                changed |= update(step, key, s.piso_outer_tol, std::stod(value));
+            else if (key == "piso_inner_tol" && std::stod(value) > 0.0)
+                changed |= update(step, key, s.piso_inner_tol, std::stod(value));
+            else if (key == "piso_outer_iter" && std::stoi(value) > 0)
+                changed |= update(step, key, s.piso_outer_iter, std::stoi(value));
+            else if (key == "piso_inner_iter" && std::stoi(value) > 0)
+                changed |= update(step, key, s.piso_inner_iter, std::stoi(value));
+            else if (key == "dt_max" && std::stod(value) > 0.0)
+                changed |= update(step, key, s.dt_max, std::stod(value));
+            else if (key == "dt" && std::stod(value) > 0.0)
+                changed |= update(step, key, s.dt, std::stod(value));
+            else if (key == "number_output" && std::stoi(value) > 0)
+                changed |= update(step, key, s.number_output, std::stoi(value));
+            else if (key == "stop") {
+                stop = true;
+                if (request(step, key, stop_, std::stoi(value) != 0)) changed = s.stop = true;
+            }
+            else if (key == "checkpoint") {
+                checkpoint = true;
+                if (request(step, key, checkpoint_, std::stoi(value) != 0)) changed = s.checkpoint = true;
+            }
+            else
+                reject(step, key, value);
+        }
+        catch (const std::exception&) {
+            reject(step, key, value);
+        }
+    }
+
+    // A removed request counts as 0, so adding it back fires again
+    if (!stop) stop_ = false;
+    if (!checkpoint) checkpoint_ = false;
+
+    // The time step never exceeds its limit, whichever of the two was edited
+    if (s.dt > s.dt_max)
+        changed |= update(step, "dt", s.dt, s.dt_max);
+
+    return changed;
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+namespace control {
+
+    // Run parameters that may be changed safely between two time steps
+    struct Settings {
+        double piso_outer_tol = 0.0;        // PISO outer tolerance [-]
+        double piso_inner_tol = 0.0;        // PISO inner tolerance [-]
+        int    piso_outer_iter = 0;         // PISO outer iterations [-]
+        int    piso_inner_iter = 0;         // PISO inner iterations [-]
+        double dt = 0.0;                    // Time step [s]
+        double dt_max = 0.0;                // Upper limit for the time step [s]
+        int    number_output = 0;           // Number of outputs over the remaining run [-]
+        bool   stop = false;                // Stop after the current step
+        bool   checkpoint = false;          // Write a checkpoint after the current step
+    };
+
+    // Watches a key = value control file (same syntax as the input files).
+    // The file is only looked at every `every` steps, and only re-read when
+    // its modification time changes, so a step costs one integer modulo and
+    // a poll costs one stat() call. Contents present before the run started
+    // are ignored: only edits made during the run are applied.
+    //
+    // stop and checkpoint are requests, not settings: one fires when its
+    // entry changes to 1 (from 0 or from absent), so that a later edit of
+    // another key does not repeat it. A second checkpoint needs the entry
+    // set to 0, or removed, in between.
+    class Poller {
+    public:
+        Poller(const std::string& file, int every);
+
+        bool due(int step) const { return enabled_ && step % every_ == 0; }
+
+        // Applies the valid entries of a modified file to `s`, logging every
+        // change. Returns true if anything was changed or requested.
+        bool poll(int step, Settings& s);
+
+    private:
+        std::filesystem::path file_;
+        int every_ = 1;
+        bool enabled_ = false;
+        std::filesystem::file_time_type stamp_{};
+        bool stop_ = false;                 // stop = 1 in the file when last read
+        bool checkpoint_ = false;           // checkpoint = 1 in the file when last read
+    };
+}
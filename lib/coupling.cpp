@@ -0,0 +1,147 @@
+#include "coupling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+#include <omp.h>
+
+#include "solver.h"
+
+namespace coupling {
+
+namespace {
+
+const char* name(Solver::Coupling mode) {
+    return mode == Solver::Coupling::jacobi ? "jacobi" : "gauss_seidel";
+}
+
+bool converged(const Solver& s) {
+    return s.momentum_residual <= s.outer_tol_v && s.temperature_residual <= s.outer_tol_v * 100;
+}
+
+struct Run {
+    long long outer = 0;        // Outer iterations over the run
+    int max_outer = 0;          // Most outer iterations in one step
+    int capped = 0;             // Steps that hit piso_outer_iter
+    double wall = 0.0;          // Wall time of the time loop [s]
+};
+
+Run run(Solver& s, int time_steps) {
+
+    Run r;
+    const double start = omp_get_wtime();
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        s.step();
+
+        r.outer += s.outer_v;
+        r.max_outer = std::max(r.max_outer, s.outer_v);
+        if (!converged(s)) ++r.capped;
+    }
+
+    r.wall = omp_get_wtime() - start;
+    return r;
+}
+
+double max_difference(const heap::vector<double>& a, const heap::vector<double>& b) {
+
+    double diff = 0.0;
+    for (std::size_t i = 0; i < a.size(); ++i)
+        diff = std::max(diff, std::fabs(a[i] - b[i]));
+    return diff;
+}
+
+}
+
+int compare(const Input& in, const std::string& caseName) {
+
+    if (in.memory_lean)
+        throw std::runtime_error("--coupling runs Jacobi coupling, which needs memory_lean = 0");
+
+    const Solver::Coupling modes[2] = { Solver::Coupling::gauss_seidel, Solver::Coupling::jacobi };
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+
+    const std::filesystem::path outputDir = std::filesystem::path("output") / caseName;
+    std::filesystem::create_directories(outputDir);
+
+    std::ofstream csv(outputDir / "coupling.csv");
+    csv << std::setprecision(10) << "section,coupling,k,momentum_residual,temperature_residual,continuity_residual\n";
+
+    std::cout << "Momentum/energy coupling on " << caseName << ", " << omp_get_max_threads() << " threads\n"
+        << "\nFirst step, residuals after k outer iterations\n"
+        << std::setw(4) << "k"
+        << std::setw(16) << "GS momentum" << std::setw(16) << "GS energy"
+        << std::setw(16) << "J momentum" << std::setw(16) << "J energy" << "\n";
+
+    // The first step is repeated with the outer loop capped at k
+    bool done[2] = { false, false };
+
+    for (int k = 1; k <= std::min(in.piso_outer_iter, 50) && !(done[0] && done[1]); ++k) {
+
+        std::cout << std::setw(4) << k << std::scientific << std::setprecision(3);
+
+        for (int m = 0; m < 2; ++m) {
+
+            Solver s(in);
+            s.coupling = modes[m];
+            s.tot_outer_v = k;
+            s.step();
+
+            std::cout << std::setw(16) << s.momentum_residual << std::setw(16) << s.temperature_residual;
+
+            csv << "history," << name(modes[m]) << "," << k << "," << s.momentum_residual << ","
+                << s.temperature_residual << "," << s.continuity_residual << "\n";
+
+            done[m] = done[m] || converged(s);
+        }
+
+        std::cout << std::defaultfloat << "\n";
+    }
+
+    // Whole run in both orderings
+    csv << "\nsection,coupling,steps,outer_iterations,max_outer,unconverged_steps,wall_s\n";
+
+    std::cout << "\nWhole run, " << time_steps + 1 << " steps\n"
+        << std::setw(14) << "coupling" << std::setw(12) << "outer" << std::setw(12) << "outer/step"
+        << std::setw(12) << "max outer" << std::setw(13) << "unconverged" << std::setw(12) << "wall [s]" << "\n";
+
+    std::vector<Solver> solvers;
+    solvers.reserve(2);
+
+    for (int m = 0; m < 2; ++m) {
+
+        solvers.emplace_back(in);
+        solvers.back().coupling = modes[m];
+
+        const Run r = run(solvers.back(), time_steps);
+
+        std::cout << std::setw(14) << name(modes[m]) << std::setw(12) << r.outer
+            << std::setw(12) << std::fixed << std::setprecision(2) << static_cast<double>(r.outer) / (time_steps + 1)
+            << std::setw(12) << r.max_outer << std::setw(13) << r.capped
+            << std::setw(12) << std::setprecision(3) << r.wall << std::defaultfloat << "\n";
+
+        csv << "run," << name(modes[m]) << "," << time_steps + 1 << "," << r.outer << ","
+            << r.max_outer << "," << r.capped << "," << r.wall << "\n";
+    }
+
+    const Solver& gs = solvers[0];
+    const Solver& j = solvers[1];
+
+    std::cout << std::scientific << std::setprecision(3)
+        << "\nLargest difference of the final fields (Jacobi - Gauss-Seidel): u " << max_difference(j.u_v, gs.u_v)
+        << " m/s, p " << max_difference(j.p_v, gs.p_v)
+        << " Pa, T " << max_difference(j.T_v, gs.T_v)
+        << " K, rho " << max_difference(j.rho_v, gs.rho_v) << " kg/m3" << std::defaultfloat << std::endl;
+
+    std::cout << "\nResults written to " << (outputDir / "coupling.csv").string() << std::endl;
+
+    return 0;
+}
+
+}
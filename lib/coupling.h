@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+#include "input.h"
+
+namespace coupling {
+
+    // Runs the case once with Gauss-Seidel and once with Jacobi coupling of
+    // momentum and energy and compares them: the residuals after each outer
+    // iteration of the first step, the outer/inner iteration totals and wall
+    // time over the whole run, and the largest difference between the final
+    // fields. Written to stdout and output/<case>/coupling.csv.
+    int compare(const Input& in, const std::string& caseName);
+}
@@ -0,0 +1,716 @@
+#include "ensemble.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <omp.h>
+
+#ifdef RHOPISO_MPI
+#include <mpi.h>
+#endif
+
+#include "affinity.h"
+#include "input.h"
+#include "schedule.h"
+#include "solver.h"
+
+namespace fs = std::filesystem;
+
+namespace ensemble {
+
+namespace {
+
+using Dict = std::unordered_map<std::string, std::string>;
+
+// Comma-separated list, trimmed
+std::vector<std::string> split(const std::string& s) {
+
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (!item.empty()) items.push_back(item);
+    }
+
+    return items;
+}
+
+std::string label(const Probe& p) {
+    std::ostringstream os;
+    os << (p.field == 'r' ? std::string("rho") : std::string(1, p.field)) << "@" << p.z;
+    return os.str();
+}
+
+#ifdef RHOPISO_MPI
+constexpr int tag_work = 1;                         // Rank 0 to a worker: a batch of cases
+constexpr int tag_stop = 2;                         // Rank 0 to a worker: no cases left
+constexpr int tag_result = 3;                       // Worker to rank 0: the results of its last batch
+
+// Messages between the ranks, native byte order (the ranks of a job run
+// the same build)
+class Writer {
+public:
+    template <typename T>
+    void put(const T& value) {
+        const char* p = reinterpret_cast<const char*>(&value);
+        buffer.insert(buffer.end(), p, p + sizeof(T));
+    }
+
+    void text(const std::string& s) {
+        put(static_cast<std::uint32_t>(s.size()));
+        buffer.insert(buffer.end(), s.begin(), s.end());
+    }
+
+    std::vector<char> buffer;
+};
+
+class Reader {
+public:
+    explicit Reader(const std::vector<char>& message) : p_(message.data()), end_(message.data() + message.size()) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        take(&value, sizeof(T));
+        return value;
+    }
+
+    std::string text() {
+        std::string s(get<std::uint32_t>(), '\0');
+        take(s.data(), s.size());
+        return s;
+    }
+
+private:
+    void take(void* out, std::size_t n) {
+        if (static_cast<std::size_t>(end_ - p_) < n)
+            throw std::runtime_error("Ensemble: truncated message");
+        std::memcpy(out, p_, n);
+        p_ += n;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+std::vector<char> pack(const std::vector<Case>& cases) {
+
+    Writer w;
+    w.put(static_cast<std::uint32_t>(cases.size()));
+
+    for (const Case& c : cases) {
+        w.put(static_cast<std::int32_t>(c.id));
+        w.put(static_cast<std::uint32_t>(c.set.size()));
+        for (const auto& kv : c.set) {
+            w.text(kv.first);
+            w.text(kv.second);
+        }
+    }
+
+    return w.buffer;
+}
+
+std::vector<Case> unpack_cases(const std::vector<char>& message) {
+
+    Reader r(message);
+    std::vector<Case> cases(r.get<std::uint32_t>());
+
+    for (Case& c : cases) {
+        c.id = r.get<std::int32_t>();
+        c.set.resize(r.get<std::uint32_t>());
+        for (auto& kv : c.set) {
+            kv.first = r.text();
+            kv.second = r.text();
+        }
+    }
+
+    return cases;
+}
+
+std::vector<char> pack(const std::vector<Result>& results) {
+
+    Writer w;
+    w.put(static_cast<std::uint32_t>(results.size()));
+
+    for (const Result& x : results) {
+        w.put(static_cast<std::int32_t>(x.id));
+        w.put(static_cast<std::int32_t>(x.rank));
+        w.put(static_cast<std::int32_t>(x.status));
+        w.put(static_cast<std::int64_t>(x.row));
+        w.put(static_cast<std::int32_t>(x.rows));
+        w.put(static_cast<std::int64_t>(x.field_row));
+        w.put(static_cast<std::int32_t>(x.steps));
+        w.put(static_cast<std::int64_t>(x.outer));
+        w.put(static_cast<std::int64_t>(x.solves));
+        w.put(x.wall);
+        w.put(static_cast<std::uint32_t>(x.probes.size()));
+        for (double v : x.probes) w.put(v);
+        w.text(x.message);
+    }
+
+    return w.buffer;
+}
+
+std::vector<Result> unpack_results(const std::vector<char>& message) {
+
+    Reader r(message);
+    std::vector<Result> results(r.get<std::uint32_t>());
+
+    for (Result& x : results) {
+        x.id = r.get<std::int32_t>();
+        x.rank = r.get<std::int32_t>();
+        x.status = r.get<std::int32_t>();
+        x.row = r.get<std::int64_t>();
+        x.rows = r.get<std::int32_t>();
+        x.field_row = r.get<std::int64_t>();
+        x.steps = r.get<std::int32_t>();
+        x.outer = r.get<std::int64_t>();
+        x.solves = r.get<std::int64_t>();
+        x.wall = r.get<double>();
+        x.probes.resize(r.get<std::uint32_t>());
+        for (double& v : x.probes) v = r.get<double>();
+        x.message = r.text();
+    }
+
+    return results;
+}
+#endif
+
+// One case as run, before it is written: the probe samples (time, then
+// one value per probe) and the final u, p, T, rho of every cell
+struct Run {
+    Result result;
+    std::vector<double> samples;
+    std::vector<double> fields;
+    double dz = 0.0;
+};
+
+void execute(const Campaign& campaign, const Dict& base, const Case& c, std::unique_ptr<Solver>& solver, Run& out) {
+
+    Dict dict = base;
+    for (const auto& kv : c.set) dict[kv.first] = kv.second;
+
+    Input in;
+    try {
+        in = parseInput(dict);
+    }
+    catch (const std::logic_error&) {
+        throw std::runtime_error("input value is not a number");      // std::stoi/stod say no more
+    }
+
+    if (in.Nr > 1)
+        throw std::runtime_error("r-z cases are not run in ensembles");
+
+    if (solver) solver->reset(in);
+    else solver = std::make_unique<Solver>(in);
+
+    Solver& s = *solver;
+    const long long solves = s.linear_solves;
+
+    // Steps and output instants of the file driver
+    schedule::Table schedule;
+    int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    if (!in.schedule_file.empty()) {
+        schedule = schedule::Table(in.schedule_file, in, s);
+        time_steps = schedule.steps(0.0, in.dt_user, in.simulation_time) - 1;
+    }
+    const int print_every = std::max(1, time_steps / std::max(1, in.number_output));
+
+    const auto sample = [&](std::vector<double>& v) {
+        for (const Probe& p : campaign.probes) {
+            const heap::vector<double>& x = p.field == 'u' ? s.u_v : p.field == 'p' ? s.p_v : p.field == 'T' ? s.T_v : s.rho_v;
+            v.push_back(s.probe(x, p.z));
+        }
+    };
+
+    Result& r = out.result;
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        if (!schedule.empty()) {
+            s.dt = schedule.step(s.time_total, in.dt_user, in.simulation_time);
+            schedule.apply(s, s.time_total, s.time_total + s.dt);
+        }
+
+        s.step();
+        r.outer += s.outer_v;
+
+        if (n % print_every == 0) {
+            out.samples.push_back(s.time_total);
+            sample(out.samples);
+            ++r.rows;
+        }
+    }
+
+    r.steps = time_steps + 1;
+    r.solves = s.linear_solves - solves;
+    sample(r.probes);
+
+    for (double v : r.probes)
+        if (!std::isfinite(v))
+            throw std::runtime_error("non-finite probe value at the end");
+
+    if (campaign.fields) {
+        out.dz = s.dz;
+        for (int i = 0; i < s.N; ++i)
+            out.fields.insert(out.fields.end(), { s.u_v[i], s.p_v[i], s.T_v[i], s.rho_v[i] });
+    }
+}
+
+// Runs the batches of one rank and appends them to its files
+class Worker {
+public:
+    Worker(const Campaign& campaign, int rank, int slot) : campaign_(campaign), rank_(rank), slot_(slot) {
+
+        base_ = readKeyValues(campaign.base_input);
+        const Input in = parseInput(base_);
+
+        // A batch of one runs on the base case's team, pinned from the
+        // rank's first slot on
+        if (in.threads > 0) omp_set_num_threads(in.threads);
+        affinity::configure(affinity::policy(in.affinity));
+        heap::configure(heapSettings(in));
+
+        #pragma omp parallel
+        affinity::pin_worker(slot_ + omp_get_thread_num());
+    }
+
+    std::vector<Result> run(const std::vector<Case>& cases) {
+
+        std::vector<Run> runs(cases.size());
+        const int width = std::min(static_cast<int>(cases.size()), campaign_.batch);
+        if (static_cast<int>(solvers_.size()) < width) solvers_.resize(width);
+
+        const auto one = [&](int k, std::unique_ptr<Solver>& solver) {
+
+            Run& out = runs[k];
+            out.result.id = cases[k].id;
+            out.result.rank = rank_;
+
+            const double start = omp_get_wtime();
+            try {
+                execute(campaign_, base_, cases[k], solver, out);
+            }
+            catch (const std::exception& e) {
+                out = Run();
+                out.result.id = cases[k].id;
+                out.result.rank = rank_;
+                out.result.status = 1;
+                out.result.message = e.what();
+                solver.reset();                     // May be half set up
+            }
+            out.result.wall = omp_get_wtime() - start;
+        };
+
+        if (width <= 1) {
+            for (int k = 0; k < static_cast<int>(cases.size()); ++k) one(k, solvers_[0]);
+        }
+        else {
+            // Side by side, as the parareal workers: plain threads with one
+            // OpenMP thread each, thread w on slot w of the rank
+            std::atomic<int> next{ 0 };
+            std::vector<std::thread> pool;
+
+            for (int w = 0; w < width; ++w) {
+                pool.emplace_back([&, w] {
+
+                    omp_set_num_threads(1);
+                    affinity::pin_worker(slot_ + w);
+
+                    for (int k; (k = next++) < static_cast<int>(cases.size()); )
+                        one(k, solvers_[w]);
+                });
+            }
+            for (std::thread& w : pool) w.join();
+        }
+
+        write(runs);
+
+        std::vector<Result> results;
+        for (Run& r : runs) results.push_back(std::move(r.result));
+        return results;
+    }
+
+private:
+    // Opened with the first batch, once rank 0 has made the directory
+    void write(std::vector<Run>& runs) {
+
+        const fs::path dir = fs::path("output") / campaign_.name;
+
+        if (!series_.is_open()) {
+
+            series_.open(dir / ("rank_" + std::to_string(rank_) + ".csv"));
+            series_ << "case,time";
+            for (const Probe& p : campaign_.probes) series_ << "," << label(p);
+            series_ << "\n" << std::setprecision(10);
+
+            if (campaign_.fields) {
+                fields_.open(dir / ("fields_" + std::to_string(rank_) + ".csv"));
+                fields_ << "case,i,z,u,p,T,rho\n" << std::setprecision(10);
+            }
+
+            if (!series_ || (campaign_.fields && !fields_))
+                throw std::runtime_error("Ensemble: cannot write to " + dir.string());
+        }
+
+        const std::size_t width = campaign_.probes.size() + 1;
+
+        for (Run& run : runs) {
+
+            Result& r = run.result;
+            r.row = series_rows_;
+
+            for (std::size_t k = 0; k < run.samples.size(); k += width) {
+                series_ << r.id;
+                for (std::size_t j = 0; j < width; ++j) series_ << "," << run.samples[k + j];
+                series_ << "\n";
+            }
+            series_rows_ += r.rows;
+
+            if (!run.fields.empty()) {
+
+                r.field_row = field_rows_;
+                const int N = static_cast<int>(run.fields.size() / 4);
+
+                for (int i = 0; i < N; ++i) {
+                    fields_ << r.id << "," << i << "," << (i + 0.5) * run.dz;
+                    for (int j = 0; j < 4; ++j) fields_ << "," << run.fields[4 * i + j];
+                    fields_ << "\n";
+                }
+                field_rows_ += N;
+            }
+        }
+
+        series_.flush();
+        fields_.flush();
+    }
+
+    const Campaign& campaign_;
+    Dict base_;
+    int rank_ = 0;
+    int slot_ = 0;                          // First affinity slot of the rank [-]
+
+    std::vector<std::unique_ptr<Solver>> solvers_;  // Warm, one per batch thread
+
+    std::ofstream series_, fields_;
+    long long series_rows_ = 0;             // Data rows written to rank_<rank>.csv [-]
+    long long field_rows_ = 0;              // Data rows written to fields_<rank>.csv [-]
+};
+
+// Results on rank 0, by case, as they come in
+struct Progress {
+    std::vector<Result> results;
+    int done = 0;
+    int failed = 0;
+    double case_time = 0.0;                 // Sum of the cases' run times [s]
+
+    void add(std::vector<Result> batch, std::size_t total) {
+
+        for (Result& r : batch) {
+
+            ++done;
+            case_time += r.wall;
+
+            if (r.status != 0) {
+                ++failed;
+                printf("[%d/%zu] case %d failed on rank %d: %s\n", done, total, r.id, r.rank, r.message.c_str());
+            }
+            else
+                printf("[%d/%zu] case %d on rank %d: %d steps, %.3f s\n", done, total, r.id, r.rank, r.steps, r.wall);
+            fflush(stdout);
+
+            results[r.id] = std::move(r);
+        }
+    }
+};
+
+void write_index(const Campaign& campaign, const std::vector<std::string>& parameters, const std::vector<Case>& cases,
+    const std::vector<Result>& results) {
+
+    std::ofstream index(fs::path("output") / campaign.name / "index.csv");
+
+    index << "case";
+    for (const std::string& p : parameters) index << "," << p;
+    index << ",status,rank,row,rows,field_row,steps,outer_iterations,linear_solves,wall_s";
+    for (const Probe& p : campaign.probes) index << "," << label(p);
+    index << "\n" << std::setprecision(10);
+
+    for (std::size_t k = 0; k < cases.size(); ++k) {
+
+        const Result& r = results[k];
+
+        index << cases[k].id;
+        for (const auto& kv : cases[k].set) index << "," << kv.second;
+        index << "," << (r.status == 0 ? "ok" : "failed") << "," << r.rank << "," << r.row << "," << r.rows << ","
+            << r.field_row << "," << r.steps << "," << r.outer << "," << r.solves << "," << r.wall;
+
+        for (std::size_t j = 0; j < campaign.probes.size(); ++j)
+            index << "," << (j < r.probes.size() ? r.probes[j] : NAN);
+        index << "\n";
+    }
+}
+}
+
+Campaign readCampaign(const std::string& filename) {
+
+    Dict dict = readKeyValues(filename);
+    Campaign c;
+
+    for (const char* key : { "base_input", "cases", "probes" })
+        if (!dict.count(key))
+            throw std::runtime_error(std::string("Ensemble: missing key ") + key + " in " + filename);
+
+    c.name = fs::path(filename).filename().string();
+    c.base_input = dict["base_input"];
+    c.cases = dict["cases"];
+
+    for (const std::string& item : split(dict["probes"])) {
+
+        const auto at = item.find('@');
+        if (at == std::string::npos)
+            throw std::runtime_error("Ensemble: probes are field@z, got: " + item);
+
+        const std::string field = item.substr(0, at);
+
+        Probe p;
+        if (field == "u" || field == "p" || field == "T") p.field = field[0];
+        else if (field == "rho") p.field = 'r';
+        else throw std::runtime_error("Ensemble: probe field must be u, p, T or rho, got: " + field);
+
+        p.z = std::stod(item.substr(at + 1));
+        c.probes.push_back(p);
+    }
+
+    if (dict.count("batch")) c.batch = std::stoi(dict["batch"]);
+    if (dict.count("fields")) c.fields = std::stoi(dict["fields"]) != 0;
+
+    if (c.probes.empty())
+        throw std::runtime_error("Ensemble: no probes");
+    if (c.batch < 1)
+        throw std::runtime_error("Ensemble: batch must be at least 1");
+
+    return c;
+}
+
+std::vector<std::string> readCases(const std::string& filename, std::vector<Case>& cases) {
+
+    std::ifstream table(filename);
+    if (!table)
+        throw std::runtime_error("Ensemble: cannot open the case table " + filename);
+
+    std::vector<std::string> keys;
+    std::string line;
+
+    while (std::getline(table, line)) {
+
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+
+        std::replace(line.begin(), line.end(), ',', ' ');
+
+        std::istringstream row(line);
+        std::vector<std::string> cells;
+        for (std::string cell; row >> cell; ) cells.push_back(cell);
+
+        if (cells.empty())
+            continue;
+
+        if (keys.empty()) {
+            keys = cells;
+            continue;
+        }
+
+        if (cells.size() != keys.size())
+            throw std::runtime_error("Ensemble: case " + std::to_string(cases.size()) + " has " + std::to_string(cells.size())
+                + " values for " + std::to_string(keys.size()) + " keys in " + filename);
+
+        Case c;
+        c.id = static_cast<int>(cases.size());
+        for (std::size_t k = 0; k < keys.size(); ++k) c.set.emplace_back(keys[k], cells[k]);
+        cases.push_back(std::move(c));
+    }
+
+    if (cases.empty())
+        throw std::runtime_error("Ensemble: no cases in " + filename);
+
+    return keys;
+}
+
+int run(const std::string& campaignFile) {
+
+    int rank = 0, size = 1;
+
+#ifdef RHOPISO_MPI
+    MPI_Init(nullptr, nullptr);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+
+    int status = 0;
+
+    try {
+        const Campaign campaign = readCampaign(campaignFile);
+
+        // Affinity slots: the workers of a node count from 0, each taking
+        // as many slots as it runs threads, so that two ranks on one node
+        // never pin to the same CPU. Rank 0 only dispatches and takes none.
+        int slot = 0;
+        {
+            const Input in = parseInput(readKeyValues(campaign.base_input));
+            const int width = std::max(campaign.batch, in.threads > 0 ? in.threads : omp_get_max_threads());
+
+#ifdef RHOPISO_MPI
+            MPI_Comm node;
+            MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+
+            int local = 0, leader = rank;
+            MPI_Comm_rank(node, &local);
+            MPI_Bcast(&leader, 1, MPI_INT, 0, node);
+            MPI_Comm_free(&node);
+
+            if (size > 1 && leader == 0) --local;
+            slot = std::max(0, local) * width;
+#else
+            (void)width;
+#endif
+        }
+
+        if (rank == 0) {
+
+            std::vector<Case> cases;
+            const std::vector<std::string> parameters = readCases(campaign.cases, cases);
+            fs::create_directories(fs::path("output") / campaign.name);
+
+            const int workers = std::max(1, size - 1);
+            std::cout << "Ensemble " << campaign.name << ": " << cases.size() << " cases of " << campaign.base_input
+                << " over " << parameters.size() << " keys, " << workers << (workers == 1 ? " worker rank" : " worker ranks")
+                << ", batches of " << campaign.batch << std::endl;
+
+            Progress progress;
+            progress.results.resize(cases.size());
+
+            const double start = omp_get_wtime();
+            std::size_t next = 0;
+
+            const auto batch = [&]() {
+                const std::size_t count = std::min<std::size_t>(campaign.batch, cases.size() - next);
+                std::vector<Case> b(cases.begin() + next, cases.begin() + next + count);
+                next += count;
+                return b;
+            };
+
+            if (size == 1) {
+
+                Worker w(campaign, 0, slot);
+                if (affinity::current() != affinity::Policy::none) affinity::report(std::cout);
+
+                while (next < cases.size())
+                    progress.add(w.run(batch()), cases.size());
+            }
+#ifdef RHOPISO_MPI
+            else {
+
+                // Self-scheduling: every result message asks for the next
+                // batch. Rank 0 polls instead of blocking in a receive,
+                // which Open MPI busy-waits, so that it leaves its core to
+                // a worker on the same node.
+                int active = size - 1;
+
+                while (active > 0) {
+
+                    MPI_Status st;
+                    int flag = 0;
+                    for (;;) {
+                        MPI_Iprobe(MPI_ANY_SOURCE, tag_result, MPI_COMM_WORLD, &flag, &st);
+                        if (flag) break;
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+
+                    int bytes = 0;
+                    MPI_Get_count(&st, MPI_BYTE, &bytes);
+                    std::vector<char> message(bytes);
+                    MPI_Recv(message.data(), bytes, MPI_BYTE, st.MPI_SOURCE, tag_result, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+                    progress.add(unpack_results(message), cases.size());
+
+                    if (next < cases.size()) {
+                        const std::vector<char> work = pack(batch());
+                        MPI_Send(work.data(), static_cast<int>(work.size()), MPI_BYTE, st.MPI_SOURCE, tag_work, MPI_COMM_WORLD);
+                    }
+                    else {
+                        MPI_Send(nullptr, 0, MPI_BYTE, st.MPI_SOURCE, tag_stop, MPI_COMM_WORLD);
+                        --active;
+                    }
+                }
+            }
+#endif
+
+            const double wall = omp_get_wtime() - start;
+            write_index(campaign, parameters, cases, progress.results);
+
+            printf("%d cases (%d failed) in %.3f s on %d %s; case run time %.3f s, %.0f%% of the workers' time\n",
+                progress.done, progress.failed, wall, workers, workers == 1 ? "worker" : "workers", progress.case_time,
+                100.0 * progress.case_time / std::max(wall * workers * campaign.batch, 1e-300));
+            std::cout << "Index written to " << (fs::path("output") / campaign.name / "index.csv").string() << std::endl;
+
+            status = progress.failed > 0 ? 1 : 0;
+        }
+#ifdef RHOPISO_MPI
+        else {
+
+            Worker w(campaign, rank, slot);
+            std::vector<Result> done;
+
+            for (;;) {
+
+                const std::vector<char> results = pack(done);
+                MPI_Send(results.data(), static_cast<int>(results.size()), MPI_BYTE, 0, tag_result, MPI_COMM_WORLD);
+
+                MPI_Status st;
+                MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &st);
+
+                int bytes = 0;
+                MPI_Get_count(&st, MPI_BYTE, &bytes);
+                std::vector<char> message(bytes);
+                MPI_Recv(message.data(), bytes, MPI_BYTE, 0, st.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+                if (st.MPI_TAG == tag_stop) break;
+                done = w.run(unpack_cases(message));
+            }
+        }
+#endif
+    }
+    catch (const std::exception& e) {
+#ifdef RHOPISO_MPI
+        // A rank that cannot go on would leave the others waiting
+        std::cerr << "Rank " << rank << ": " << e.what() << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+#else
+        throw;
+#endif
+    }
+
+#ifdef RHOPISO_MPI
+    MPI_Finalize();
+#endif
+
+    return status;
+}
+}
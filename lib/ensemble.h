@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ensemble {
+
+    // Probe recorded over a case: a field at a position
+    struct Probe {
+        char field = 'T';                   // u, p, T or r (rho)
+        double z = 0.0;                     // Position [m]
+    };
+
+    // One case: the overrides of one row of the case table
+    struct Case {
+        int id = 0;                         // Row of the table, from 0 [-]
+        std::vector<std::pair<std::string, std::string>> set;
+    };
+
+    // Campaign, read from a key = value file:
+    //
+    //   base_input = input/sources         case every run starts from
+    //   cases      = sweep.cases           case table, see readCases
+    //   probes     = T@0.5, p@0, u@1.0     field@z [m], sampled number_output times
+    //   batch      = 1                     cases per request [-]
+    //   fields     = 1                     final fields of every case, 0 for none
+    struct Campaign {
+        std::string name;                   // File name of the campaign, names output/<name>/
+        std::string base_input;
+        std::string cases;
+        std::vector<Probe> probes;
+        int batch = 1;
+        bool fields = true;
+    };
+
+    Campaign readCampaign(const std::string& filename);
+
+    // Case table: the first line names input keys, every further line is
+    // one case with a value per key. Separators are blanks or commas, '#'
+    // starts a comment.
+    //
+    //     S_h_cell   u_inlet_value   k
+    //     1000       0.1             0.02
+    //     2000       0.1             0.02
+    std::vector<std::string> readCases(const std::string& filename, std::vector<Case>& cases);
+
+    // Summary of a finished case, all that travels back to rank 0
+    struct Result {
+        int id = 0;
+        int rank = 0;                       // Rank that ran the case [-]
+        int status = 0;                     // 0 ok, 1 failed [-]
+        long long row = 0;                  // First row of the case in rank_<rank>.csv [-]
+        int rows = 0;                       // Probe samples [-]
+        long long field_row = -1;           // First row in fields_<rank>.csv, -1 for none [-]
+        int steps = 0;                      // Time steps [-]
+        long long outer = 0;                // Outer iterations over all steps [-]
+        long long solves = 0;               // TDMA solves [-]
+        double wall = 0.0;                  // Run time of the case [s]
+        std::vector<double> probes;         // Final probe values, in campaign order
+        std::string message;                // Why it failed
+    };
+
+    // rhoPISO --ensemble <campaign file>, one process per rank:
+    //
+    //   mpirun -np 4 rhoPISO --ensemble sweep.campaign
+    //
+    // Rank 0 reads the case table and hands the cases out on request, one
+    // batch at a time, to ranks 1 ... n-1, so a rank that draws short cases
+    // simply asks more often. A worker runs a batch of one case on the
+    // base input's OpenMP threads, and a larger batch side by side, one
+    // single-threaded warm Solver per thread (the SIMD lanes stay inside
+    // each case's TDMA). Its probe samples go to output/<campaign>/rank_<r>.csv
+    // and the final fields to fields_<r>.csv; only the Result goes back to
+    // rank 0, which writes index.csv in case order: the parameters, status,
+    // rank and row of each case in its rank's files, its cost and final
+    // probe values.
+    //
+    // Built without RHOPISO_MPI (or run on one rank), rank 0 runs every
+    // case itself and writes the same files.
+    int run(const std::string& campaignFile);
+}
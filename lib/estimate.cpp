@@ -0,0 +1,234 @@
+#include "estimate.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <omp.h>
+
+#include "heap.h"
+#include "rz.h"
+#include "schedule.h"
+#include "solver.h"
+
+namespace estimate {
+
+namespace {
+
+// Keys readInput() has no default for
+const char* required[] = {
+    "N", "L", "dt_user", "simulation_time",
+    "piso_outer_iter", "piso_inner_iter", "piso_outer_tol", "piso_inner_tol", "rhie_chow",
+    "mu", "Rv", "k", "cp", "S_m_cell", "S_h_cell",
+    "z_evap_start", "z_evap_end", "z_cond_start", "z_cond_end",
+    "u_inlet_bc", "u_inlet_value", "u_outlet_bc", "u_outlet_value",
+    "T_inlet_bc", "T_inlet_value", "T_outlet_bc", "T_outlet_value",
+    "p_inlet_bc", "p_inlet_value", "p_outlet_bc", "p_outlet_value",
+    "u_initial", "T_initial", "p_initial", "rho_initial", "number_output",
+    "velocity_file", "pressure_file", "temperature_file", "density_file"
+};
+
+struct Calibration {
+    double step_s = 0.0;            // Wall time of one step [s]
+    double outer = 0.0;             // PISO outer iterations per step [-]
+    std::size_t memory = 0;         // Solver arrays [B]
+    std::size_t output_bytes = 0;   // One output, all files [B]
+    double output_s = 0.0;          // Formatting one output [s]
+};
+
+// One output line of a field, formatted as the drivers write it
+std::size_t line_bytes(const heap::vector<double>& x) {
+
+    std::ostringstream os;
+    for (double v : x) os << v << ", ";
+    os << "\n";
+
+    return os.str().size();
+}
+
+// One warm-up step (page faults, thread pool), then `steps` timed steps
+template <typename S, typename Fields>
+Calibration calibrate(S& s, int steps, Fields fields) {
+
+    Calibration c;
+
+    const heap::Stats h = heap::stats();
+    c.memory = h.bytes + h.small_bytes;
+
+    s.step();
+
+    int outer = 0;
+    const double start = omp_get_wtime();
+
+    for (int k = 0; k < steps; ++k) {
+        s.step();
+        outer += s.outer_v;
+    }
+
+    c.step_s = (omp_get_wtime() - start) / steps;
+    c.outer = static_cast<double>(outer) / steps;
+
+    const double t0 = omp_get_wtime();
+    for (const heap::vector<double>* x : fields(s))
+        c.output_bytes += line_bytes(*x);
+    c.output_s = omp_get_wtime() - t0;
+
+    return c;
+}
+
+double peak_rss_MB() {
+
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stod(line.substr(6)) / 1024.0;
+#endif
+    return 0.0;
+}
+
+void print(const std::vector<Problem>& problems) {
+    for (const Problem& p : problems)
+        std::cout << "# " << (p.error ? "error: " : "warning: ") << p.message << "\n";
+}
+
+int fail(const std::vector<Problem>& problems) {
+    print(problems);
+    std::cout << "status = error" << std::endl;
+    return 2;
+}
+}
+
+std::vector<Problem> validate(const Input& in) {
+
+    std::vector<Problem> problems;
+    const auto warning = [&](const std::string& m) { problems.push_back({ false, m }); };
+
+    for (const std::string& m : inputErrors(in))
+        problems.push_back({ true, m });
+
+    if (in.dt_user > 0.0 && in.simulation_time < in.dt_user)
+        warning("simulation_time < dt_user: a single step is run");
+
+    for (const auto& t : { std::make_pair("piso_outer_tol", in.piso_outer_tol),
+                           std::make_pair("piso_inner_tol", in.piso_inner_tol) }) {
+        if (t.second <= 0.0)
+            warning(std::string(t.first) + " <= 0 is never met: every step runs the iteration cap");
+        else if (t.second >= 1.0)
+            warning(std::string(t.first) + " >= 1: every step stops after one iteration");
+    }
+
+    if (in.p_inlet_bc == 1 && in.p_outlet_bc == 1)
+        warning("p_inlet_bc and p_outlet_bc are both Neumann: the pressure level is not fixed");
+
+    for (const auto& zone : { std::make_pair(in.z_evap_start, in.z_evap_end),
+                              std::make_pair(in.z_cond_start, in.z_cond_end) })
+        if (zone.first > zone.second || zone.first < 0.0 || zone.second > in.L)
+            warning("source zone [" + std::to_string(zone.first) + ", " + std::to_string(zone.second)
+                + "] m is empty or outside [0, L]");
+
+    return problems;
+}
+
+int run(const std::string& inputFile, int steps) {
+
+    std::cout << "# Preflight estimate: " << inputFile << "\n";
+
+    if (!std::ifstream(inputFile))
+        return fail({ { true, "cannot open " + inputFile } });
+
+    const auto dict = readKeyValues(inputFile);
+
+    std::vector<Problem> problems;
+    for (const char* key : required)
+        if (!dict.count(key))
+            problems.push_back({ true, std::string("missing key ") + key });
+
+    if (!problems.empty())
+        return fail(problems);
+
+    Input in;
+    try {
+        in = readInput(inputFile);
+    }
+    catch (const std::exception& e) {
+        // parseInput reports every inputError, one per line
+        std::istringstream lines(e.what());
+        for (std::string line; std::getline(lines, line); )
+            problems.push_back({ true, line });
+        return fail(problems);
+    }
+
+    problems = validate(in);
+
+    if (std::any_of(problems.begin(), problems.end(), [](const Problem& p) { return p.error; }))
+        return fail(problems);
+
+    if (in.threads > 0) omp_set_num_threads(in.threads);
+    steps = std::max(1, steps);
+
+    // Steps of the time loop: 0 ... time_steps, and with a schedule the
+    // steps of the 1D driver, which land on every breakpoint
+    int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    const long long cells = static_cast<long long>(in.N) * in.Nr;
+
+    Calibration c;
+
+    if (in.Nr > 1) {
+        SolverRZ s(in);
+        c = calibrate(s, steps, [](const SolverRZ& s) {
+            return std::vector<const heap::vector<double>*>{ &s.u, &s.v, &s.p, &s.T, &s.rho }; });
+    }
+    else {
+        Solver s(in);
+        if (!in.schedule_file.empty())
+            time_steps = schedule::Table(in.schedule_file, in, s).steps(0.0, in.dt_user, in.simulation_time) - 1;
+        c = calibrate(s, steps, [](const Solver& s) {
+            return std::vector<const heap::vector<double>*>{ &s.u_v, &s.p_v, &s.T_v, &s.rho_v }; });
+    }
+
+    if (in.number_output > time_steps)
+        problems.push_back({ false, "number_output = " + std::to_string(in.number_output) + " exceeds the "
+            + std::to_string(time_steps) + " time steps: output is written every step" });
+
+    print(problems);
+
+    const int print_every = std::max(1, time_steps / in.number_output);
+    const long long outputs = time_steps / print_every + 1;
+
+    // u, p, T, rho, bVU and the padded p_storage of the 1D driver
+    const double checkpoint_MB = in.Nr == 1 && in.checkpoint_every > 0
+        ? (5.0 * in.N + (in.N + 2)) * sizeof(double) / 1048576.0 : 0.0;
+
+    const double time_s = c.step_s * (time_steps + 1.0) + c.output_s * outputs;
+
+    // Bound for a scheduler: every step at the outer iteration cap
+    const double time_max_s = c.step_s / std::max(1.0, c.outer) * in.piso_outer_iter * (time_steps + 1.0)
+        + c.output_s * outputs;
+
+    printf("status = %s\n", problems.empty() ? "ok" : "warnings");
+    printf("cells = %lld\n", cells);
+    printf("time_steps = %d\n", time_steps + 1);
+    printf("print_every = %d\n", print_every);
+    printf("outputs = %lld\n", outputs);
+    printf("threads = %d\n", omp_get_max_threads());
+    printf("calibration_steps = %d\n", steps);
+    printf("outer_per_step = %.2f\n", c.outer);
+    printf("memory_MB = %.2f\n", c.memory / 1048576.0);
+    printf("peak_rss_MB = %.1f\n", peak_rss_MB());
+    printf("output_MB = %.2f\n", outputs * c.output_bytes / 1048576.0);
+    printf("checkpoint_MB = %.2f\n", checkpoint_MB);
+    printf("cost_ns_per_cell_step = %.1f\n", c.step_s / cells * 1e9);
+    for (const auto& t : { std::make_pair("time_s", time_s), std::make_pair("time_max_s", time_max_s) }) {
+        printf("%s = %.4g", t.first, t.second);
+        if (t.second > 86400.0) printf("    # %.1f days", t.second / 86400.0);
+        else if (t.second > 3600.0) printf("    # %.1f h", t.second / 3600.0);
+        printf("\n");
+    }
+
+    return 0;
+}
+}
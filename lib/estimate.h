@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "input.h"
+
+namespace estimate {
+
+    struct Problem {
+        bool error = false;         // The run would fail or crash; otherwise a warning
+        std::string message;
+    };
+
+    // Checks a parsed input for values the solver cannot run with (the
+    // inputErrors of input.h) and for values that are probably unintended
+    // (tolerances, zones)
+    std::vector<Problem> validate(const Input& in);
+
+    // Preflight of an input file, rhoPISO --estimate <input file> [steps]:
+    // validates it, builds the solver, times `steps` steps after one
+    // warm-up step and prints the predicted memory, output size and run
+    // time as key = value lines (the input file syntax), for a scheduler to
+    // read. Returns 0, or 2 if the case would not run.
+    int run(const std::string& inputFile, int steps);
+}
@@ -0,0 +1,317 @@
+#include "heap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <omp.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace heap {
+
+namespace {
+
+constexpr std::size_t huge_page = std::size_t(1) << 21;
+constexpr std::size_t small_page = 4096;
+
+// MPOL_PREFERRED and MPOL_INTERLEAVE of <linux/mempolicy.h>, for the raw
+// mbind system call
+constexpr int mpol_preferred = 1;
+constexpr int mpol_interleave = 3;
+
+// Array starts are staggered by a multiple of this many bytes. Aligned
+// starts put element i of every array in the same cache set, and on huge
+// pages also in the same L2 set, which a loop over a dozen coefficient
+// arrays turns into conflict misses. 17 lines: distinct L1 sets mod 4 KB.
+constexpr std::size_t colour_bytes = 17 * 64;
+constexpr std::size_t colours = 64;
+
+struct Block {
+    void* base = nullptr;           // Start of the mapping
+    std::size_t bytes = 0;          // Requested size [B]
+    std::size_t length = 0;         // Mapped length [B]
+    bool hugetlb = false;
+    bool thp = false;
+    bool interleaved = false;
+    bool local = false;
+};
+
+std::mutex mutex_;
+Settings settings_;
+bool configured_ = false;           // settings_ set by the first configure()
+Stats stats_;
+std::map<void*, Block> blocks_;
+std::size_t next_colour_ = 0;
+
+bool nodes_read_ = false;
+unsigned long node_mask_ = 1;       // Online nodes 0..63
+
+std::size_t round_up(std::size_t n, std::size_t to) { return (n + to - 1) / to * to; }
+
+// Online NUMA nodes from sysfs, e.g. "0-1,3"; a single node without it
+void read_nodes() {
+
+    if (nodes_read_) return;
+    nodes_read_ = true;
+
+    std::ifstream f("/sys/devices/system/node/online");
+    std::string list;
+    if (!(f >> list)) return;
+
+    unsigned long mask = 0;
+    std::stringstream ss(list);
+    std::string range;
+
+    while (std::getline(ss, range, ',')) {
+
+        const auto dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+        for (int n = first; n <= last && n < 64; ++n) mask |= 1ul << n;
+    }
+
+    if (mask == 0) return;
+
+    node_mask_ = mask;
+    stats_.nodes = 0;
+    for (unsigned long m = mask; m; m &= m - 1) ++stats_.nodes;
+}
+
+double MB(std::size_t bytes) { return bytes / 1048576.0; }
+
+const char* name(Placement p) {
+
+    return p == Placement::interleave ? "interleave" : p == Placement::local ? "local" : "first_touch";
+}
+
+std::string describe(const Settings& s) {
+
+    return std::string("huge_pages = ") + (s.hugetlbfs ? "2" : s.huge_pages ? "1" : "0") + ", numa_placement = " + name(s.placement);
+}
+}
+
+void configure(const Settings& s) {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Solvers of one process may run side by side (service, surrogate and
+    // ensemble workers), so settings that changed under them would apply
+    // to each other's arrays
+    if (configured_) {
+        if (s.huge_pages != settings_.huge_pages || s.hugetlbfs != settings_.hugetlbfs || s.placement != settings_.placement)
+            throw std::runtime_error("Large-page and NUMA settings are per process: the case asks for "
+                + describe(s) + ", the process uses " + describe(settings_));
+        return;
+    }
+
+    settings_ = s;
+    configured_ = true;
+    read_nodes();
+}
+
+Stats stats() {
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void* allocate(std::size_t bytes) {
+
+    if (bytes < min_bytes) {
+
+        void* p = ::operator new(bytes);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.small_bytes += bytes;
+        return p;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    read_nodes();
+    const Settings s = settings_;
+    const std::size_t offset = next_colour_++ % colours * colour_bytes;
+    lock.unlock();
+
+    Block b;
+    b.bytes = bytes;
+    const std::size_t extent = bytes + offset;
+    void* p = nullptr;
+    bool refused = false;
+
+#ifdef __linux__
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    // Reserved huge pages first, if asked for; the pool is usually empty
+    if (s.huge_pages && s.hugetlbfs) {
+
+        b.length = round_up(extent, huge_page);
+        void* m = mmap(nullptr, b.length, prot, flags | MAP_HUGETLB, -1, 0);
+
+        if (m != MAP_FAILED) {
+            p = m;
+            b.hugetlb = true;
+        }
+    }
+
+    if (!p && s.huge_pages) {
+
+        // Over-map by one huge page and trim to a 2 MB aligned start, so
+        // that every whole 2 MB of the array can become a transparent huge page
+        b.length = round_up(extent, small_page);
+        const std::size_t span = b.length + huge_page;
+
+        char* raw = static_cast<char*>(mmap(nullptr, span, prot, flags, -1, 0));
+        if (raw == MAP_FAILED) throw std::bad_alloc();
+
+        char* start = reinterpret_cast<char*>(round_up(reinterpret_cast<std::uintptr_t>(raw), huge_page));
+        if (start > raw) munmap(raw, start - raw);
+        if (raw + span > start + b.length) munmap(start + b.length, raw + span - (start + b.length));
+
+        p = start;
+        b.thp = madvise(p, b.length, MADV_HUGEPAGE) == 0;
+        refused = !b.thp;
+    }
+
+    if (!p) {
+
+        b.length = round_up(extent, small_page);
+        p = mmap(nullptr, b.length, prot, flags, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+    }
+
+    if (s.placement == Placement::interleave && stats_.nodes > 1) {
+
+        b.interleaved = syscall(SYS_mbind, p, b.length, mpol_interleave, &node_mask_, 64, 0) == 0;
+        refused = refused || !b.interleaved;
+    }
+    else if (s.placement == Placement::local && stats_.nodes > 1) {
+
+        // The node of the CPU this thread runs on, which is only stable
+        // once the thread is pinned (see affinity). Preferred rather than
+        // bound: a full node spills to the others instead of failing.
+        unsigned cpu = 0, node = 0;
+        unsigned long mask = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < 64) mask = 1ul << node;
+
+        b.local = mask != 0 && syscall(SYS_mbind, p, b.length, mpol_preferred, &mask, 64, 0) == 0;
+        refused = refused || !b.local;
+    }
+    else if (s.placement == Placement::first_touch && omp_get_max_threads() > 1 && !omp_in_parallel()) {
+
+        // Fault the pages in with the static schedule of the solver loops,
+        // so that each thread's range of cells lands on its own node
+        char* c = static_cast<char*>(p);
+        const long long pages = static_cast<long long>(b.length / small_page);
+
+        #pragma omp parallel for schedule(static)
+        for (long long k = 0; k < pages; ++k) c[k * small_page] = 0;
+    }
+#else
+    (void)s;
+    b.length = extent;
+    p = ::operator new(extent);
+#endif
+
+    b.base = p;
+    p = static_cast<char*>(p) + offset;
+
+    lock.lock();
+
+    blocks_[p] = b;
+
+    ++stats_.arrays;
+    stats_.bytes += bytes;
+    stats_.peak_bytes = std::max(stats_.peak_bytes, stats_.bytes);
+    if (b.hugetlb) stats_.hugetlb_bytes += bytes;
+    if (b.thp) stats_.thp_bytes += bytes;
+    if (b.interleaved) stats_.interleaved_bytes += bytes;
+    if (b.local) stats_.local_bytes += bytes;
+    if (refused) ++stats_.fallbacks;
+
+    return p;
+}
+
+void deallocate(void* p, std::size_t bytes) noexcept {
+
+    if (!p) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (bytes < min_bytes) {
+        ::operator delete(p);
+        stats_.small_bytes -= bytes;
+        return;
+    }
+
+    const auto it = blocks_.find(p);
+    if (it == blocks_.end()) return;
+
+    const Block b = it->second;
+    blocks_.erase(it);
+
+#ifdef __linux__
+    munmap(b.base, b.length);
+#else
+    ::operator delete(b.base);
+#endif
+
+    --stats_.arrays;
+    stats_.bytes -= b.bytes;
+    if (b.hugetlb) stats_.hugetlb_bytes -= b.bytes;
+    if (b.thp) stats_.thp_bytes -= b.bytes;
+    if (b.interleaved) stats_.interleaved_bytes -= b.bytes;
+    if (b.local) stats_.local_bytes -= b.bytes;
+}
+
+void report(std::ostream& os) {
+
+    const Stats s = stats();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const auto flags = os.flags();
+    const auto precision = os.precision();
+
+    os << std::fixed << std::setprecision(1)
+        << "Allocator: " << s.arrays << " large arrays, " << MB(s.bytes) << " MB (peak " << MB(s.peak_bytes)
+        << " MB), " << MB(s.small_bytes) << " MB small; huge pages "
+        << (settings_.hugetlbfs ? "on, hugetlbfs first" : settings_.huge_pages ? "on" : "off")
+        << ": " << MB(s.hugetlb_bytes) << " MB hugetlbfs, " << MB(s.thp_bytes) << " MB advised";
+
+#ifdef __linux__
+    // What the kernel actually backs with transparent huge pages
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string line;
+    while (std::getline(rollup, line)) {
+        if (line.rfind("AnonHugePages:", 0) == 0) {
+            os << ", " << std::stol(line.substr(14)) / 1024.0 << " MB backed";
+            break;
+        }
+    }
+#endif
+
+    os << "; placement " << (settings_.placement == Placement::interleave ? "interleave"
+            : settings_.placement == Placement::local ? "local" : "first-touch")
+        << " over " << s.nodes << (s.nodes == 1 ? " node" : " nodes");
+    if (s.local_bytes > 0) os << " (" << MB(s.local_bytes) << " MB node-local)";
+    if (s.fallbacks > 0) os << ", " << s.fallbacks << " requests refused";
+    os << std::endl;
+
+    os.flags(flags);
+    os.precision(precision);
+}
+}
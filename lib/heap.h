@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+namespace heap {
+
+    // Arrays of at least this size are mapped directly and get the huge page
+    // and NUMA treatment below; smaller ones come from operator new
+    constexpr std::size_t min_bytes = std::size_t(1) << 21;
+
+    enum class Placement {
+        first_touch,    // Pages faulted in by the threads that use them (static schedule)
+        interleave,     // Pages spread round-robin over all NUMA nodes
+        local           // Pages on the node of the allocating thread (preferred)
+    };
+
+    struct Settings {
+        bool huge_pages = true;                         // madvise(MADV_HUGEPAGE)
+        bool hugetlbfs = false;                         // MAP_HUGETLB first (reserved pool), opt-in
+        Placement placement = Placement::first_touch;   // NUMA placement of large arrays
+    };
+
+    // Settings of the whole process, applied to the arrays allocated from
+    // then on; call before building a solver. The first call sets them. A
+    // later call with the same settings does nothing, and one with other
+    // settings throws std::runtime_error: solvers of one process may be
+    // built and reset concurrently, and must not switch each other's.
+    void configure(const Settings& s);
+
+    struct Stats {
+        std::size_t arrays = 0;             // Live large arrays [-]
+        std::size_t bytes = 0;              // Bytes in live large arrays [B]
+        std::size_t peak_bytes = 0;         // Largest value of `bytes` so far [B]
+        std::size_t small_bytes = 0;        // Bytes in live arrays from operator new [B]
+        std::size_t hugetlb_bytes = 0;      // Live bytes from the hugetlbfs pool [B]
+        std::size_t thp_bytes = 0;          // Live bytes advised for transparent huge pages [B]
+        std::size_t interleaved_bytes = 0;  // Live bytes with an interleave policy [B]
+        std::size_t local_bytes = 0;        // Live bytes preferring the allocating thread's node [B]
+        std::size_t fallbacks = 0;          // Huge page or NUMA requests the kernel refused [-]
+        int nodes = 1;                      // NUMA nodes online [-]
+    };
+
+    Stats stats();
+
+    // One line with the statistics, and on Linux the part of the process
+    // actually backed by transparent huge pages (AnonHugePages)
+    void report(std::ostream& os);
+
+    void* allocate(std::size_t bytes);
+    void deallocate(void* p, std::size_t bytes) noexcept;
+
+    // Standard allocator over allocate/deallocate, for std::vector
+    template <typename T>
+    struct Allocator {
+
+        using value_type = T;
+
+        Allocator() = default;
+        template <typename U> Allocator(const Allocator<U>&) noexcept {}
+
+        T* allocate(std::size_t n) { return static_cast<T*>(heap::allocate(n * sizeof(T))); }
+        void deallocate(T* p, std::size_t n) noexcept { heap::deallocate(p, n * sizeof(T)); }
+    };
+
+    template <typename T, typename U>
+    bool operator==(const Allocator<T>&, const Allocator<U>&) { return true; }
+
+    template <typename T, typename U>
+    bool operator!=(const Allocator<T>&, const Allocator<U>&) { return false; }
+
+    // Container of the solver fields, coefficients and TDMA workspaces
+    template <typename T>
+    using vector = std::vector<T, Allocator<T>>;
+}
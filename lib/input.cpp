@@ -0,0 +1,389 @@
+#include "input.h"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// =======================================================================
+//                                INPUT
+// =======================================================================
+
+std::unordered_map<std::string, std::string> readKeyValues(const std::string& filename) {
+
+    std::ifstream file(filename);
+    std::string line, key, eq, value;
+
+    std::unordered_map<std::string, std::string> dict;
+
+    while (std::getline(file, line)) {
+
+        // Removes comments
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+
+        // Removes empty lines
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        // Finds '='
+        auto pos = line.find('=');
+        if (pos == std::string::npos)
+            continue;
+
+        std::string key = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+
+        // Trim key
+        key.erase(0, key.find_first_not_of(" \t"));
+        key.erase(key.find_last_not_of(" \t") + 1);
+
+        // Trim value
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t") + 1);
+
+        dict[key] = value;
+    }
+
+    return dict;
+}
+
+Input readInput(const std::string& filename) {
+    return parseInput(readKeyValues(filename));
+}
+
+Input parseInput(std::unordered_map<std::string, std::string> dict) {
+
+    Input in;
+
+    in.N = std::stoi(dict["N"]);
+    in.L = std::stod(dict["L"]);
+
+    in.dt_user = std::stod(dict["dt_user"]);
+    in.simulation_time = std::stod(dict["simulation_time"]);
+
+    in.piso_outer_iter = std::stoi(dict["piso_outer_iter"]);
+    in.piso_inner_iter = std::stoi(dict["piso_inner_iter"]);
+    in.piso_outer_tol = std::stod(dict["piso_outer_tol"]);
+    in.piso_inner_tol = std::stod(dict["piso_inner_tol"]);
+    in.rhie_chow_on_off_v = std::stoi(dict["rhie_chow"]);
+
+    in.mu = std::stod(dict["mu"]);
+    in.Rv = std::stod(dict["Rv"]);
+    in.k = std::stod(dict["k"]);
+    in.cp = std::stod(dict["cp"]);
+
+    in.S_m_cell = std::stod(dict["S_m_cell"]);
+    in.S_h_cell = std::stod(dict["S_h_cell"]);
+
+    in.z_evap_start = std::stod(dict["z_evap_start"]);
+    in.z_evap_end = std::stod(dict["z_evap_end"]);
+    in.z_cond_start = std::stod(dict["z_cond_start"]);
+    in.z_cond_end = std::stod(dict["z_cond_end"]);
+
+    in.u_inlet_bc = std::stoi(dict["u_inlet_bc"]);
+    in.u_inlet_value = std::stod(dict["u_inlet_value"]);
+
+    in.u_outlet_bc = std::stoi(dict["u_outlet_bc"]);
+    in.u_outlet_value = std::stod(dict["u_outlet_value"]);
+
+    in.T_inlet_bc = std::stoi(dict["T_inlet_bc"]);
+    in.T_inlet_value = std::stod(dict["T_inlet_value"]);
+
+    in.T_outlet_bc = std::stoi(dict["T_outlet_bc"]);
+    in.T_outlet_value = std::stod(dict["T_outlet_value"]);
+
+    in.p_inlet_bc = std::stoi(dict["p_inlet_bc"]);
+    in.p_inlet_value = std::stod(dict["p_inlet_value"]);
+
+    in.p_outlet_bc = std::stoi(dict["p_outlet_bc"]);
+    in.p_outlet_value = std::stod(dict["p_outlet_value"]);
+
+    in.u_initial = std::stod(dict["u_initial"]);
+    in.T_initial = std::stod(dict["T_initial"]);
+    in.p_initial = std::stod(dict["p_initial"]);
+    in.rho_initial = std::stod(dict["rho_initial"]);
+
+    if (dict.count("threads")) in.threads = std::stoi(dict["threads"]);
+    if (dict.count("deterministic")) in.deterministic = std::stoi(dict["deterministic"]);
+    if (dict.count("tdma_chunks")) in.tdma_chunks = std::stoi(dict["tdma_chunks"]);
+    if (dict.count("tdma_simd_rows")) in.tdma_simd_rows = std::stoi(dict["tdma_simd_rows"]);
+    if (dict.count("tdma_simd_max_rows")) in.tdma_simd_max_rows = std::stoi(dict["tdma_simd_max_rows"]);
+    if (dict.count("coupling")) in.coupling = dict["coupling"];
+
+    if (in.coupling != "gauss_seidel" && in.coupling != "jacobi")
+        throw std::runtime_error("coupling must be gauss_seidel or jacobi, got: " + in.coupling);
+
+    if (dict.count("pressure_work")) in.pressure_work = dict["pressure_work"];
+
+    if (in.pressure_work != "lagged" && in.pressure_work != "inner")
+        throw std::runtime_error("pressure_work must be lagged or inner, got: " + in.pressure_work);
+
+    if (dict.count("algorithm")) in.algorithm = dict["algorithm"];
+    if (dict.count("relax_u")) in.relax_u = std::stod(dict["relax_u"]);
+    if (dict.count("relax_T")) in.relax_T = std::stod(dict["relax_T"]);
+    if (dict.count("relax_p")) in.relax_p = std::stod(dict["relax_p"]);
+
+    if (in.algorithm != "piso" && in.algorithm != "simplec" && in.algorithm != "pimple")
+        throw std::runtime_error("algorithm must be piso, simplec or pimple, got: " + in.algorithm);
+
+    for (double alpha : { in.relax_u, in.relax_T, in.relax_p }) {
+        if (alpha != -1.0 && !(alpha > 0.0 && alpha <= 1.0))
+            throw std::runtime_error("relax_u, relax_T and relax_p must be in (0, 1], or -1 for adaptive");
+        if (alpha != 1.0 && in.algorithm == "piso")
+            throw std::runtime_error("under-relaxation needs algorithm = simplec or pimple");
+    }
+
+    if (dict.count("memory_lean")) in.memory_lean = std::stoi(dict["memory_lean"]);
+    if (dict.count("lean_float")) in.lean_float = std::stoi(dict["lean_float"]);
+
+    // Jacobi coupling assembles momentum and energy at the same time
+    if (in.memory_lean && in.coupling == "jacobi")
+        throw std::runtime_error("memory_lean needs coupling = gauss_seidel");
+
+    // The temperature correction reuses the energy matrix, which the
+    // memory-lean mode overwrites with p'
+    if (in.memory_lean && in.pressure_work == "inner")
+        throw std::runtime_error("memory_lean needs pressure_work = lagged");
+
+    if (dict.count("huge_pages")) in.huge_pages = std::stoi(dict["huge_pages"]);
+    if (dict.count("numa_placement")) in.numa_placement = dict["numa_placement"];
+
+    if (in.huge_pages < 0 || in.huge_pages > 2)
+        throw std::runtime_error("huge_pages must be 0, 1 or 2, got: " + std::to_string(in.huge_pages));
+
+    if (in.numa_placement != "first_touch" && in.numa_placement != "interleave" && in.numa_placement != "local")
+        throw std::runtime_error("numa_placement must be first_touch, interleave or local, got: " + in.numa_placement);
+
+    if (dict.count("affinity")) in.affinity = dict["affinity"];
+
+    if (in.affinity != "none" && in.affinity != "compact" && in.affinity != "scatter" && in.affinity != "case_per_core")
+        throw std::runtime_error("affinity must be none, compact, scatter or case_per_core, got: " + in.affinity);
+
+    if (dict.count("control_file")) in.control_file = dict["control_file"];
+    if (dict.count("control_every")) in.control_every = std::stoi(dict["control_every"]);
+    if (dict.count("restart_file")) in.restart_file = dict["restart_file"];
+    if (dict.count("checkpoint_every")) in.checkpoint_every = std::stoi(dict["checkpoint_every"]);
+    if (dict.count("checkpoint_async")) in.checkpoint_async = std::stoi(dict["checkpoint_async"]);
+    if (dict.count("schedule_file")) in.schedule_file = dict["schedule_file"];
+
+    if (dict.count("rt_period")) in.rt_period = std::stod(dict["rt_period"]);
+    if (dict.count("rt_budget")) in.rt_budget = std::stod(dict["rt_budget"]);
+    if (dict.count("rt_lock_memory")) in.rt_lock_memory = std::stoi(dict["rt_lock_memory"]);
+
+    if (dict.count("Nr")) in.Nr = std::stoi(dict["Nr"]);
+    if (dict.count("R")) in.R = std::stod(dict["R"]);
+    if (dict.count("adi_sweeps")) in.adi_sweeps = std::stoi(dict["adi_sweeps"]);
+    if (dict.count("T_wall_bc")) in.T_wall_bc = std::stoi(dict["T_wall_bc"]);
+    if (dict.count("T_wall_value")) in.T_wall_value = std::stod(dict["T_wall_value"]);
+
+    if (in.Nr > 1 && in.R <= 0.0)
+        throw std::runtime_error("R must be positive for an r-z case (Nr > 1)");
+
+    if (in.Nr > 1 && in.algorithm != "piso")
+        throw std::runtime_error("algorithm = " + in.algorithm + " is for the 1D solver (Nr = 1)");
+
+    if (dict.count("area_file")) in.area_file = dict["area_file"];
+    if (dict.count("area_inlet")) in.area_inlet = std::stod(dict["area_inlet"]);
+    if (dict.count("area_outlet")) in.area_outlet = std::stod(dict["area_outlet"]);
+    if (dict.count("eos_density")) in.eos_density = std::stoi(dict["eos_density"]);
+
+    if (!in.area_file.empty()) {
+
+        std::ifstream table(in.area_file);
+        if (!table)
+            throw std::runtime_error("Cannot open area_file: " + in.area_file);
+
+        std::string line;
+        while (std::getline(table, line)) {
+
+            auto comment = line.find('#');
+            if (comment != std::string::npos)
+                line = line.substr(0, comment);
+
+            std::istringstream row(line);
+            double z, A;
+            if (!(row >> z >> A))
+                continue;
+
+            if (!in.area_z.empty() && z <= in.area_z.back())
+                throw std::runtime_error("area_file positions must increase: " + in.area_file);
+
+            in.area_z.push_back(z);
+            in.area_A.push_back(A);
+        }
+
+        if (in.area_z.empty())
+            throw std::runtime_error("area_file has no (z, A) rows: " + in.area_file);
+    }
+
+    if (hasCrossSection(in) && in.Nr > 1)
+        throw std::runtime_error("A cross-section profile is not supported in r-z mode (Nr > 1)");
+
+    if (in.area_inlet <= 0.0 || in.area_outlet <= 0.0
+        || std::any_of(in.area_A.begin(), in.area_A.end(), [](double A) { return A <= 0.0; }))
+        throw std::runtime_error("Cross-section areas must be positive");
+
+    for (const auto& end : { std::make_pair(std::string("inlet"), &in.inlet_lumped), std::make_pair(std::string("outlet"), &in.outlet_lumped) }) {
+
+        const std::string& e = end.first;
+        LumpedInput& c = *end.second;
+
+        if (dict.count(e + "_lumped")) c.type = dict[e + "_lumped"];
+        if (dict.count(e + "_volume")) c.volume = std::stod(dict[e + "_volume"]);
+        if (dict.count(e + "_temperature")) c.temperature = std::stod(dict[e + "_temperature"]);
+        if (dict.count(e + "_mass_flow")) c.mass_flow = std::stod(dict[e + "_mass_flow"]);
+        if (dict.count(e + "_pressure")) c.pressure = std::stod(dict[e + "_pressure"]);
+        if (dict.count(e + "_loss")) c.loss = std::stod(dict[e + "_loss"]);
+        if (dict.count(e + "_area")) c.area = std::stod(dict[e + "_area"]);
+        if (dict.count(e + "_UA")) c.UA = std::stod(dict[e + "_UA"]);
+        if (dict.count(e + "_heat_capacity")) c.heat_capacity = std::stod(dict[e + "_heat_capacity"]);
+        if (dict.count(e + "_coolant_UA")) c.coolant_UA = std::stod(dict[e + "_coolant_UA"]);
+        if (dict.count(e + "_coolant_temperature")) c.coolant_temperature = std::stod(dict[e + "_coolant_temperature"]);
+
+        const int u_bc = e == "inlet" ? in.u_inlet_bc : in.u_outlet_bc;
+
+        if (c.type != "none" && c.type != "plenum" && c.type != "orifice" && c.type != "condenser")
+            throw std::runtime_error(e + "_lumped must be none, plenum, orifice or condenser, got: " + c.type);
+        if (c.type != "none" && in.Nr > 1)
+            throw std::runtime_error("Lumped components are for the 1D solver (Nr = 1)");
+
+        // The mass components take over the pressure and temperature rows
+        // of their end and need the velocity free there
+        if ((c.type == "plenum" || c.type == "orifice") && u_bc != 1)
+            throw std::runtime_error(e + "_lumped = " + c.type + " needs u_" + e + "_bc = 1 (Neumann)");
+        if (c.type == "plenum" && !(c.volume > 0.0 && c.temperature > 0.0))
+            throw std::runtime_error(e + "_lumped = plenum needs a positive " + e + "_volume and " + e + "_temperature");
+        if (c.type == "orifice" && !(c.loss > 0.0 && c.pressure > 0.0 && c.temperature > 0.0 && c.area >= 0.0))
+            throw std::runtime_error(e + "_lumped = orifice needs a positive " + e + "_loss, " + e + "_pressure and "
+                + e + "_temperature, and " + e + "_area >= 0");
+        if (c.type == "condenser" && !(c.UA > 0.0 && c.heat_capacity >= 0.0 && c.coolant_UA >= 0.0))
+            throw std::runtime_error(e + "_lumped = condenser needs a positive " + e + "_UA, and "
+                + e + "_heat_capacity, " + e + "_coolant_UA >= 0");
+    }
+
+    if (dict.count("statistics")) in.statistics = std::stoi(dict["statistics"]);
+    if (dict.count("statistics_start")) in.statistics_start = std::stod(dict["statistics_start"]);
+    if (dict.count("spectrum_probes")) in.spectrum_probes = dict["spectrum_probes"];
+    if (dict.count("spectrum_window")) in.spectrum_window = std::stoi(dict["spectrum_window"]);
+    if (dict.count("spectrum_peaks")) in.spectrum_peaks = std::stoi(dict["spectrum_peaks"]);
+
+    if ((in.statistics || !in.spectrum_probes.empty()) && in.Nr > 1)
+        throw std::runtime_error("statistics and spectrum_probes are for the 1D solver (Nr = 1)");
+    if (in.spectrum_window < 16 || (in.spectrum_window & (in.spectrum_window - 1)) != 0)
+        throw std::runtime_error("spectrum_window must be a power of 2, at least 16");
+    if (in.spectrum_peaks < 1)
+        throw std::runtime_error("spectrum_peaks must be at least 1");
+
+    in.number_output = std::stoi(dict["number_output"]);
+    in.velocity_file = dict["velocity_file"];
+    in.pressure_file = dict["pressure_file"];
+    in.temperature_file = dict["temperature_file"];
+    in.density_file = dict["density_file"];
+
+    const std::vector<std::string> errors = inputErrors(in);
+    if (!errors.empty()) {
+        std::string message = errors.front();
+        for (std::size_t i = 1; i < errors.size(); ++i) message += "\n" + errors[i];
+        throw std::runtime_error(message);
+    }
+
+    return in;
+}
+
+std::vector<std::string> inputErrors(const Input& in) {
+
+    std::vector<std::string> errors;
+    const auto error = [&](const std::string& m) { errors.push_back(m); };
+
+    if (in.N < 3)
+        error("N = " + std::to_string(in.N) + ": at least 3 cells are needed, two of them BC rows");
+    if (in.L <= 0.0)
+        error("L must be positive");
+
+    // Time stepping and output cadence: print_every = time_steps / number_output
+    if (in.dt_user <= 0.0)
+        error("dt_user must be positive");
+    else if (in.simulation_time / in.dt_user >= INT_MAX)
+        error("simulation_time / dt_user overflows the step counter");
+    if (in.number_output < 1)
+        error("number_output must be at least 1");
+
+    if (in.piso_outer_iter < 1)
+        error("piso_outer_iter must be at least 1");
+    if (in.piso_inner_iter < 1)
+        error("piso_inner_iter must be at least 1");
+
+    // BC codes: 0 Dirichlet, 1 Neumann
+    for (const auto& bc : { std::make_pair("u_inlet_bc", in.u_inlet_bc), std::make_pair("u_outlet_bc", in.u_outlet_bc),
+                            std::make_pair("T_inlet_bc", in.T_inlet_bc), std::make_pair("T_outlet_bc", in.T_outlet_bc),
+                            std::make_pair("p_inlet_bc", in.p_inlet_bc), std::make_pair("p_outlet_bc", in.p_outlet_bc) })
+        if (bc.second != 0 && bc.second != 1)
+            error(std::string(bc.first) + " = " + std::to_string(bc.second) + ": must be 0 (Dirichlet) or 1 (Neumann)");
+
+    if (in.mu < 0.0 || in.k < 0.0)
+        error("mu and k must not be negative");
+    if (in.Rv <= 0.0 || in.cp <= 0.0)
+        error("Rv and cp must be positive");
+    if (in.p_initial <= 0.0 || in.T_initial <= 0.0 || in.rho_initial <= 0.0)
+        error("p_initial, T_initial and rho_initial must be positive");
+
+    if (in.threads < 0)
+        error("threads must not be negative");
+    if (in.checkpoint_every < 0)
+        error("checkpoint_every must not be negative");
+
+    if (in.Nr > 1) {
+        if (in.adi_sweeps < 1)
+            error("adi_sweeps must be at least 1");
+        if (in.T_wall_bc != 0 && in.T_wall_bc != 1)
+            error("T_wall_bc = " + std::to_string(in.T_wall_bc) + ": must be 0 (Dirichlet) or 1 (Neumann)");
+    }
+
+    for (const auto& file : { std::make_pair("velocity_file", &in.velocity_file), std::make_pair("pressure_file", &in.pressure_file),
+                              std::make_pair("temperature_file", &in.temperature_file), std::make_pair("density_file", &in.density_file) })
+        if (file.second->empty())
+            error(std::string(file.first) + " is empty");
+
+    return errors;
+}
+
+double crossSection(const Input& in, double z) {
+
+    if (in.area_z.empty())
+        return in.area_inlet + (in.area_outlet - in.area_inlet) * z / in.L;
+
+    if (z <= in.area_z.front()) return in.area_A.front();
+    if (z >= in.area_z.back()) return in.area_A.back();
+
+    const auto hi = std::upper_bound(in.area_z.begin(), in.area_z.end(), z) - in.area_z.begin();
+    const auto lo = hi - 1;
+
+    const double w = (z - in.area_z[lo]) / (in.area_z[hi] - in.area_z[lo]);
+    return in.area_A[lo] + w * (in.area_A[hi] - in.area_A[lo]);
+}
+
+int sourceZone(const Input& in, double z) {
+
+    if (z >= in.z_evap_start && z <= in.z_evap_end) return 1;
+    if (z >= in.z_cond_start && z <= in.z_cond_end) return -1;
+    return 0;
+}
+
+bool hasCrossSection(const Input& in) {
+
+    return !in.area_z.empty() || in.area_inlet != 1.0 || in.area_outlet != 1.0;
+}
+
+heap::Settings heapSettings(const Input& in) {
+
+    heap::Settings s;
+    s.huge_pages = in.huge_pages >= 1;
+    s.hugetlbfs = in.huge_pages == 2;
+    s.placement = in.numa_placement == "interleave" ? heap::Placement::interleave
+        : in.numa_placement == "local" ? heap::Placement::local : heap::Placement::first_touch;
+
+    return s;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "heap.h"
+
+// Lumped component at one end of the pipe (see lumped.h), from the keys
+// <end>_lumped and <end>_<parameter>, <end> being inlet or outlet
+struct LumpedInput {
+    std::string type = "none";              // none, plenum, orifice or condenser
+    double volume = 0.0;                    // Plenum: volume [m3]
+    double temperature = 0.0;               // Plenum: gas temperature; orifice: temperature beyond it [K]
+    double mass_flow = 0.0;                 // Plenum: external supply [kg/s]
+    double pressure = 0.0;                  // Orifice: pressure beyond it [Pa]
+    double loss = 1.0;                      // Orifice: loss coefficient K, dp = K rho u^2 / 2 [-]
+    double area = 0.0;                      // Orifice: throat area, 0 for the end face area [m2]
+    double UA = 0.0;                        // Condenser: fluid-to-wall conductance [W/K]
+    double heat_capacity = 0.0;             // Condenser: wall heat capacity [J/K]
+    double coolant_UA = 0.0;                // Condenser: wall-to-coolant conductance [W/K]
+    double coolant_temperature = 0.0;       // Condenser: coolant temperature [K]
+};
+
+struct Input {
+
+    int    N = 0;                           // Number of cells [-]
+    double L = 0.0;                         // Length of the domain [m]
+
+    double dt_user = 0.0;                   // User-defined time step [s]
+    double simulation_time = 0.0;           // Total simulation time [s]
+
+    int    picard_max_iter = 0;             // Maximum Picard iterations [-]
+    double picard_tol = 0.0;                // Picard tolerance [-]
+
+    int    piso_outer_iter = 0;             // PISO outer iterations [-]
+    int    piso_inner_iter = 0;             // PISO inner iterations [-]
+    double piso_outer_tol = 0.0;            // PISO outer tolerance [-]
+    double piso_inner_tol = 0.0;            // PISO inner tolerance [-]
+    bool   rhie_chow_on_off_v = true;       // RhieChow on/off [-]
+
+    double mu = 0.0;                        // Dynamic viscosity [kg/(m s)]
+    double Rv = 0.0;                        // Specific gas constant for water vapor [J/(kg K)]
+    double k = 0.0;                         // Thermal conductivity [W/(m K)]
+    double cp = 0.0;                        // Specific heat capacity at constant pressure [J/(kg K)]
+
+    double S_m_cell = 0.0;                  // Volumetric mass source [kg/(m3 s)]
+    double S_h_cell = 0.0;                  // Volumetric heat source [W/m3]
+
+    double z_evap_start = 0.0;              // Evaporation zone start [m]
+    double z_evap_end = 0.0;                // Evaporation zone end [m]
+    double z_cond_start = 0.0;              // Condensation zone start [m]
+    double z_cond_end = 0.0;                // Condensation zone end [m]
+
+    int    u_inlet_bc = 0;                  // 0 Dirichlet, 1 Neumann
+    double u_inlet_value = 0.0;             // [m/s]
+
+    int    u_outlet_bc = 0;                 // 0 Dirichlet, 1 Neumann
+    double u_outlet_value = 0.0;            // [m/s]
+
+    int    T_inlet_bc = 0;                  // 0 Dirichlet, 1 Neumann
+    double T_inlet_value = 0.0;             // [K]
+
+    int    T_outlet_bc = 0;                 // 0 Dirichlet, 1 Neumann
+    double T_outlet_value = 0.0;            // [K]
+
+    int    p_inlet_bc = 0;                  // 0 Dirichlet, 1 Neumann
+    double p_inlet_value = 0.0;             // [Pa]
+
+    int    p_outlet_bc = 0;                 // 0 Dirichlet, 1 Neumann
+    double p_outlet_value = 0.0;            // [Pa]
+
+    double u_initial = 0.0;                 // [m/s]
+    double p_initial = 0.0;                 // [Pa]
+    double T_initial = 0.0;                 // [K]
+    double rho_initial = 0.0;               // [kg/m3]
+
+    int    threads = 0;                     // OpenMP threads, 0 for the runtime default [-]
+    bool   deterministic = false;           // Bit-identical results for any thread count [-]
+    int    tdma_chunks = 8;                 // Fixed TDMA partitions in deterministic mode [-]
+    int    tdma_simd_rows = 0;              // Smallest system for the SIMD PCR solver, 0 built-in, -1 off [-]
+    int    tdma_simd_max_rows = 0;          // Largest system for the SIMD PCR solver, 0 built-in, -1 no limit [-]
+    std::string coupling = "gauss_seidel";  // Momentum/energy ordering: gauss_seidel or jacobi
+    std::string pressure_work = "lagged";   // Energy pressure work: lagged or inner (corrected with every p')
+    std::string algorithm = "piso";         // Pressure-velocity algorithm: piso, simplec or pimple
+    double relax_u = 1.0;                   // Velocity under-relaxation, -1 adaptive (simplec, pimple) [-]
+    double relax_T = 1.0;                   // Temperature under-relaxation, -1 adaptive (simplec, pimple) [-]
+    double relax_p = 1.0;                   // Pressure under-relaxation, -1 adaptive (simplec, pimple) [-]
+    bool   memory_lean = false;             // One coefficient workspace for all equations [-]
+    bool   lean_float = false;              // Memory-lean mode: momentum residual arrays in float [-]
+    int    huge_pages = 1;                  // Large arrays: 0 normal pages, 1 transparent huge pages, 2 hugetlbfs pool first [-]
+    std::string numa_placement = "first_touch"; // Large arrays: first_touch, interleave over NUMA nodes or local
+    std::string affinity = "none";          // Thread pinning: none, compact, scatter or case_per_core
+
+    std::string control_file = "";          // Runtime control file, empty to disable
+    int    control_every = 10;              // Steps between two control file polls [-]
+    std::string restart_file = "";          // Checkpoint or manifest to restart from, empty for a cold start
+    int    checkpoint_every = 0;            // Steps between two checkpoints, 0 for on request only [-]
+    bool   checkpoint_async = false;        // Checkpoints written by a fork()ed child (Linux) [-]
+    std::string schedule_file = "";         // Time table of source and boundary values, empty for none
+
+    double rt_period = 1.0e-3;              // Real-time mode: wall-clock tick [s]
+    double rt_budget = 0.0;                 // Real-time mode: wall time for one step, 0 for 90% of the tick [s]
+    bool   rt_lock_memory = false;          // Real-time mode: lock the process memory in RAM (Linux) [-]
+
+    int    Nr = 1;                          // Radial cells, > 1 for the axisymmetric r-z solver [-]
+    double R = 0.0;                         // r-z mode: radius of the domain [m]
+    int    adi_sweeps = 2;                  // r-z mode: ADI sweep pairs per linear system [-]
+    int    T_wall_bc = 1;                   // r-z mode: 0 Dirichlet, 1 Neumann (adiabatic)
+    double T_wall_value = 0.0;              // r-z mode: wall temperature [K]
+
+    std::string area_file = "";             // Cross-section table (z [m], A [m2] per line), empty for none
+    double area_inlet = 1.0;                // Cross-section at z = 0 without a table [m2]
+    double area_outlet = 1.0;               // Cross-section at z = L without a table [m2]
+    std::vector<double> area_z;             // Cross-section table: positions [m]
+    std::vector<double> area_A;             // Cross-section table: areas [m2]
+    int    eos_density = -1;                // Density on the EOS: 1 on, 0 off, -1 only with a cross-section profile
+
+    LumpedInput inlet_lumped;               // Lumped component at z = 0
+    LumpedInput outlet_lumped;              // Lumped component at z = L
+
+    bool   statistics = false;              // Per-cell time mean, RMS, min and max of u, p, T, rho [-]
+    double statistics_start = 0.0;          // Start of the statistics and spectra [s]
+    std::string spectrum_probes = "";       // Probe signals to analyse, field@z list; empty for none
+    int    spectrum_window = 1024;          // Samples per FFT window, a power of 2 [-]
+    int    spectrum_peaks = 3;              // Dominant frequencies reported per probe [-]
+
+    int number_output = 0;                  // Number of outputs [-]
+
+    std::string velocity_file = "";
+    std::string pressure_file = "";
+    std::string temperature_file = "";
+    std::string density_file = "";
+};
+
+// Reads a key = value file; '#' starts a comment
+std::unordered_map<std::string, std::string> readKeyValues(const std::string& filename);
+
+Input readInput(const std::string& filename);
+
+// Input from the keys of an input file, e.g. a base case with overrides.
+// Throws the inputErrors of the case, one per line.
+Input parseInput(std::unordered_map<std::string, std::string> dict);
+
+// Values the solver cannot run with, one message each: mesh, time stepping,
+// number_output < 1 (print_every divides by it), iteration caps, BC codes,
+// properties, thread and checkpoint counts, output file names
+std::vector<std::string> inputErrors(const Input& in);
+
+// Cross-section at z: linear interpolation of the area table, constant
+// beyond its ends, or without a table linear from area_inlet to area_outlet
+double crossSection(const Input& in, double z);
+
+// Source zone of the point z: +1 in the evaporator [z_evap_start,
+// z_evap_end], -1 in the condenser [z_cond_start, z_cond_end], 0 elsewhere.
+// The evaporator wins where the two overlap. Cell i is in the zone of its
+// centre, z = (i + 0.5) dz.
+int sourceZone(const Input& in, double z);
+
+// True when the case gives a cross-section other than the default 1 m2: an
+// area table, or area_inlet or area_outlet. Such a case switches
+// eos_density on by default and is rejected in r-z mode.
+bool hasCrossSection(const Input& in);
+
+// huge_pages and numa_placement as heap settings. They hold for the whole
+// process: drivers that run several cases configure them once from the
+// base case, and a case asking for others fails (heap::configure).
+heap::Settings heapSettings(const Input& in);
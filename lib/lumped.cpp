@@ -0,0 +1,138 @@
+#include "lumped.h"
+
+#include <cmath>
+#include <sstream>
+
+#include "stencil.h"
+
+namespace lumped {
+
+namespace {
+
+// Below this pressure difference the orifice law is continued linearly,
+// so that its conductance stays finite at rest [Pa]
+constexpr double orifice_linear_dp = 1.0;
+}
+
+void condense(const Block& k, int i, bool last, double* a, double* b, double* c, double* d) {
+
+    const double s = k.e / k.m;
+
+    b[i] = k.b - s * k.g0;
+    d[i] = k.d - s * k.r;
+
+    const double nb = k.c - s * k.g1;
+    a[i] = last ? nb : 0.0;
+    c[i] = last ? 0.0 : nb;
+}
+
+double recover(const Block& k, double x_end, double x_nb) {
+    return (k.r - k.g0 * x_end - k.g1 * x_nb) / k.m;
+}
+
+Component::Component(const LumpedInput& in, double T_initial) : in_(in), wall_T_(T_initial) {
+
+    if (in.type == "plenum") kind_ = Kind::plenum;
+    else if (in.type == "orifice") kind_ = Kind::orifice;
+    else if (in.type == "condenser") kind_ = Kind::condenser;
+}
+
+void Component::pressure_row(double q, double D, double p_end, double p_end_old, double rho_end, double A, double dt,
+    double Rv, int i, bool last, double* a, double* b, double* c, double* d) {
+
+    Block& k = pressure_;
+
+    // Flow out of the pipe after the correction
+    k.b = D;
+    k.c = -D;
+    k.e = 1.0;
+    k.d = q;
+
+    if (kind_ == Kind::plenum) {
+
+        // Mass stored in the plenum, p V / (Rv T)
+        const double C = in_.volume / (Rv * in_.temperature * dt);        // [m s]
+
+        k.g0 = -C;
+        k.r = C * (p_end - p_end_old) - in_.mass_flow;
+    }
+    else {
+
+        // Upstream density
+        const double dp = p_end - in_.pressure;                             // [Pa]
+        const double rho = dp > 0.0 ? rho_end : in_.pressure / (Rv * in_.temperature);
+        const double kA = (in_.area > 0.0 ? in_.area : A) * std::sqrt(2.0 * rho / in_.loss);
+
+        if (std::fabs(dp) > orifice_linear_dp) {
+            k.r = std::copysign(kA * std::sqrt(std::fabs(dp)), dp);
+            k.g0 = -kA / (2.0 * std::sqrt(std::fabs(dp)));
+        }
+        else {
+            k.r = kA * dp / std::sqrt(orifice_linear_dp);
+            k.g0 = -kA / std::sqrt(orifice_linear_dp);
+        }
+    }
+
+    k.g1 = 0.0;
+    k.m = 1.0;
+
+    condense(k, i, last, a, b, c, d);
+}
+
+void Component::energy_row(double q, double F, double Dk, double dt, int i, bool last, double* a, double* b, double* c, double* d) {
+
+    if (kind_ != Kind::condenser) {
+
+        // Inflow at the component temperature, outflow as it comes
+        stencil::boundary(q > 0.0 ? 1 : 0, in_.temperature, 1.0, i, last, a, b, c, d);
+        return;
+    }
+
+    // Heat balance of the end node: conduction and, when the gas leaves
+    // the pipe, upwind convection from the neighbour, against the wall
+    const double out = q > 0.0 ? F : 0.0;
+
+    Block k;
+    k.b = Dk + out + in_.UA;
+    k.c = -(Dk + out);
+    k.e = -in_.UA;
+    k.d = 0.0;
+
+    k.g0 = -in_.UA;
+    k.m = wall_m(dt);
+    k.r = wall_r(dt);
+
+    condense(k, i, last, a, b, c, d);
+}
+
+void Component::advance(double T_end, double dt) {
+
+    if (kind_ != Kind::condenser) return;
+
+    wall_T_ = (wall_r(dt) + in_.UA * T_end) / wall_m(dt);
+    heat_ = in_.UA * (T_end - wall_T_);
+}
+
+std::string Component::describe() const {
+
+    std::ostringstream os;
+
+    switch (kind_) {
+    case Kind::plenum:
+        os << "plenum, " << in_.volume << " m3 at " << in_.temperature << " K, supply " << in_.mass_flow << " kg/s";
+        break;
+    case Kind::orifice:
+        os << "orifice, K = " << in_.loss << ", throat " << (in_.area > 0.0 ? std::to_string(in_.area) + " m2" : "end face")
+            << ", to " << in_.pressure << " Pa at " << in_.temperature << " K";
+        break;
+    case Kind::condenser:
+        os << "condenser, UA " << in_.UA << " W/K, wall " << in_.heat_capacity << " J/K, coolant UA "
+            << in_.coolant_UA << " W/K at " << in_.coolant_temperature << " K";
+        break;
+    default:
+        os << "none";
+    }
+
+    return os.str();
+}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+
+#include "input.h"
+
+namespace lumped {
+
+    // One unknown y of a lumped component, coupled to the end row i of a
+    // tridiagonal system, x_nb being the neighbour of that row (i + 1, or
+    // i - 1 at the last row):
+    //
+    //     end row         b x_end + c x_nb + e y = d
+    //     component row   g0 x_end + g1 x_nb + m y = r
+    //
+    // condense eliminates y from the end row through the Schur complement
+    // of m, which leaves the system tridiagonal; the component is then
+    // solved together with the pipe, without a coupling iteration, and
+    // recover gives y from the solution.
+    struct Block {
+        double b = 0.0, c = 0.0, e = 0.0, d = 0.0;          // End row
+        double g0 = 0.0, g1 = 0.0, m = 1.0, r = 0.0;        // Component row
+    };
+
+    // Writes the condensed end row i into a, b, c, d
+    void condense(const Block& k, int i, bool last, double* a, double* b, double* c, double* d);
+
+    double recover(const Block& k, double x_end, double x_nb);
+
+    enum class Kind { none, plenum, orifice, condenser };
+
+    // Component at one end of the pipe.
+    //
+    // Mass components take over the pressure correction row of their end:
+    // the end row is the mass flow out of the pipe through the end face,
+    // y = q* - D (p'_end - p'_nb), with q* the flow of the current face
+    // velocity and D the p' conductance of that face; the component row
+    // is the flow the component takes at the corrected end pressure,
+    //
+    //     plenum    y = V / (Rv T dt) (p_end - p_end_old) - mass_flow
+    //     orifice   y = sign(dp) A sqrt(2 rho |dp| / K), dp = p_end - pressure,
+    //               linearized at the current p_end
+    //
+    // The plenum pressure is the end pressure, so the plenum needs no state
+    // of its own. Gas flowing into the pipe has the component temperature
+    // (Dirichlet), gas flowing out the end cell's (Neumann).
+    //
+    // The condenser takes over the energy row of its end: the end node
+    // exchanges UA (T_end - T_wall) with a wall of heat capacity C that
+    // loses coolant_UA (T_wall - coolant_temperature),
+    //
+    //     C (T_wall - T_wall_old) / dt = UA (T_end - T_wall) - coolant_UA (T_wall - T_coolant)
+    //
+    // integrated implicitly with the pipe. Its velocity and pressure BCs
+    // stay those of the input.
+    class Component {
+    public:
+        Component() = default;
+        Component(const LumpedInput& in, double T_initial);
+
+        Kind kind() const { return kind_; }
+        bool carries_mass() const { return kind_ == Kind::plenum || kind_ == Kind::orifice; }
+
+        // Condensed p' row of end cell i. q: mass flow out of the pipe of
+        // the current face velocity [kg/s]; D: p' conductance of the end
+        // face [m s]; A: end face area [m2].
+        void pressure_row(double q, double D, double p_end, double p_end_old, double rho_end, double A, double dt,
+            double Rv, int i, bool last, double* a, double* b, double* c, double* d);
+
+        // Mass flow out of the pipe from the p' solution [kg/s]
+        void pressure_solved(double x_end, double x_nb) { flow_ = recover(pressure_, x_end, x_nb); }
+
+        // Energy row of end cell i. q as above; F = cp |q| [W/K]; Dk: the
+        // conductance of the end face [W/K].
+        void energy_row(double q, double F, double Dk, double dt, int i, bool last, double* a, double* b, double* c, double* d);
+
+        // The wall temperature at the end of a step, from the final T_end
+        void advance(double T_end, double dt);
+
+        double flow() const { return flow_; }              // Into the component, last p' solve [kg/s]
+        double wall_temperature() const { return wall_T_; } // Condenser wall [K]
+        double heat() const { return heat_; }              // Condenser: fluid to wall, last step [W]
+
+        void set_wall_temperature(double T) { wall_T_ = T; }
+
+        // One line: kind and parameters
+        std::string describe() const;
+
+    private:
+        Kind kind_ = Kind::none;
+        LumpedInput in_;
+
+        Block pressure_;                    // Last condensed p' row
+        double flow_ = 0.0;                 // [kg/s]
+        double wall_T_ = 0.0;               // [K]
+        double heat_ = 0.0;                 // [W]
+
+        // Wall row of the condenser: m T_wall = r + UA T_end
+        double wall_m(double dt) const { return in_.heat_capacity / dt + in_.UA + in_.coolant_UA; }
+        double wall_r(double dt) const { return in_.heat_capacity / dt * wall_T_ + in_.coolant_UA * in_.coolant_temperature; }
+    };
+}
@@ -0,0 +1,366 @@
+#include "mms.h"
+
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <omp.h>
+
+#include "solver.h"
+
+namespace mms {
+
+namespace {
+
+// Forward-mode dual number; nesting it gives second derivatives
+template <typename T>
+struct Dual {
+    T v;        // Value
+    T d;        // Derivative
+};
+
+template <typename T> Dual<T> operator+(Dual<T> a, Dual<T> b) { return { a.v + b.v, a.d + b.d }; }
+template <typename T> Dual<T> operator-(Dual<T> a, Dual<T> b) { return { a.v - b.v, a.d - b.d }; }
+template <typename T> Dual<T> operator*(Dual<T> a, Dual<T> b) { return { a.v * b.v, a.v * b.d + a.d * b.v }; }
+template <typename T> Dual<T> operator/(Dual<T> a, Dual<T> b) { return { a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v) }; }
+
+template <typename T> Dual<T> operator+(Dual<T> a, double s) { return { a.v + s, a.d }; }
+template <typename T> Dual<T> operator+(double s, Dual<T> a) { return { s + a.v, a.d }; }
+template <typename T> Dual<T> operator-(Dual<T> a, double s) { return { a.v - s, a.d }; }
+template <typename T> Dual<T> operator-(double s, Dual<T> a) { return { s - a.v, -1.0 * a.d }; }
+template <typename T> Dual<T> operator*(Dual<T> a, double s) { return { a.v * s, a.d * s }; }
+template <typename T> Dual<T> operator*(double s, Dual<T> a) { return { s * a.v, s * a.d }; }
+template <typename T> Dual<T> operator/(Dual<T> a, double s) { return { a.v / s, a.d / s }; }
+template <typename T> Dual<T> operator/(double s, Dual<T> a) { return Dual<T>{ s + 0.0 * a.v, 0.0 * a.d } / a; }
+
+using std::sin;
+using std::cos;
+
+template <typename T> Dual<T> sin(Dual<T> a) { return { sin(a.v), cos(a.v) * a.d }; }
+template <typename T> Dual<T> cos(Dual<T> a) { return { cos(a.v), -1.0 * sin(a.v) * a.d }; }
+
+using D1 = Dual<double>;
+using D2 = Dual<D1>;
+
+const double pi = 3.14159265358979323846;
+
+// Manufactured solution and the properties it is run with: a smooth
+// low-Mach profile with a periodic modulation in time
+struct Case {
+
+    double L = 1.0;             // Length of the domain [m]
+    double t_end = 0.05;        // Final time [s]
+    double tau = 0.1;           // Period of the time modulation [s]
+    double a_t = 0.05;          // Amplitude of the time modulation [-]
+
+    double U0 = 1.0;            // Velocity scale [m/s]
+    double T0 = 300.0;          // Temperature scale [K]
+    double p0 = 1.0e4;          // Pressure scale [Pa]
+
+    double mu = 1.0e-5;         // Dynamic viscosity [kg/(m s)]
+    double k = 0.01;            // Thermal conductivity [W/(m K)]
+    double Rv = 361.5;          // Specific gas constant [J/(kg K)]
+    double cp = 1000.0;         // Specific heat capacity [J/(kg K)]
+
+    // Zero gradient where the boundary condition is Neumann: du/dz at the
+    // outlet, dT/dz at the outlet, dp/dz at the inlet
+    template <typename T> T u(T z, T t) const {
+        return U0 * (1.0 + 0.3 * sin(0.5 * pi * z / L)) * (1.0 + a_t * sin(2.0 * pi * t / tau));
+    }
+
+    template <typename T> T temp(T z, T t) const {
+        return T0 * (1.0 + 0.1 * cos(pi * z / L) * (1.0 + a_t * sin(2.0 * pi * t / tau)));
+    }
+
+    template <typename T> T p(T z, T t) const {
+        return p0 * (1.0 + 1.0e-4 * cos(pi * z / L) * (1.0 + 2.5 * a_t * sin(2.0 * pi * t / tau)));
+    }
+
+    template <typename T> T rho(T z, T t) const {
+        return p(z, t) / (Rv * temp(z, t));
+    }
+};
+
+// Partial derivatives of f(z, t) at a point
+template <typename F> double d_dz(F f, double z, double t) { return f(D1{ z, 1.0 }, D1{ t, 0.0 }).d; }
+template <typename F> double d_dt(F f, double z, double t) { return f(D1{ z, 0.0 }, D1{ t, 1.0 }).d; }
+template <typename F> double d2_dz2(F f, double z, double t) {
+    return f(D2{ { z, 1.0 }, { 1.0, 0.0 } }, D2{ { t, 0.0 }, { 0.0, 0.0 } }).d.d;
+}
+
+// Source terms of the continuous equations the solver discretizes
+void sources(const Case& c, Solver& s, double t) {
+
+    auto u = [&](auto z, auto t) { return c.u(z, t); };
+    auto T = [&](auto z, auto t) { return c.temp(z, t); };
+    auto p = [&](auto z, auto t) { return c.p(z, t); };
+    auto rho = [&](auto z, auto t) { return c.rho(z, t); };
+    auto rho_u = [&](auto z, auto t) { return c.rho(z, t) * c.u(z, t); };
+    auto rho_uu = [&](auto z, auto t) { return c.rho(z, t) * c.u(z, t) * c.u(z, t); };
+    auto rho_T = [&](auto z, auto t) { return c.rho(z, t) * c.temp(z, t); };
+    auto rho_uT = [&](auto z, auto t) { return c.rho(z, t) * c.u(z, t) * c.temp(z, t); };
+
+    for (int i = 0; i < s.N; ++i) {
+
+        const double z = (i + 0.5) * s.dz;
+        const double dudz = d_dz(u, z, t);
+
+        s.S_m[i] = d_dt(rho, z, t) + d_dz(rho_u, z, t);
+
+        s.S_u[i] = d_dt(rho_u, z, t) + d_dz(rho_uu, z, t) + d_dz(p, z, t)
+            - 4.0 / 3.0 * c.mu * d2_dz2(u, z, t);
+
+        s.S_h[i] = c.cp * (d_dt(rho_T, z, t) + d_dz(rho_uT, z, t))
+            - c.k * d2_dz2(T, z, t)
+            - d_dt(p, z, t)
+            - c.u(z, t) * d_dz(p, z, t)
+            - 4.0 / 3.0 * c.mu * dudz * dudz;
+    }
+}
+
+struct Errors {
+    double l2[4] = { 0.0, 0.0, 0.0, 0.0 };      // RMS error of u, p, T, rho
+    double linf[4] = { 0.0, 0.0, 0.0, 0.0 };    // Max error of u, p, T, rho
+    double wall = 0.0;                          // Solver wall time [s]
+    double cpu = 0.0;                           // Solver CPU time [s]
+    int steps = 0;
+    long long outer = 0;                        // Outer iterations summed over the run
+};
+
+Errors solve(const Case& c, const Input& base, int N, int steps) {
+
+    Input in = base;
+    in.N = N;
+    in.L = c.L;
+    in.dt_user = c.t_end / steps;
+    in.simulation_time = c.t_end;
+
+    in.mu = c.mu;
+    in.k = c.k;
+    in.Rv = c.Rv;
+    in.cp = c.cp;
+
+    in.S_m_cell = 0.0;
+    in.S_h_cell = 0.0;
+
+    // The manufactured solutions are for a constant cross-section
+    in.area_z.clear();
+    in.area_A.clear();
+    in.area_inlet = 1.0;
+    in.area_outlet = 1.0;
+
+    // Same boundary types as the shipped cases
+    in.u_inlet_bc = 0;
+    in.u_outlet_bc = 1;
+    in.T_inlet_bc = 0;
+    in.T_outlet_bc = 1;
+    in.p_inlet_bc = 1;
+    in.p_outlet_bc = 0;
+    in.inlet_lumped = in.outlet_lumped = LumpedInput();
+
+    // The manufactured density is p / (Rv T). Off the equation of state the
+    // solver transports rho on its own and moves p only by the corrector's
+    // p', so p and rho drift apart by O(1) of the imposed variation, on any
+    // mesh and step, and neither converges to this solution.
+    in.eos_density = 1;
+
+    Solver s(in);
+
+    // Exact initial state
+    for (int i = 0; i < N; ++i) {
+
+        const double z = (i + 0.5) * s.dz;
+
+        s.u_v[i] = c.u(z, 0.0);
+        s.p_v[i] = c.p(z, 0.0);
+        s.T_v[i] = c.temp(z, 0.0);
+        s.rho_v[i] = c.rho(z, 0.0);
+        s.bVU[i] = s.rho_v[i] * s.dz / s.dt + 2 * s.mu / s.dz;
+    }
+
+    s.u_v_old = s.u_v;
+    s.p_v_old = s.p_v;
+    s.T_v_old = s.T_v;
+    s.rho_v_old = s.rho_v;
+
+    for (int i = 0; i < N; ++i)
+        s.p_storage_v[i + 1] = s.p_v[i];
+
+    s.p_storage_v[0] = s.p_v[0];
+    s.p_storage_v[N + 1] = s.p_v[N - 1];
+
+    const double z_first = 0.5 * s.dz;
+    const double z_last = (N - 0.5) * s.dz;
+
+    Errors e;
+    e.steps = steps;
+
+    for (int n = 0; n < steps; ++n) {
+
+        // Sources and boundary values at the new time level (implicit Euler)
+        const double t = (n + 1) * s.dt;
+
+        sources(c, s, t);
+
+        s.u_inlet_value = c.u(z_first, t);
+        s.T_inlet_value = c.temp(z_first, t);
+        s.p_outlet_value = c.p(z_last, t);
+
+        // The boundary densities are not transported by the solver
+        s.rho_v[0] = c.rho(z_first, t);
+        s.rho_v[N - 1] = c.rho(z_last, t);
+
+        const double wall = omp_get_wtime();
+        const std::clock_t cpu = std::clock();
+
+        s.step();
+
+        e.cpu += static_cast<double>(std::clock() - cpu) / CLOCKS_PER_SEC;
+        e.wall += omp_get_wtime() - wall;
+        e.outer += s.outer_v;
+    }
+
+    for (int i = 0; i < N; ++i) {
+
+        const double z = (i + 0.5) * s.dz;
+
+        const double err[4] = {
+            s.u_v[i] - c.u(z, c.t_end),
+            s.p_v[i] - c.p(z, c.t_end),
+            s.T_v[i] - c.temp(z, c.t_end),
+            s.rho_v[i] - c.rho(z, c.t_end) };
+
+        for (int q = 0; q < 4; ++q) {
+            e.l2[q] += err[q] * err[q];
+            e.linf[q] = std::max(e.linf[q], std::fabs(err[q]));
+        }
+    }
+
+    for (int q = 0; q < 4; ++q)
+        e.l2[q] = std::sqrt(e.l2[q] / N);
+
+    return e;
+}
+
+const char* names[4] = { "u", "p", "T", "rho" };
+
+// Upwind convection and implicit Euler: first order in dz and dt together.
+// An observed order below this on the two finest meshes fails the run.
+const double min_order = 0.8;
+
+bool diverged(const Errors& e) {
+    for (int q = 0; q < 4; ++q)
+        if (!std::isfinite(e.l2[q])) return true;
+    return false;
+}
+
+void report(std::ostream& csv, const std::string& study, int N, const Errors& e, const Errors* coarser) {
+
+    std::cout << std::setw(6) << N << std::setw(7) << e.steps
+        << std::setw(8) << e.outer;
+
+    for (int q = 0; q < 4; ++q) {
+        std::cout << std::scientific << std::setprecision(3) << std::setw(11) << e.l2[q];
+        if (coarser)
+            std::cout << std::fixed << std::setprecision(2) << std::setw(6)
+                << std::log2(coarser->l2[q] / e.l2[q]);
+        else
+            std::cout << std::setw(6) << "-";
+    }
+
+    std::cout << std::scientific << std::setprecision(3)
+        << std::setw(11) << e.wall << std::setw(11) << e.cpu
+        << std::setw(11) << e.l2[0] * e.cpu
+        << (diverged(e) ? "  diverged" : "") << std::endl;
+
+    csv << study << "," << N << "," << e.steps << "," << e.outer;
+    for (int q = 0; q < 4; ++q)
+        csv << "," << e.l2[q] << "," << e.linf[q];
+    csv << "," << e.wall << "," << e.cpu << "\n";
+}
+
+void header(const std::string& title) {
+
+    std::cout << "\n" << title << "\n"
+        << std::setw(6) << "N" << std::setw(7) << "steps" << std::setw(8) << "outer";
+    for (int q = 0; q < 4; ++q)
+        std::cout << std::setw(11) << (std::string("L2 ") + names[q]) << std::setw(6) << "ord";
+    std::cout << std::setw(11) << "wall [s]" << std::setw(11) << "cpu [s]"
+        << std::setw(11) << "L2u*cpu" << std::endl;
+}
+
+}
+
+int run(const Input& base, const std::string& caseName) {
+
+    Case c;
+    c.Rv = base.Rv > 0.0 ? base.Rv : c.Rv;
+    c.cp = base.cp > 0.0 ? base.cp : c.cp;
+
+    std::filesystem::path outputDir = std::filesystem::path("output") / "mms";
+    std::filesystem::create_directories(outputDir);
+
+    std::ofstream csv(outputDir / (caseName + ".csv"));
+    csv << std::setprecision(10)
+        << "study,N,steps,outer_iterations,"
+        << "L2_u,Linf_u,L2_p,Linf_p,L2_T,Linf_T,L2_rho,Linf_rho,wall_s,cpu_s\n";
+
+    std::cout << "Manufactured solution, options from " << caseName
+        << ": rhie_chow = " << base.rhie_chow_on_off_v
+        << ", outer tol = " << base.piso_outer_tol
+        << ", inner tol = " << base.piso_inner_tol
+        << ", threads = " << omp_get_max_threads() << std::endl;
+
+    // Mesh refinement with dt ~ dz
+    header("Mesh refinement (dt ~ dz)");
+
+    int failures = 0;
+
+    Errors previous, coarser;
+    for (int level = 0; level < 5; ++level) {
+
+        const int N = 20 << level;
+        const Errors e = solve(c, base, N, N / 2);
+
+        report(csv, "mesh", N, e, level > 0 ? &previous : nullptr);
+        failures += diverged(e);
+        coarser = previous;
+        previous = e;
+    }
+
+    // Observed order between the two finest meshes
+    bool low = false;
+
+    std::cout << "\nObserved order, N = " << (20 << 3) << " -> " << (20 << 4) << ":" << std::fixed << std::setprecision(2);
+    for (int q = 0; q < 4; ++q) {
+        const double order = std::log2(coarser.l2[q] / previous.l2[q]);
+        std::cout << " " << names[q] << " " << order;
+        low = low || !(order >= min_order);
+    }
+    std::cout << " (at least " << min_order << ")" << (low ? "  FAILED" : "") << std::defaultfloat << std::endl;
+
+    failures += low;
+
+    // Time refinement on a fixed fine mesh
+    const int N_time = 160;
+    header("Time refinement (N = " + std::to_string(N_time) + ")");
+
+    for (int level = 0; level < 4; ++level) {
+
+        const int steps = 10 << level;
+        const Errors e = solve(c, base, N_time, steps);
+
+        report(csv, "time", N_time, e, level > 0 ? &previous : nullptr);
+        failures += diverged(e);
+        previous = e;
+    }
+
+    std::cout << "\nResults written to " << (outputDir / (caseName + ".csv")).string() << std::endl;
+
+    return failures > 0 ? 1 : 0;
+}
+
+}
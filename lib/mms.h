@@ -0,0 +1,20 @@
+#pragma once
+
+#include "input.h"
+
+namespace mms {
+
+    // Method of manufactured solutions. Analytic u(z,t), p(z,t), T(z,t)
+    // (rho from the equation of state) are imposed by injecting the matching
+    // source terms into the continuity, momentum and energy equations and the
+    // exact values at the Dirichlet ends (u, T inlet, p outlet, as in the
+    // shipped cases), with the density on the equation of state. A mesh
+    // refinement (dt ~ dz) and a time refinement (fixed mesh) are run with
+    // the numerical options of `base` (RhieChow, tolerances, iteration
+    // caps, threading); the error norms and observed orders are reported
+    // with the solver wall and CPU time of every run, both on stdout and in
+    // output/mms/<case>.csv. Returns 1 if any run diverged or if an L2 error
+    // of the mesh refinement converges at below first order (0.8) between
+    // the two finest meshes.
+    int run(const Input& base, const std::string& caseName);
+}
@@ -0,0 +1,253 @@
+#include "parareal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <omp.h>
+
+#include "affinity.h"
+#include "schedule.h"
+#include "solver.h"
+
+namespace parareal {
+
+namespace {
+
+// Everything a step starts from, at a step boundary where old = current
+heap::vector<double> Solver::* const fields[] = {
+    &Solver::u_v, &Solver::p_v, &Solver::T_v, &Solver::rho_v, &Solver::bVU, &Solver::p_storage_v };
+
+using State = std::vector<double>;      // The fields one after the other
+
+State save(const Solver& s) {
+
+    State x;
+    for (auto f : fields) x.insert(x.end(), (s.*f).begin(), (s.*f).end());
+    return x;
+}
+
+void load(Solver& s, const State& x, double t) {
+
+    auto at = x.begin();
+    for (auto f : fields) {
+        std::copy(at, at + (s.*f).size(), (s.*f).begin());
+        at += (s.*f).size();
+    }
+
+    s.u_v_old = s.u_v;
+    s.p_v_old = s.p_v;
+    s.T_v_old = s.T_v;
+    s.rho_v_old = s.rho_v;
+    s.time_total = t;
+}
+
+// Largest change of any field relative to that field's largest magnitude
+// in b; infinite if a is not finite
+double change(const Solver& s, const State& a, const State& b) {
+
+    double worst = 0.0;
+    std::size_t begin = 0;
+
+    for (auto f : fields) {
+
+        const std::size_t end = begin + (s.*f).size();
+        double diff = 0.0, scale = 0.0;
+        for (std::size_t k = begin; k < end; ++k) {
+            if (!std::isfinite(a[k])) return HUGE_VAL;
+            diff = std::max(diff, std::fabs(a[k] - b[k]));
+            scale = std::max(scale, std::fabs(b[k]));
+        }
+        worst = std::max(worst, scale > 0.0 ? diff / scale : diff);
+        begin = end;
+    }
+    return worst;
+}
+
+// Solver with its own copy of the schedule, whose cache of the values last
+// put into the solver belongs to that solver
+struct Propagator {
+    Solver s;
+    schedule::Table table;
+    double dt = 0.0;                    // Step, or largest step with a schedule [s]
+
+    // State at t1 from x at t0
+    State operator()(const State& x, double t0, double t1) {
+
+        load(s, x, t0);
+
+        if (table.empty()) {
+            const int n = std::max(1, static_cast<int>(std::lround((t1 - t0) / dt)));
+            s.dt = (t1 - t0) / n;
+            for (int k = 0; k < n; ++k) s.step();
+        }
+        else {
+            for (int k = table.steps(t0, dt, t1); k > 0; --k) {
+                s.dt = table.step(s.time_total, dt, t1);
+                table.apply(s, s.time_total, s.time_total + s.dt);
+                s.step();
+            }
+        }
+
+        return save(s);
+    }
+};
+
+}
+
+int run(const Input& in, const std::string& caseName, int slices, int ratio, double tolerance) {
+
+    if (in.Nr > 1)
+        throw std::runtime_error("--parareal is for the 1D solver (Nr = 1)");
+    if (slices < 2 || ratio < 1)
+        throw std::runtime_error("--parareal needs at least 2 slices and a coarse ratio of at least 1");
+    if (in.inlet_lumped.type == "condenser" || in.outlet_lumped.type == "condenser")
+        throw std::runtime_error("--parareal: a condenser wall is state outside the fields it propagates");
+
+    const double T = in.simulation_time;
+    const int workers = omp_get_max_threads();          // Fine slices run at once [-]
+    const Solver s0(in);
+
+    Propagator base{ s0, {}, in.dt_user };
+    if (!in.schedule_file.empty()) base.table = schedule::Table(in.schedule_file, in, s0);
+
+    // The coarse error only slows the iteration down, it does not reach the
+    // converged result: no need to solve G's steps tighter than that
+    Propagator coarse = base;
+    coarse.dt = ratio * in.dt_user;
+    coarse.s.outer_tol_v = std::max(coarse.s.outer_tol_v, tolerance);
+    coarse.s.inner_tol_v = std::max(coarse.s.inner_tol_v, tolerance);
+    std::vector<Propagator> fine(slices, base);
+
+    const auto t = [&](int n) { return T * n / slices; };
+
+    std::cout << "Parareal on " << caseName << ": " << slices << " slices, coarse dt " << coarse.dt
+        << " s, fine dt " << in.dt_user << " s, " << workers << " threads\n";
+
+    // Serial time loop at dt_user, slice after slice with the fine steps
+    std::vector<State> exact(slices + 1);
+    exact[0] = save(s0);
+
+    double start = omp_get_wtime();
+    for (int n = 0; n < slices; ++n)
+        exact[n + 1] = base(exact[n], t(n), t(n + 1));
+    const double serial = omp_get_wtime() - start;
+
+    // Iteration 0: serial coarse sweep
+    std::vector<State> U(slices + 1), G(slices + 1), F(slices + 1);
+    U[0] = exact[0];
+
+    start = omp_get_wtime();
+    for (int n = 0; n < slices; ++n)
+        U[n + 1] = G[n + 1] = coarse(U[n], t(n), t(n + 1));
+    double coarse_time = omp_get_wtime() - start;
+
+    if (change(s0, U[slices], U[slices]) == HUGE_VAL)
+        throw std::runtime_error("--parareal: the coarse propagator diverged at dt = "
+            + std::to_string(coarse.dt) + " s, lower the coarse ratio");
+
+    // On one core per slice an iteration takes its slowest fine slice and
+    // its coarse sweep
+    double ideal = coarse_time;
+
+    const std::filesystem::path outputDir = std::filesystem::path("output") / caseName;
+    std::filesystem::create_directories(outputDir);
+
+    std::ofstream csv(outputDir / "parareal.csv");
+    csv << "iteration,change,error,fine_slowest_s,coarse_s,wall_s\n";
+
+    const auto error = [&] {
+        double e = 0.0;
+        for (int n = 1; n <= slices; ++n) e = std::max(e, change(s0, U[n], exact[n]));
+        return e;
+    };
+
+    std::cout << std::setw(10) << "iteration" << std::setw(12) << "change" << std::setw(12) << "error"
+        << std::setw(16) << "slowest F [s]" << std::setw(12) << "G [s]" << "\n"
+        << std::scientific << std::setprecision(3)
+        << std::setw(10) << 0 << std::setw(12) << "" << std::setw(12) << error()
+        << std::setw(16) << "" << std::setw(12) << coarse_time << "\n";
+    csv << 0 << ",," << error() << ",," << coarse_time << "," << coarse_time << "\n";
+
+    int k = 1;
+    double wall = coarse_time, delta = 0.0;
+
+    for (; k <= slices; ++k) {
+
+        const double t0 = omp_get_wtime();
+
+        // Fine propagation of the slices not yet converged. The workers are
+        // plain threads, each running its solvers serially: inside an
+        // OpenMP parallel region every one of the solver's (inactive)
+        // parallel loops would set up a nested team, about 30% of a step at
+        // N = 51. Worker w runs on the CPU of slot w of the affinity policy.
+        std::vector<double> fine_time(slices, 0.0);
+        std::atomic<int> next_slice{ k - 1 };
+
+        std::vector<std::thread> pool;
+        for (int w = 0; w < std::min(workers, slices - k + 1); ++w) {
+            pool.emplace_back([&, w] {
+
+                omp_set_num_threads(1);
+                affinity::pin_worker(w);
+
+                for (int n; (n = next_slice++) < slices; ) {
+                    const double f0 = omp_get_wtime();
+                    F[n + 1] = fine[n](U[n], t(n), t(n + 1));
+                    fine_time[n] = omp_get_wtime() - f0;
+                }
+            });
+        }
+        for (std::thread& w : pool) w.join();
+
+        // Serial correction; the first of these slices starts from a
+        // converged state and becomes the fine solution
+        const double c0 = omp_get_wtime();
+        delta = 0.0;
+
+        for (int n = k - 1; n < slices; ++n) {
+
+            const State g = n == k - 1 ? G[n + 1] : coarse(U[n], t(n), t(n + 1));
+
+            State next = F[n + 1];
+            if (n > k - 1)
+                for (std::size_t j = 0; j < g.size(); ++j)
+                    next[j] = g[j] + F[n + 1][j] - G[n + 1][j];
+
+            delta = std::max(delta, change(s0, next, U[n + 1]));
+            U[n + 1] = std::move(next);
+            G[n + 1] = g;
+        }
+
+        coarse_time = omp_get_wtime() - c0;
+        const double slowest = *std::max_element(fine_time.begin(), fine_time.end());
+        ideal += slowest + coarse_time;
+        wall += omp_get_wtime() - t0;
+
+        const double e = error();
+        std::cout << std::setw(10) << k << std::setw(12) << delta << std::setw(12) << e
+            << std::setw(16) << slowest << std::setw(12) << coarse_time << "\n";
+        csv << k << "," << delta << "," << e << "," << slowest << "," << coarse_time << "," << wall << "\n";
+
+        if (delta == HUGE_VAL)
+            throw std::runtime_error("--parareal: the correction diverged in iteration " + std::to_string(k)
+                + ", lower the coarse ratio");
+        if (delta <= tolerance) break;
+    }
+
+    std::cout << std::defaultfloat << std::setprecision(4)
+        << (delta <= tolerance || k > slices ? "Converged" : "Not converged") << " after " << std::min(k, slices) << " iterations"
+        << " (tolerance " << tolerance << ")\n"
+        << "Serial time loop " << serial << " s, Parareal " << wall << " s: speedup " << serial / wall
+        << " on " << workers << " threads, " << serial / ideal << " on " << slices << " cores\n"
+        << "Iterations written to " << (outputDir / "parareal.csv").string() << std::endl;
+
+    return 0;
+}
+}
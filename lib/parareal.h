@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include "input.h"
+
+namespace parareal {
+
+    // Parallel-in-time integration of [0, simulation_time]:
+    // rhoPISO --parareal <input file> [slices] [coarse ratio] [tolerance].
+    //
+    // The interval is cut into `slices` equal time slices. The coarse
+    // propagator G is the same solver with a time step `ratio` times
+    // dt_user, the fine propagator F the solver at dt_user. Iteration 0 is
+    // a serial G sweep; every further iteration k runs F on the slices not
+    // yet converged, one thread each, from the current slice start states,
+    // then corrects serially
+    //
+    //     U[n+1] = G(U[n]) + F(U_prev[n]) - G(U_prev[n])
+    //
+    // over the state u, p, T, rho, bVU, p_storage of every cell. After k
+    // iterations the first k slices are the serial fine solution; the
+    // iteration stops once no slice end state changes by more than
+    // `tolerance` of each field's largest magnitude. A schedule_file is
+    // followed by both propagators.
+    //
+    // The serial time loop at dt_user is run as well, for the error and
+    // the speedup; besides the measured speedup on the threads present,
+    // the speedup on one core per slice is reported from the measured
+    // slice times. Iterations are written to output/<case>/parareal.csv.
+    int run(const Input& in, const std::string& caseName, int slices, int ratio, double tolerance);
+}
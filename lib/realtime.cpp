@@ -0,0 +1,186 @@
+#include "realtime.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "solver.h"
+
+namespace realtime {
+
+double Histogram::edge(int k) {
+    return 1.0e-6 * std::pow(2.0, 0.25 * k);
+}
+
+void Histogram::add(double seconds) {
+
+    int k = seconds > 1.0e-6 ? static_cast<int>(4.0 * std::log2(seconds * 1.0e6)) : 0;
+    k = std::min(k, bins);
+
+    ++counts_[k];
+    ++count_;
+    max_ = std::max(max_, seconds);
+}
+
+double Histogram::quantile(double q) const {
+
+    const long long target = static_cast<long long>(std::ceil(q * count_));
+    long long seen = 0;
+
+    for (int k = 0; k < bins; ++k) {
+        seen += counts_[k];
+        if (seen >= target) return std::min(edge(k + 1), max_);
+    }
+    return max_;
+}
+
+void Histogram::print(std::ostream& os, const std::string& title) const {
+
+    const auto flags = os.flags();
+    const auto precision = os.precision(4);
+
+    os << "\n" << title << ": " << count_ << " samples, p50 < " << quantile(0.5) * 1e6
+        << " us, p99 < " << quantile(0.99) * 1e6 << " us, p99.9 < " << quantile(0.999) * 1e6
+        << " us, max " << max_ * 1e6 << " us\n";
+
+    if (count_ == 0) {
+        os.flags(flags);
+        os.precision(precision);
+        return;
+    }
+
+    int first = 0;
+    int last = bins;
+    while (counts_[first] == 0) ++first;
+    while (counts_[last] == 0) --last;
+
+    const long long peak = *std::max_element(counts_.begin(), counts_.end());
+
+    for (int k = first; k <= last; ++k) {
+
+        os << std::fixed << std::setprecision(1) << std::setw(10) << edge(k) * 1e6 << " us ";
+        if (k == bins) os << "and up ";
+        os << std::setw(9) << counts_[k] << " "
+            << std::string(static_cast<std::size_t>(50.0 * counts_[k] / peak), '#') << "\n";
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void Histogram::write_csv(std::ostream& os, const std::string& name) const {
+    for (int k = 0; k <= bins; ++k)
+        if (counts_[k] > 0)
+            os << name << "," << edge(k) << "," << (k < bins ? edge(k + 1) : 0.0) << "," << counts_[k] << "\n";
+}
+
+int run(const Input& in, const std::string& caseName) {
+
+    using clock = std::chrono::steady_clock;
+
+    const double budget = in.rt_budget > 0.0 ? in.rt_budget : 0.9 * in.rt_period;
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+
+    Solver s(in);
+    s.step_budget = budget;
+
+    // Warm-up on a copy: faults in the pages and the thread pool, and
+    // measures the iteration costs the budget is enforced with
+    {
+        Solver warm = s;
+        warm.step_budget = 1.0e9;
+
+        for (int n = 0; n < 20; ++n)
+            warm.step();
+
+        s.outer_cost = warm.outer_cost;
+        s.inner_cost = warm.inner_cost;
+    }
+
+#ifdef __linux__
+    if (in.rt_lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        std::cout << "Warning: mlockall failed, memory is not locked" << std::endl;
+#endif
+
+    if (s.coupling == Solver::Coupling::jacobi)
+        std::cout << "Warning: coupling = jacobi runs OpenMP tasks, which may allocate in step()" << std::endl;
+
+    std::cout << "Real-time mode: " << time_steps + 1 << " steps, tick " << in.rt_period * 1e6
+        << " us, budget " << budget * 1e6 << " us" << std::endl;
+    std::cout << "Calibrated costs: outer " << s.outer_cost * 1e6 << " us, inner "
+        << s.inner_cost * 1e6 << " us" << std::endl;
+    heap::report(std::cout);
+
+    Histogram latency;                      // Duration of step()
+    Histogram jitter;                       // Start of step() after its tick
+
+    long long best_effort = 0;              // Steps stopped at the budget
+    long long overruns = 0;                 // Steps longer than the budget
+    long long late = 0;                     // Steps that ended after the next tick
+    long long outer = 0;
+    double worst_residual = 0.0;            // Largest momentum residual left by a best-effort step
+
+    const auto period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(in.rt_period));
+    const auto spin = std::min<clock::duration>(period / 4, std::chrono::microseconds(200));
+    auto tick = clock::now() + period;
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        // Sleep to just before the tick, then spin: the scheduler's wake-up
+        // latency would otherwise show up as start jitter
+        std::this_thread::sleep_until(tick - spin);
+        while (clock::now() < tick) {}
+
+        const auto start = clock::now();
+        s.step();
+        const auto end = clock::now();
+
+        const double step_time = std::chrono::duration<double>(end - start).count();
+
+        latency.add(step_time);
+        jitter.add(std::chrono::duration<double>(start - tick).count());
+
+        if (s.best_effort) {
+            ++best_effort;
+            worst_residual = std::max(worst_residual, s.momentum_residual);
+        }
+        if (step_time > budget) ++overruns;
+        if (end > tick + period) ++late;
+        outer += s.outer_v;
+
+        tick += period;
+    }
+
+    std::cout << "\nSteps: " << latency.count()
+        << ", best effort: " << best_effort
+        << ", over budget: " << overruns
+        << ", past next tick: " << late
+        << ", mean outer iterations: " << static_cast<double>(outer) / latency.count() << std::endl;
+    if (best_effort > 0)
+        std::cout << "Largest momentum residual left by a best-effort step: " << worst_residual << std::endl;
+
+    latency.print(std::cout, "Step latency");
+    jitter.print(std::cout, "Start jitter");
+
+    const std::filesystem::path outputDir = std::filesystem::path("output") / caseName;
+    std::filesystem::create_directories(outputDir);
+
+    std::ofstream csv(outputDir / "realtime.csv");
+    csv << "histogram,bin_low_s,bin_high_s,count\n";
+    latency.write_csv(csv, "latency");
+    jitter.write_csv(csv, "jitter");
+
+    std::cout << "\nHistograms written to " << (outputDir / "realtime.csv").string() << std::endl;
+
+    return 0;
+}
+
+}
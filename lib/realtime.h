@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <iosfwd>
+#include <string>
+
+#include "input.h"
+
+namespace realtime {
+
+    // Latency histogram with fixed log-spaced bins (4 per octave from 1 us
+    // to about 1 s), so recording a sample never allocates
+    class Histogram {
+    public:
+        static constexpr int bins = 81;
+
+        void add(double seconds);
+
+        long long count() const { return count_; }
+        double max() const { return max_; }
+
+        // Upper bin edge below which a fraction q of the samples lie [s]
+        double quantile(double q) const;
+
+        // Bin edges [s]: bin k holds [edge(k), edge(k + 1))
+        static double edge(int k);
+
+        void print(std::ostream& os, const std::string& title) const;
+        void write_csv(std::ostream& os, const std::string& name) const;
+
+    private:
+        std::array<long long, bins + 1> counts_{};   // Last bin: overflow
+        long long count_ = 0;
+        double max_ = 0.0;
+    };
+
+    // Hardware-in-the-loop mode: one time step per wall-clock tick of
+    // in.rt_period, each bounded by in.rt_budget through Solver::step_budget.
+    // The loop does no I/O, and no allocation with Gauss-Seidel coupling
+    // (Jacobi runs OpenMP tasks, whose descriptors the runtime may
+    // allocate; a warning is printed). Step latency and start jitter
+    // are reported as histograms at the end (stdout and
+    // output/<case>/realtime.csv), with the number of best-effort steps and
+    // deadline misses.
+    int run(const Input& in, const std::string& caseName);
+}
@@ -0,0 +1,810 @@
+#include "rz.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <omp.h>
+
+#include "tdma.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// SIMPLEC diagonal aP + sum(a_nb) of row c. The pressure corrector uses it in
+// place of aP: the neighbour velocity corrections it drops are of the order of
+// the radial viscous coefficients, which on a fine radial mesh are as large as
+// the inertia and make plain SIMPLE corrections overshoot.
+double simplec(const SolverRZ::System& s, int c) {
+
+    const double a = s.aP[c] + s.aW[c] + s.aE[c] + s.aS[c] + s.aN[c];
+    return a > 1e-3 * s.aP[c] ? a : s.aP[c];
+}
+}
+
+void SolverRZ::System::assign(int n) {
+
+    aW.assign(n, 0.0);
+    aE.assign(n, 0.0);
+    aS.assign(n, 0.0);
+    aN.assign(n, 0.0);
+    aP.assign(n, 1.0);
+    b.assign(n, 0.0);
+}
+
+SolverRZ::SolverRZ(const Input& in) {
+
+    // Page size and NUMA placement of the large arrays allocated below
+    heap::configure(heapSettings(in));
+
+    N = in.N;
+    Nr = in.Nr;
+    L = in.L;
+    R = in.R;
+    dz = L / N;
+    dr = R / Nr;
+
+    dt = in.dt_user;
+
+    tot_outer_v = in.piso_outer_iter;
+    tot_inner_v = in.piso_inner_iter;
+    outer_tol_v = in.piso_outer_tol;
+    inner_tol_v = in.piso_inner_tol;
+    rhie_chow_on_off_v = in.rhie_chow_on_off_v;
+    adi_sweeps = std::max(1, in.adi_sweeps);
+
+    mu = in.mu;
+    Rv = in.Rv;
+    k = in.k;
+    cp = in.cp;
+
+    // Geometry per radian
+    r.assign(Nr, 0.0);
+    vol.assign(Nr, 0.0);
+    A_z.assign(Nr, 0.0);
+    A_s.assign(Nr, 0.0);
+    A_n.assign(Nr, 0.0);
+
+    for (int j = 0; j < Nr; ++j) {
+
+        r[j] = (j + 0.5) * dr;
+        A_z[j] = r[j] * dr;
+        A_s[j] = j * dr * dz;
+        A_n[j] = (j + 1) * dr * dz;
+        vol[j] = A_z[j] * dz;
+    }
+
+    const int n = N * Nr;
+
+    u.assign(n, in.u_initial);
+    v.assign(n, 0.0);
+    p.assign(n, in.p_initial);
+    T.assign(n, in.T_initial);
+    rho.assign(n, in.rho_initial);
+
+    for (int c = 0; c < n; ++c) { rho[c] = std::max(1e-6, p[c] / (Rv * T[c])); }
+
+    u_old = u;
+    v_old = v;
+    p_old = p;
+    T_old = T;
+    rho_old = rho;
+
+    p_prime.assign(n, 0.0);
+    T_prev.assign(n, 0.0);
+    rho_new_.assign(n, 0.0);
+    x_sweep_.assign(n, 0.0);
+    u_f_.assign(n, 0.0);
+    v_f_.assign(n, 0.0);
+
+    S_m.assign(N, 0.0);
+    S_h.assign(N, 0.0);
+
+    // Source vectors definition, as in the 1D solver
+    for (int i = 0; i < N; ++i) {
+
+        const int zone = sourceZone(in, (i + 0.5) * dz);
+
+        if (zone != 0) {
+            S_m[i] = zone * in.S_m_cell;
+            S_h[i] = zone * in.S_h_cell;
+        }
+    }
+
+    u_inlet_value = in.u_inlet_value;
+    u_outlet_value = in.u_outlet_value;
+    u_inlet_bc = in.u_inlet_bc;
+    u_outlet_bc = in.u_outlet_bc;
+
+    T_inlet_value = in.T_inlet_value;
+    T_outlet_value = in.T_outlet_value;
+    T_inlet_bc = in.T_inlet_bc;
+    T_outlet_bc = in.T_outlet_bc;
+
+    p_inlet_value = in.p_inlet_value;
+    p_outlet_value = in.p_outlet_value;
+    p_inlet_bc = in.p_inlet_bc;
+    p_outlet_bc = in.p_outlet_bc;
+
+    T_wall_value = in.T_wall_value;
+    T_wall_bc = in.T_wall_bc;
+
+    U.assign(n);
+    V.assign(n);
+    P.assign(n);
+    H.assign(n);
+
+    // Momentum diagonals for the first Rhie-Chow interpolation
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 0; i < N; ++i) {
+            U.aP[idx(i, j)] = rho[idx(i, j)] * vol[j] / dt + 2 * mu * A_z[j] / dz;
+            V.aP[idx(i, j)] = U.aP[idx(i, j)];
+        }
+    }
+
+    parallel_v = n >= 1024;
+
+    // Line buffers of every thread, sized once
+    lines_z_.resize(omp_get_max_threads());
+    lines_r_.resize(omp_get_max_threads());
+
+    for (Line& l : lines_z_) {
+        for (auto* x : { &l.a, &l.b, &l.c, &l.d, &l.x }) x->assign(N, 0.0);
+        l.w.reserve(N, 1);
+    }
+    for (auto* x : { &block_.a, &block_.b, &block_.c, &block_.d, &block_.x }) x->assign(N, 0.0);
+    block_.w.reserve(N, 1);
+
+    for (Line& l : lines_r_) {
+        for (auto* x : { &l.a, &l.b, &l.c, &l.d, &l.x }) x->assign(Nr, 0.0);
+        l.w.reserve(Nr, 1);
+    }
+}
+
+double SolverRZ::face_u(int i, int j) const {
+
+    const int P_ = idx(i, j);
+    const int E_ = idx(i + 1, j);
+
+    // A Dirichlet end imposes its velocity on the adjacent face
+    if (i == 0 && !u_inlet_bc) return u[P_];
+    if (i == N - 2 && !u_outlet_bc) return u[E_];
+
+    const double u_f = 0.5 * (u[P_] + u[E_]);
+
+    if (!rhie_chow_on_off_v) return u_f;
+
+    const double p_W = axial(p, i - 1, j);
+    const double p_EE = axial(p, i + 2, j);
+
+    const double d = 0.5 * (vol[j] / U.aP[P_] + vol[j] / U.aP[E_]) / dz;   // [m2s/kg]
+
+    return u_f - d / 4.0 * (p_W - 3.0 * p[P_] + 3.0 * p[E_] - p_EE);      // [m/s]
+}
+
+double SolverRZ::face_v(int i, int j) const {
+
+    const int P_ = idx(i, j);
+    const int N_ = idx(i, j + 1);
+
+    const double v_f = 0.5 * (v[P_] + v[N_]);
+
+    if (!rhie_chow_on_off_v) return v_f;
+
+    // Symmetry at the axis, zero gradient at the wall
+    const double p_S = p[idx(i, std::max(j - 1, 0))];
+    const double p_NN = p[idx(i, std::min(j + 2, Nr - 1))];
+
+    const double d = 0.5 * (vol[j] / V.aP[P_] + vol[j + 1] / V.aP[N_]) / dr;   // [m2s/kg]
+
+    return v_f - d / 4.0 * (p_S - 3.0 * p[P_] + 3.0 * p[N_] - p_NN);          // [m/s]
+}
+
+void SolverRZ::faces() {
+
+    #pragma omp parallel for if (parallel_v)
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 0; i < N - 1; ++i) u_f_[idx(i, j)] = face_u(i, j);
+        if (j < Nr - 1)
+            for (int i = 0; i < N; ++i) v_f_[idx(i, j)] = face_v(i, j);
+    }
+}
+
+double SolverRZ::axial(const heap::vector<double>& x, int i, int j) const {
+
+    const int first = u_inlet_bc ? 0 : 1;
+    const int last = u_outlet_bc ? N - 1 : N - 2;
+
+    return x[idx(std::clamp(i, first, last), j)];
+}
+
+void SolverRZ::adi(const System& s, heap::vector<double>& x) {
+
+    for (int sweep = 0; sweep < adi_sweeps; ++sweep) {
+
+        // Block correction: a correction uniform over every cross-section,
+        // from the radial sums of the equations. Removes the long axial error
+        // modes, which line relaxation damps slowly when the radial coupling
+        // dominates (it does for the pressure correction on slender domains).
+        Line& blk = block_;
+
+        #pragma omp parallel for if (parallel_v)
+        for (int i = 0; i < N; ++i) {
+
+            double aW = 0.0, aE = 0.0, aP = 0.0, res = 0.0;
+
+            for (int j = 0; j < Nr; ++j) {
+
+                const int c = idx(i, j);
+
+                double Ax = s.aP[c] * x[c];
+                if (i > 0) Ax += s.aW[c] * x[c - 1];
+                if (i < N - 1) Ax += s.aE[c] * x[c + 1];
+                if (j > 0) { Ax += s.aS[c] * x[c - N]; aP += s.aS[c]; }
+                if (j < Nr - 1) { Ax += s.aN[c] * x[c + N]; aP += s.aN[c]; }
+
+                aW += s.aW[c];
+                aE += s.aE[c];
+                aP += s.aP[c];
+                res += s.b[c] - Ax;
+            }
+
+            blk.a[i] = aW;
+            blk.b[i] = aP;
+            blk.c[i] = aE;
+            blk.d[i] = res;
+        }
+
+        tdma::solve(blk.a, blk.b, blk.c, blk.d, blk.x, blk.w);
+
+        #pragma omp parallel for if (parallel_v)
+        for (int j = 0; j < Nr; ++j)
+            for (int i = 0; i < N; ++i)
+                x[idx(i, j)] += blk.x[i];
+
+        // Axial lines, radial neighbours from the start of the sweep
+        x_sweep_ = x;
+
+        #pragma omp parallel for if (parallel_v)
+        for (int j = 0; j < Nr; ++j) {
+
+            Line& l = lines_z_[omp_get_thread_num()];
+
+            for (int i = 0; i < N; ++i) {
+
+                const int c = idx(i, j);
+
+                l.a[i] = s.aW[c];
+                l.b[i] = s.aP[c];
+                l.c[i] = s.aE[c];
+                l.d[i] = s.b[c]
+                    - (j > 0 ? s.aS[c] * x_sweep_[c - N] : 0.0)
+                    - (j < Nr - 1 ? s.aN[c] * x_sweep_[c + N] : 0.0);
+            }
+
+            tdma::solve(l.a, l.b, l.c, l.d, l.x, l.w);
+
+            for (int i = 0; i < N; ++i) x[idx(i, j)] = l.x[i];
+        }
+
+        // Radial lines, axial neighbours from the axial sweep
+        x_sweep_ = x;
+
+        #pragma omp parallel for if (parallel_v)
+        for (int i = 0; i < N; ++i) {
+
+            Line& l = lines_r_[omp_get_thread_num()];
+
+            for (int j = 0; j < Nr; ++j) {
+
+                const int c = idx(i, j);
+
+                l.a[j] = s.aS[c];
+                l.b[j] = s.aP[c];
+                l.c[j] = s.aN[c];
+                l.d[j] = s.b[c]
+                    - (i > 0 ? s.aW[c] * x_sweep_[c - 1] : 0.0)
+                    - (i < N - 1 ? s.aE[c] * x_sweep_[c + 1] : 0.0);
+            }
+
+            tdma::solve(l.a, l.b, l.c, l.d, l.x, l.w);
+
+            for (int j = 0; j < Nr; ++j) x[idx(i, j)] = l.x[j];
+        }
+    }
+}
+
+void SolverRZ::step() {
+
+    outer_v = 0;
+
+    momentum_residual = 1.0;
+    temperature_residual = 1.0;
+
+    // -------------------------------------------------------
+    // DENSITY PREDICTOR
+    // -------------------------------------------------------
+
+    rho_new_ = rho;
+    faces();
+
+    #pragma omp parallel for if (parallel_v)
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 1; i < N - 1; ++i) {
+
+            const int c = idx(i, j);
+
+            const double u_w = u_f_[c - 1];
+            const double u_e = u_f_[c];
+
+            double net =
+                A_z[j] * ((u_e >= 0.0 ? rho[c] : rho[c + 1]) * u_e
+                    - (u_w >= 0.0 ? rho[c - 1] : rho[c]) * u_w);   // [kg/s]
+
+            if (j < Nr - 1) {
+                const double v_n = v_f_[c];
+                net += A_n[j] * (v_n >= 0.0 ? rho[c] : rho[c + N]) * v_n;
+            }
+            if (j > 0) {
+                const double v_s = v_f_[c - N];
+                net -= A_s[j] * (v_s >= 0.0 ? rho[c - N] : rho[c]) * v_s;
+            }
+
+            rho_new_[c] = rho_old[c] - dt / vol[j] * net + dt * S_m[i];
+        }
+    }
+
+    rho = rho_new_;
+
+    while (outer_v < tot_outer_v && (momentum_residual > outer_tol_v || temperature_residual > outer_tol_v * 100)) {
+
+        momentum();
+        energy();
+
+        inner_v = 0;
+        continuity_residual = 1.0;
+
+        while (inner_v < tot_inner_v && continuity_residual > inner_tol_v) {
+
+            pressure_correction();
+            inner_v++;
+        }
+
+        // -------------------------------------------------------
+        // MOMENTUM RESIDUAL CALCULATION
+        // -------------------------------------------------------
+
+        momentum_residual = 0.0;
+
+        #pragma omp parallel for if (parallel_v) reduction(max:momentum_residual)
+        for (int j = 0; j < Nr; ++j) {
+            for (int i = 1; i < N - 1; ++i) {
+
+                const int c = idx(i, j);
+
+                const double res = U.aW[c] * u[c - 1] + U.aE[c] * u[c + 1] + U.aP[c] * u[c]
+                    + (j > 0 ? U.aS[c] * u[c - N] : 0.0)
+                    + (j < Nr - 1 ? U.aN[c] * u[c + N] : 0.0)
+                    - U.b[c];
+
+                momentum_residual = std::max(momentum_residual, std::fabs(res) / A_z[j]);
+            }
+        }
+
+        outer_v++;
+    }
+
+    // Saving old variables
+    u_old = u;
+    v_old = v;
+    p_old = p;
+    rho_old = rho;
+    T_old = T;
+
+    time_total += dt;
+}
+
+void SolverRZ::momentum() {
+
+    // ===========================================================
+    // MOMENTUM PREDICTOR (axial and radial)
+    // ===========================================================
+
+    faces();
+
+    #pragma omp parallel for if (parallel_v)
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 1; i < N - 1; ++i) {
+
+            const int c = idx(i, j);
+
+            // Outward mass fluxes through the four faces [kg/s]
+            const double u_w = u_f_[c - 1];
+            const double u_e = u_f_[c];
+
+            const double F_w = -A_z[j] * (u_w >= 0.0 ? rho[c - 1] : rho[c]) * u_w;
+            const double F_e = A_z[j] * (u_e >= 0.0 ? rho[c] : rho[c + 1]) * u_e;
+
+            double F_s = 0.0, F_n = 0.0;
+
+            if (j > 0) {
+                const double v_s = v_f_[c - N];
+                F_s = -A_s[j] * (v_s >= 0.0 ? rho[c - N] : rho[c]) * v_s;
+            }
+            if (j < Nr - 1) {
+                const double v_n = v_f_[c];
+                F_n = A_n[j] * (v_n >= 0.0 ? rho[c] : rho[c + N]) * v_n;
+            }
+
+            const double conv_P =
+                std::max(F_w, 0.0) + std::max(F_e, 0.0)
+                + std::max(F_s, 0.0) + std::max(F_n, 0.0);     // [kg/s]
+
+            const double inertia = rho[c] * vol[j] / dt;        // [kg/s]
+
+            // Mass imbalance of the current iterate, taken out of the diagonal:
+            // zero at convergence, but it keeps the iterates bounded while the
+            // face fluxes do not yet satisfy continuity. The source term S_m is
+            // left in, so that a source adds mass at the local velocity.
+            const double imbalance =
+                F_w + F_e + F_s + F_n
+                + (rho[c] - rho_old[c]) * vol[j] / dt;         // [kg/s]
+
+            // Axial velocity: normal stress axially, shear radially, no slip at the wall
+            const double Dz_u = (4.0 / 3.0) * mu * A_z[j] / dz;
+            const double Ds_u = mu * A_s[j] / dr;
+            const double Dn_u = j < Nr - 1 ? mu * A_n[j] / dr : 0.0;
+            const double Dwall_u = j == Nr - 1 ? mu * A_n[j] / (0.5 * dr) : 0.0;
+
+            U.aW[c] = -std::max(-F_w, 0.0) - Dz_u;
+            U.aE[c] = -std::max(-F_e, 0.0) - Dz_u;
+            U.aS[c] = -std::max(-F_s, 0.0) - Ds_u;
+            U.aN[c] = -std::max(-F_n, 0.0) - Dn_u;
+            U.aP[c] = conv_P + inertia - imbalance + 2 * Dz_u + Ds_u + Dn_u + Dwall_u;
+            U.b[c] =
+                -0.5 * (axial(p, i + 1, j) - axial(p, i - 1, j)) * A_z[j]
+                + rho_old[c] * u_old[c] * vol[j] / dt;
+
+            // Radial velocity: normal stress radially, hoop stress, zero at the wall
+            const double Dz_v = mu * A_z[j] / dz;
+            const double Ds_v = (4.0 / 3.0) * mu * A_s[j] / dr;
+            const double Dn_v = j < Nr - 1 ? (4.0 / 3.0) * mu * A_n[j] / dr : 0.0;
+            const double Dwall_v = j == Nr - 1 ? (4.0 / 3.0) * mu * A_n[j] / (0.5 * dr) : 0.0;
+            const double hoop = (4.0 / 3.0) * mu * vol[j] / (r[j] * r[j]);
+
+            const double p_S = j > 0 ? p[c - N] : p[c];
+            const double p_N = j < Nr - 1 ? p[c + N] : p[c];
+
+            V.aW[c] = -std::max(-F_w, 0.0) - Dz_v;
+            V.aE[c] = -std::max(-F_e, 0.0) - Dz_v;
+            V.aS[c] = -std::max(-F_s, 0.0) - Ds_v;
+            V.aN[c] = -std::max(-F_n, 0.0) - Dn_v;
+            V.aP[c] = conv_P + inertia - imbalance + 2 * Dz_v + Ds_v + Dn_v + Dwall_v + hoop;
+            V.b[c] =
+                -0.5 * (p_N - p_S) * vol[j] / dr
+                + rho_old[c] * v_old[c] * vol[j] / dt;
+        }
+    }
+
+    // BCs on the first and last axial cell of every ring, as in the 1D solver
+    for (int j = 0; j < Nr; ++j) {
+
+        const double D = (4.0 / 3.0) * mu * A_z[j] / dz;
+
+        const int f = idx(0, j);
+        const int l = idx(N - 1, j);
+
+        const double u_r_face_first = 0.5 * u[f + 1];
+        const double F_r_first = (u_r_face_first >= 0 ? rho[f] : rho[f + 1]) * u_r_face_first * A_z[j];
+
+        const double u_l_face_last = 0.5 * u[l - 1];
+        const double F_l_last = (u_l_face_last >= 0 ? rho[l - 1] : rho[l]) * u_l_face_last * A_z[j];
+
+        const double diag_first = rho[f] * vol[j] / dt + 2 * D + F_r_first;
+        const double diag_last = rho[l] * vol[j] / dt + 2 * D - F_l_last;
+
+        U.aP[f] = diag_first;
+        U.aE[f] = u_inlet_bc ? -diag_first : 0.0;
+        U.b[f] = u_inlet_bc ? 0.0 : diag_first * u_inlet_value;
+
+        U.aP[l] = diag_last;
+        U.aW[l] = u_outlet_bc ? -diag_last : 0.0;
+        U.b[l] = u_outlet_bc ? 0.0 : diag_last * u_outlet_value;
+
+        // No radial velocity through the end planes
+        V.aP[f] = diag_first;
+        V.b[f] = 0.0;
+        V.aP[l] = diag_last;
+        V.b[l] = 0.0;
+    }
+
+    adi(U, u);
+    adi(V, v);
+}
+
+void SolverRZ::energy() {
+
+    // ===============================================================
+    // TEMPERATURE SOLVER
+    // ===============================================================
+
+    faces();
+
+    #pragma omp parallel for if (parallel_v)
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 1; i < N - 1; ++i) {
+
+            const int c = idx(i, j);
+
+            // Outward enthalpy fluxes per kelvin [W/K]
+            const double u_w = u_f_[c - 1];
+            const double u_e = u_f_[c];
+
+            const double C_w = -cp * A_z[j] * (u_w >= 0.0 ? rho[c - 1] : rho[c]) * u_w;
+            const double C_e = cp * A_z[j] * (u_e >= 0.0 ? rho[c] : rho[c + 1]) * u_e;
+
+            double C_s = 0.0, C_n = 0.0;
+
+            if (j > 0) {
+                const double v_s = v_f_[c - N];
+                C_s = -cp * A_s[j] * (v_s >= 0.0 ? rho[c - N] : rho[c]) * v_s;
+            }
+            if (j < Nr - 1) {
+                const double v_n = v_f_[c];
+                C_n = cp * A_n[j] * (v_n >= 0.0 ? rho[c] : rho[c + N]) * v_n;
+            }
+
+            // Enthalpy carried by the mass imbalance, as in the momentum
+            // predictor: a source adds mass at the local temperature
+            const double imbalance =
+                C_w + C_e + C_s + C_n
+                + cp * (rho[c] - rho_old[c]) * vol[j] / dt;    // [W/K]
+
+            const double Dz = k * A_z[j] / dz;
+            const double Ds = k * A_s[j] / dr;
+            const double Dn = j < Nr - 1 ? k * A_n[j] / dr : 0.0;
+            const double Dwall = (j == Nr - 1 && !T_wall_bc) ? k * A_n[j] / (0.5 * dr) : 0.0;
+
+            const double p_S = j > 0 ? p[c - N] : p[c];
+            const double p_N = j < Nr - 1 ? p[c + N] : p[c];
+
+            const double dp_dt = (p[c] - p_old[c]) / dt * vol[j];
+            const double work =
+                u[c] * 0.5 * (axial(p, i + 1, j) - axial(p, i - 1, j)) * A_z[j]
+                + v[c] * 0.5 * (p_N - p_S) * vol[j] / dr;
+
+            // Mirror the velocity through the wall so that it vanishes there
+            const double u_S = j > 0 ? u[c - N] : u[c];
+            const double u_N = j < Nr - 1 ? u[c + N] : -u[c];
+            const double du_dz = (u[c + 1] - u[c - 1]) / (2 * dz);
+            const double du_dr = (u_N - u_S) / (2 * dr);
+
+            const double viscous_dissipation =
+                mu * ((4.0 / 3.0) * du_dz * du_dz + du_dr * du_dr) * vol[j];
+
+            H.aW[c] = -std::max(-C_w, 0.0) - Dz;
+            H.aE[c] = -std::max(-C_e, 0.0) - Dz;
+            H.aS[c] = -std::max(-C_s, 0.0) - Ds;
+            H.aN[c] = -std::max(-C_n, 0.0) - Dn;
+            H.aP[c] =
+                std::max(C_w, 0.0) + std::max(C_e, 0.0)
+                + std::max(C_s, 0.0) + std::max(C_n, 0.0)
+                + 2 * Dz + Ds + Dn + Dwall
+                + rho[c] * cp * vol[j] / dt
+                - imbalance;                    /// [W/K]
+            H.b[c] =
+                rho_old[c] * cp * vol[j] / dt * T_old[c]
+                + dp_dt
+                + work
+                + viscous_dissipation
+                + Dwall * T_wall_value
+                + S_h[i] * vol[j];              /// [W]
+        }
+    }
+
+    // BCs on temperature
+    for (int j = 0; j < Nr; ++j) {
+
+        const int f = idx(0, j);
+        const int l = idx(N - 1, j);
+
+        H.aP[f] = 1.0;
+        H.aE[f] = T_inlet_bc ? -1.0 : 0.0;
+        H.b[f] = T_inlet_bc ? 0.0 : T_inlet_value;
+
+        H.aP[l] = 1.0;
+        H.aW[l] = T_outlet_bc ? -1.0 : 0.0;
+        H.b[l] = T_outlet_bc ? 0.0 : T_outlet_value;
+    }
+
+    T_prev = T;
+    adi(H, T);
+
+    temperature_residual = 0.0;
+
+    for (std::size_t c = 0; c < T.size(); ++c)
+        temperature_residual = std::max(temperature_residual, std::fabs(T[c] - T_prev[c]));
+
+    // Density back on the equation of state with the new temperature; the
+    // correctors then keep it there (rho += psi p'). Without this the density
+    // of a heated or cooled cell only follows its pressure and drifts.
+    for (std::size_t c = 0; c < rho.size(); ++c)
+        rho[c] = std::max(1e-6, p[c] / (Rv * T[c]));
+}
+
+void SolverRZ::pressure_correction() {
+
+    // -------------------------------------------------------
+    // CONTINUITY SATISFACTOR: assemble pressure correction
+    // -------------------------------------------------------
+
+    faces();
+
+    #pragma omp parallel for if (parallel_v)
+    for (int j = 0; j < Nr; ++j) {
+        for (int i = 1; i < N - 1; ++i) {
+
+            const int c = idx(i, j);
+
+            const double psi = 1.0 / (Rv * T[c]);      // [s2/m2]
+
+            double a_P = psi * vol[j] / dt;             // [m s]
+            double imbalance = (rho[c] - rho_old[c]) * vol[j] / dt;     // [kg/s]
+
+            // One face: outward velocity, area, distance, neighbour cell and
+            // the momentum diagonals behind its Rhie-Chow velocity
+            auto face = [&](double u_out, double A, double delta, int nb, double d_nb, double d_P,
+                double& a_nb) {
+
+                const bool out = u_out >= 0.0;
+
+                const double psi_up = out ? psi : 1.0 / (Rv * T[nb]);
+                const double C = psi_up * u_out * A;                                    // [m s]
+                const double E = 0.5 * (rho[c] * d_P + rho[nb] * d_nb) * A / delta;     // [m s]
+
+                a_nb = -E - std::max(-C, 0.0);
+                a_P += E + std::max(C, 0.0);
+                imbalance += (out ? rho[c] : rho[nb]) * u_out * A;
+            };
+
+            // The flux through a face with an imposed velocity does not respond to p'
+            const double open_w = (i == 1 && !u_inlet_bc) ? 0.0 : 1.0;
+            const double open_e = (i == N - 2 && !u_outlet_bc) ? 0.0 : 1.0;
+
+            face(-u_f_[c - 1], A_z[j], dz, c - 1,
+                open_w * vol[j] / simplec(U, c - 1), open_w * vol[j] / simplec(U, c), P.aW[c]);
+            face(u_f_[c], A_z[j], dz, c + 1,
+                open_e * vol[j] / simplec(U, c + 1), open_e * vol[j] / simplec(U, c), P.aE[c]);
+
+            P.aS[c] = 0.0;
+            P.aN[c] = 0.0;
+
+            if (j > 0)
+                face(-v_f_[c - N], A_s[j], dr, c - N, vol[j - 1] / simplec(V, c - N), vol[j] / simplec(V, c), P.aS[c]);
+            if (j < Nr - 1)
+                face(v_f_[c], A_n[j], dr, c + N, vol[j + 1] / simplec(V, c + N), vol[j] / simplec(V, c), P.aN[c]);
+
+            P.aP[c] = a_P;
+            P.b[c] = S_m[i] * vol[j] - imbalance;   /// [kg/s]
+        }
+    }
+
+    // BCs on p_prime
+    for (int j = 0; j < Nr; ++j) {
+
+        const int f = idx(0, j);
+        const int l = idx(N - 1, j);
+
+        P.aP[f] = 1.0;
+        P.aE[f] = p_inlet_bc ? -1.0 : 0.0;
+        P.b[f] = 0.0;
+
+        P.aP[l] = 1.0;
+        P.aW[l] = p_outlet_bc ? -1.0 : 0.0;
+        P.b[l] = 0.0;
+    }
+
+    std::fill(p_prime.begin(), p_prime.end(), 0.0);
+    adi(P, p_prime);
+
+    // -------------------------------------------------------
+    // PRESSURE, VELOCITY AND DENSITY CORRECTORS
+    // -------------------------------------------------------
+
+    #pragma omp parallel for if (parallel_v)
+    for (int j = 0; j < Nr; ++j) {
+
+        for (int i = 1; i < N - 1; ++i) {
+
+            const int c = idx(i, j);
+
+            const double pp_S = j > 0 ? p_prime[c - N] : p_prime[c];
+            const double pp_N = j < Nr - 1 ? p_prime[c + N] : p_prime[c];
+
+            u[c] -= vol[j] / simplec(U, c) * (axial(p_prime, i + 1, j) - axial(p_prime, i - 1, j)) / (2.0 * dz);
+            v[c] -= vol[j] / simplec(V, c) * (pp_N - pp_S) / (2.0 * dr);
+        }
+
+        for (int i = 0; i < N; ++i) {
+
+            const int c = idx(i, j);
+
+            p[c] += p_prime[c];
+            rho[c] += p_prime[c] / (Rv * T[c]);
+        }
+
+        // BCs on pressure
+        const int f = idx(0, j);
+        const int l = idx(N - 1, j);
+
+        p[f] = p_inlet_bc ? p[f + 1] : p_inlet_value;
+        p[l] = p_outlet_bc ? p[l - 1] : p_outlet_value;
+    }
+
+    // -------------------------------------------------------
+    // CONTINUITY RESIDUAL CALCULATION
+    // -------------------------------------------------------
+
+    continuity_residual = 0.0;
+
+    #pragma omp parallel for if (parallel_v) reduction(max:continuity_residual)
+    for (int j = 0; j < Nr; ++j)
+        for (int i = 1; i < N - 1; ++i)
+            continuity_residual = std::max(continuity_residual, std::fabs(P.b[idx(i, j)]) / A_z[j]);
+}
+
+namespace rz {
+
+int run(const Input& in, const std::string& caseName) {
+
+    SolverRZ s(in);
+
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);    // Number of time steps [-]
+    const int print_every = std::max(1, time_steps / std::max(1, in.number_output));
+
+    std::cout << "Axisymmetric r-z mode: " << s.N << " x " << s.Nr << " cells, R = " << s.R << " m"
+        << ", ADI sweeps: " << s.adi_sweeps << ", threads: " << omp_get_max_threads() << std::endl;
+    heap::report(std::cout);
+
+    const fs::path outputDir = fs::path("output") / caseName;
+    fs::create_directories(outputDir);
+
+    std::ofstream u_out(outputDir / in.velocity_file);                 // Axial velocity output file
+    std::ofstream v_out(outputDir / "radial_velocity.dat");            // Radial velocity output file
+    std::ofstream p_out(outputDir / in.pressure_file);                 // Pressure output file
+    std::ofstream T_out(outputDir / in.temperature_file);              // Temperature output file
+    std::ofstream rho_out(outputDir / in.density_file);                // Density output file
+
+    double start = omp_get_wtime();
+
+    // Time-stepping loop
+    for (int n = 0; n <= time_steps; ++n) {
+
+        s.step();
+
+        if (n % print_every == 0) {
+            for (std::size_t c = 0; c < s.u.size(); ++c) {
+
+                u_out << s.u[c] << ", ";
+                v_out << s.v[c] << ", ";
+                p_out << s.p[c] << ", ";
+                T_out << s.T[c] << ", ";
+                rho_out << s.rho[c] << ", ";
+            }
+
+            for (std::ofstream* f : { &u_out, &v_out, &p_out, &T_out, &rho_out }) {
+                *f << "\n";
+                f->flush();
+            }
+        }
+    }
+
+    double end = omp_get_wtime();
+    printf("Execution time: %.6f s\n", end - start);
+
+    return 0;
+}
+}
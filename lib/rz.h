@@ -0,0 +1,153 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "heap.h"
+#include "input.h"
+#include "tdma.h"
+
+// =======================================================================
+//                          AXISYMMETRIC SOLVER
+// =======================================================================
+
+// r-z extension of the PISO solver: N axial x Nr radial cells on a cylinder
+// of length L and radius R, collocated u (axial), v (radial), p, T, rho.
+// Same discretization and boundary conventions as the 1D Solver: upwind
+// convection, central diffusion, Rhie-Chow face velocities, compressible
+// pressure correction, BC rows at the first and last axial cell. The axis
+// is a symmetry line; the wall (r = R) is no-slip, adiabatic or at
+// T_wall_value. Sources S_m, S_h are per axial position, uniform in r.
+//
+// Every 2D system is relaxed by adi_sweeps alternating-direction sweeps:
+// all axial lines (one Thomas solve per radial index), then all radial
+// lines. The off-line neighbours are taken from the iterate at the start of
+// the sweep, so the lines of a sweep are independent: they are solved in
+// parallel, each thread with its own line buffers, and the result does not
+// depend on the number of threads.
+//
+// Fields are stored axial-contiguous: cell (i, j) is at j * N + i.
+struct SolverRZ {
+
+    explicit SolverRZ(const Input& in);
+
+    // Advances the solution by one time step of size dt
+    void step();
+
+    int idx(int i, int j) const { return j * N + i; }
+
+    int    N = 0;                                   // Axial cells [-]
+    int    Nr = 0;                                  // Radial cells [-]
+    double L = 0.0;                                 // Length of the domain [m]
+    double R = 0.0;                                 // Radius of the domain [m]
+    double dz = 0.0;                                // Axial cell size [m]
+    double dr = 0.0;                                // Radial cell size [m]
+
+    double dt = 0.0;                                // Time step [s]
+    double time_total = 0.0;                        // Simulated time [s]
+
+    int    tot_outer_v = 0;                         // PISO outer iterations [-]
+    int    tot_inner_v = 0;                         // PISO inner iterations [-]
+    double outer_tol_v = 0.0;                       // PISO outer tolerance [-]
+    double inner_tol_v = 0.0;                       // PISO inner tolerance [-]
+    bool   rhie_chow_on_off_v = true;               // Rhie-Chow interpolation on/off (1/0) [-]
+    int    adi_sweeps = 2;                          // ADI sweep pairs per linear system [-]
+
+    double mu = 0.0;                                // Dynamic viscosity [kg/(m s)]
+    double Rv = 0.0;                                // Specific gas constant [J/(kg K)]
+    double k = 0.0;                                 // Thermal conductivity [W/(m K)]
+    double cp = 0.0;                                // Specific heat capacity [J/(kg K)]
+
+    // Geometry per radian, per radial index
+    heap::vector<double> r;                         // Cell centre radius [m]
+    heap::vector<double> vol;                       // Cell volume [m3]
+    heap::vector<double> A_z;                       // Axial face area [m2]
+    heap::vector<double> A_s;                       // Inner radial face area [m2]
+    heap::vector<double> A_n;                       // Outer radial face area [m2]
+
+    heap::vector<double> u, v, p, T, rho;           // Fields [m/s], [m/s], [Pa], [K], [kg/m3]
+    heap::vector<double> u_old, v_old, p_old, T_old, rho_old;
+    heap::vector<double> p_prime, T_prev;
+
+    heap::vector<double> S_m;                       // Volumetric mass source per axial cell [kg/(m3 s)]
+    heap::vector<double> S_h;                       // Volumetric heat source per axial cell [W/m3]
+
+    // Axial BCs as in the 1D solver, uniform over the radius (Dirichlet: 0, Neumann: 1)
+    double u_inlet_value = 0.0;                     // Inlet axial velocity [m/s]
+    double u_outlet_value = 0.0;                    // Outlet axial velocity [m/s]
+    bool   u_inlet_bc = false;                      // Inlet velocity BC type [-]
+    bool   u_outlet_bc = false;                     // Outlet velocity BC type [-]
+
+    double T_inlet_value = 0.0;                     // Inlet temperature [K]
+    double T_outlet_value = 0.0;                    // Outlet temperature [K]
+    bool   T_inlet_bc = false;                      // Inlet temperature BC type [-]
+    bool   T_outlet_bc = false;                     // Outlet temperature BC type [-]
+
+    double p_inlet_value = 0.0;                     // Inlet pressure [Pa]
+    double p_outlet_value = 0.0;                    // Outlet pressure [Pa]
+    bool   p_inlet_bc = false;                      // Inlet pressure BC type [-]
+    bool   p_outlet_bc = false;                     // Outlet pressure BC type [-]
+
+    double T_wall_value = 0.0;                      // Wall temperature [K]
+    bool   T_wall_bc = true;                        // Wall temperature BC type, Neumann is adiabatic [-]
+
+    // Five-point system: aW x_W + aE x_E + aS x_S + aN x_N + aP x_P = b
+    struct System {
+        heap::vector<double> aW, aE, aS, aN, aP, b;
+        void assign(int n);
+    };
+
+    System U, V, P, H;                              // u, v, p' and T systems
+
+    // Convergence metrics of the last step
+    double continuity_residual = 1.0;
+    double momentum_residual = 1.0;
+    double temperature_residual = 1.0;
+    int outer_v = 0;
+    int inner_v = 0;
+
+private:
+    // Line buffers of one thread
+    struct Line {
+        heap::vector<double> a, b, c, d, x;
+        tdma::Workspace w;
+    };
+
+    std::vector<Line> lines_z_;                     // Axial line buffers, one per thread
+    std::vector<Line> lines_r_;                     // Radial line buffers, one per thread
+    Line block_;                                    // Cross-section block correction system
+    heap::vector<double> x_sweep_;                  // Iterate at the start of a sweep
+    heap::vector<double> rho_new_;                  // Density predictor [kg/m3]
+    bool parallel_v = false;                        // Worksharing only pays off on large meshes [-]
+
+    void momentum();
+    void energy();
+    void pressure_correction();
+    void adi(const System& s, heap::vector<double>& x);
+
+    // Axial and radial face velocities between (i, j) and its east / north
+    // neighbour, with Rhie-Chow corrections
+    double face_u(int i, int j) const;
+    double face_v(int i, int j) const;
+
+    // Fills u_f_ and v_f_ from the current fields and momentum diagonals.
+    // The assembly loops read only these, so that a loop writing the
+    // diagonals of one ring never races with a neighbour ring reading them.
+    void faces();
+
+    // x at axial index i of ring j. Behind an end with an imposed velocity
+    // the face is closed and the BC cell does not take part: the value of
+    // the last interior cell is used instead (zero gradient at the face).
+    double axial(const heap::vector<double>& x, int i, int j) const;
+
+    heap::vector<double> u_f_;                      // Velocity of the east face of every cell [m/s]
+    heap::vector<double> v_f_;                      // Velocity of the north face of every cell [m/s]
+};
+
+namespace rz {
+
+    // Time loop of an r-z case (Nr > 1): writes u, v, p, T, rho to
+    // output/<case>/ like the 1D driver, one line per output time with the
+    // N * Nr cell values, radial ring by radial ring
+    int run(const Input& in, const std::string& caseName);
+}
@@ -0,0 +1,185 @@
+#include "schedule.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace schedule {
+
+namespace {
+
+constexpr double reached = 1e-9;        // Breakpoints this close to t, in steps, count as reached [-]
+
+}
+
+Target target(const Input& in, const Solver& s, const std::string& name) {
+
+    Target p;
+    p.name = name;
+
+    if (name == "S_m_cell" || name == "S_h_cell") {
+
+        p.key = name == "S_m_cell" ? &Input::S_m_cell : &Input::S_h_cell;
+        p.source = name == "S_m_cell" ? &Solver::S_m : &Solver::S_h;
+
+        // The zones of Solver::reset
+        p.zone.assign(s.N, 0.0);
+        for (int i = 0; i < s.N; ++i)
+            p.zone[i] = sourceZone(in, (i + 0.5) * s.dz);
+        return p;
+    }
+
+    const std::pair<const char*, std::pair<double Input::*, double Solver::*>> boundaries[] = {
+        { "u_inlet_value", { &Input::u_inlet_value, &Solver::u_inlet_value } },
+        { "u_outlet_value", { &Input::u_outlet_value, &Solver::u_outlet_value } },
+        { "T_inlet_value", { &Input::T_inlet_value, &Solver::T_inlet_value } },
+        { "T_outlet_value", { &Input::T_outlet_value, &Solver::T_outlet_value } },
+        { "p_inlet_value", { &Input::p_inlet_value, &Solver::p_inlet_value } },
+        { "p_outlet_value", { &Input::p_outlet_value, &Solver::p_outlet_value } },
+    };
+
+    for (const auto& b : boundaries)
+        if (name == b.first) {
+            p.key = b.second.first;
+            p.boundary = b.second.second;
+            return p;
+        }
+
+    throw std::runtime_error("Not a source or boundary value (S_m_cell, S_h_cell, u/T/p_inlet/outlet_value): " + name);
+}
+
+void set(const Target& p, Solver& s, double value) {
+
+    if (p.boundary) {
+        s.*p.boundary = value;
+        return;
+    }
+
+    heap::vector<double>& source = s.*p.source;
+    for (int i = 0; i < s.N; ++i) source[i] = p.zone[i] * value;
+}
+
+Table::Table(const std::string& file, const Input& in, const Solver& s) {
+
+    std::ifstream table(file);
+    if (!table)
+        throw std::runtime_error("Cannot open schedule_file: " + file);
+
+    std::string line;
+    while (std::getline(table, line)) {
+
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line = line.substr(0, comment);
+
+        std::replace(line.begin(), line.end(), ',', ' ');
+
+        std::istringstream row(line);
+        std::vector<std::string> cells;
+        for (std::string cell; row >> cell; ) cells.push_back(cell);
+
+        if (cells.empty())
+            continue;
+
+        // Header: the time column, then one column per target
+        if (columns_.empty()) {
+
+            if (cells.size() < 2)
+                throw std::runtime_error("schedule_file header needs the time and at least one value column: " + file);
+
+            for (std::size_t k = 1; k < cells.size(); ++k) {
+
+                Column c;
+                const auto colon = cells[k].find(':');
+                if (colon != std::string::npos) {
+                    if (cells[k].substr(colon + 1) != "step")
+                        throw std::runtime_error("schedule_file column suffix must be :step, got: " + cells[k]);
+                    c.step = true;
+                }
+                c.target = target(in, s, cells[k].substr(0, colon));
+                columns_.push_back(std::move(c));
+            }
+            continue;
+        }
+
+        if (cells.size() != columns_.size() + 1)
+            throw std::runtime_error("schedule_file row with " + std::to_string(cells.size())
+                + " values, expected " + std::to_string(columns_.size() + 1) + ": " + file);
+
+        const double t = std::stod(cells[0]);
+        if (!time_.empty() && t <= time_.back())
+            throw std::runtime_error("schedule_file times must increase: " + file);
+
+        time_.push_back(t);
+        for (std::size_t k = 0; k < columns_.size(); ++k)
+            columns_[k].values.push_back(std::stod(cells[k + 1]));
+    }
+
+    if (time_.empty())
+        throw std::runtime_error("schedule_file has no rows: " + file);
+}
+
+double Table::step(double t, double dt_max, double t_end) const {
+
+    const double eps = reached * dt_max;
+
+    double next = t_end;
+    auto b = std::upper_bound(time_.begin(), time_.end(), t + eps);
+    if (b != time_.end() && *b < next) next = *b;
+
+    const double gap = next - t;
+    if (gap <= eps) return dt_max;
+
+    return gap / std::max(1.0, std::ceil(gap / dt_max - reached));
+}
+
+int Table::steps(double t0, double dt_max, double t_end) const {
+
+    int n = 0;
+    for (double t = t0; t < t_end - reached * dt_max; ++n)
+        t += step(t, dt_max, t_end);
+    return n;
+}
+
+double Table::value(const Column& c, double t) const {
+
+    if (t <= time_.front()) return c.values.front();
+    if (t >= time_.back()) return c.values.back();
+
+    // Rows k - 1 and k around t
+    const std::size_t k = std::upper_bound(time_.begin(), time_.end(), t) - time_.begin();
+    if (c.step) return c.values[k - 1];
+
+    const double w = (t - time_[k - 1]) / (time_[k] - time_[k - 1]);
+    return (1.0 - w) * c.values[k - 1] + w * c.values[k];
+}
+
+void Table::apply(Solver& s, double t0, double t1) {
+
+    for (Column& c : columns_) {
+
+        // A step column holds over the whole step: its value at the middle
+        // does not depend on where round-off puts t1 around a breakpoint
+        const double v = value(c, c.step ? 0.5 * (t0 + t1) : t1);
+        if (c.set && v == c.last) continue;
+
+        set(c.target, s, v);
+        c.last = v;
+        c.set = true;
+    }
+}
+
+std::string Table::describe() const {
+
+    std::ostringstream out;
+    out << "Schedule: " << time_.size() << " breakpoints from t = " << time_.front() << " to " << time_.back() << " s\n";
+    for (const Column& c : columns_) {
+        const auto range = std::minmax_element(c.values.begin(), c.values.end());
+        out << "  " << c.target.name << (c.step ? " (step)" : " (linear)")
+            << ": " << *range.first << " ... " << *range.second << "\n";
+    }
+    return out.str();
+}
+}
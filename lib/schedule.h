@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "input.h"
+#include "solver.h"
+
+namespace schedule {
+
+    // Input value that can be changed on a running Solver: S_m_cell or
+    // S_h_cell (the source zones of the input scaled as a whole) or one of
+    // the boundary values u/T/p_inlet/outlet_value
+    struct Target {
+        std::string name;
+        double Input::* key = nullptr;
+        double Solver::* boundary = nullptr;            // Boundary value, or
+        heap::vector<double> Solver::* source = nullptr; // source field scaled over the zones
+        std::vector<double> zone;                       // +1 evaporator, -1 condenser, 0 elsewhere
+    };
+
+    Target target(const Input& in, const Solver& s, const std::string& name);
+
+    // Puts `value` into the solver: one store for a boundary value, one
+    // pass over the cells for a source
+    void set(const Target& target, Solver& s, double value);
+
+    // Time table of source and boundary values (schedule_file in the input):
+    //
+    //     time   S_h_cell   u_inlet_value:step
+    //     0      0          0.1
+    //     10     2000       0.1
+    //     30     2000       0.2
+    //
+    // The first line names the columns: the time [s], then one Target per
+    // column. Columns are piecewise linear between rows, or piecewise
+    // constant (the value of the last row reached) with the :step suffix;
+    // before the first and after the last row the end values hold.
+    // Separators are blanks or commas, '#' starts a comment.
+    //
+    // The values are evaluated once per time step, linear columns at the
+    // end of the step (the implicit time level), and only put into the
+    // solver when they change, so a flat stretch costs nothing per cell and
+    // a ramp one pass over the cells of a source per step. Every row time is a breakpoint
+    // that the time stepping lands on exactly (see step).
+    class Table {
+    public:
+        Table() = default;
+        Table(const std::string& file, const Input& in, const Solver& s);
+
+        bool empty() const { return columns_.empty(); }
+
+        // Time step from t: `dt_max`, or shorter so that the step ends on
+        // the next breakpoint or on t_end. The gap to the next breakpoint is
+        // split into equal steps, so no sliver step is left before it.
+        double step(double t, double dt_max, double t_end) const;
+
+        // Steps of `step` from t0 to t_end [-]
+        int steps(double t0, double dt_max, double t_end) const;
+
+        // Puts the values of the step from t0 to t1 into the solver
+        void apply(Solver& s, double t0, double t1);
+
+        // One line per column: name, interpolation and range
+        std::string describe() const;
+
+    private:
+        struct Column {
+            Target target;
+            bool step = false;                          // Piecewise constant instead of linear
+            std::vector<double> values;                 // One per row
+            double last = 0.0;                          // Value last put into the solver
+            bool set = false;                           // `last` is valid
+        };
+
+        double value(const Column& c, double t) const;
+
+        std::vector<double> time_;                      // Row times, increasing [s]
+        std::vector<Column> columns_;
+    };
+}
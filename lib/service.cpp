@@ -0,0 +1,410 @@
+#include "service.h"
+
+#include <iostream>
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <omp.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "affinity.h"
+#include "input.h"
+#include "schedule.h"
+#include "solver.h"
+
+namespace service {
+
+namespace {
+
+constexpr std::uint32_t max_frame = 1u << 20;   // Largest request accepted [B]
+
+using Dict = std::unordered_map<std::string, std::string>;
+
+// Client connection, shared by its reader thread and the jobs it queued;
+// the socket is closed with the last of them
+struct Connection {
+
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { close(fd); }
+
+    const int fd;
+    std::mutex write;                           // One response at a time
+};
+
+struct Get {
+    std::uint8_t field = 0;                     // 0 u, 1 p, 2 T, 3 rho
+    double z = -1.0;                            // Probe position, < 0 for the whole field [m]
+};
+
+struct Job {
+    std::shared_ptr<Connection> connection;
+    std::uint32_t id = 0;
+    std::vector<std::pair<std::string, std::string>> set;
+    std::vector<Get> get;
+};
+
+// FIFO of decoded requests, closed once at shutdown
+class Queue {
+public:
+    void push(Job&& job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        ready_.notify_one();
+    }
+
+    // Waits for a job; false once closed and drained
+    bool pop(Job& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return closed_ || !jobs_.empty(); });
+        if (jobs_.empty()) return false;
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Job> jobs_;
+    bool closed_ = false;
+};
+
+std::atomic<int> listen_fd{ -1 };
+
+// Wakes the accept() loop; shutdown() is async-signal-safe
+void on_signal(int) {
+    const int fd = listen_fd.load();
+    if (fd >= 0) shutdown(fd, SHUT_RDWR);
+}
+
+bool read_all(int fd, void* data, std::size_t n) {
+
+    char* p = static_cast<char*>(data);
+    while (n > 0) {
+        const ssize_t r = read(fd, p, n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        p += r;
+        n -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+bool write_all(int fd, const void* data, std::size_t n) {
+
+    const char* p = static_cast<const char*>(data);
+    while (n > 0) {
+        const ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        p += w;
+        n -= static_cast<std::size_t>(w);
+    }
+    return true;
+}
+
+// Cursor over a request frame
+class Reader {
+public:
+    explicit Reader(const std::vector<char>& frame) : p_(frame.data()), end_(frame.data() + frame.size()) {}
+
+    template <typename T>
+    T get() {
+        T value;
+        take(&value, sizeof(T));
+        return value;
+    }
+
+    std::string text() {
+        std::string s(get<std::uint16_t>(), '\0');
+        take(s.data(), s.size());
+        return s;
+    }
+
+    bool done() const { return p_ == end_; }
+
+private:
+    void take(void* out, std::size_t n) {
+        if (static_cast<std::size_t>(end_ - p_) < n)
+            throw std::runtime_error("truncated request");
+        std::memcpy(out, p_, n);
+        p_ += n;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+void respond(Connection& c, std::uint32_t id, std::int32_t status, const void* body, std::uint32_t count, std::size_t item) {
+
+    const std::uint32_t size = 3 * sizeof(std::uint32_t) + static_cast<std::uint32_t>(count * item);
+
+    std::vector<char> frame(sizeof(size) + size);
+    char* p = frame.data();
+    for (const std::uint32_t v : { size, id, static_cast<std::uint32_t>(status), count }) {
+        std::memcpy(p, &v, sizeof(v));
+        p += sizeof(v);
+    }
+    if (count > 0) std::memcpy(p, body, count * item);
+
+    std::lock_guard<std::mutex> lock(c.write);
+    write_all(c.fd, frame.data(), frame.size());
+}
+
+void respond_error(Connection& c, std::uint32_t id, const std::string& message) {
+    respond(c, id, 1, message.data(), static_cast<std::uint32_t>(message.size()), 1);
+}
+
+// Runs one case on the worker's solver and collects the requested values
+std::vector<double> execute(const Dict& base, const Job& job, std::unique_ptr<Solver>& solver) {
+
+    Dict dict = base;
+    for (const auto& kv : job.set) dict[kv.first] = kv.second;
+
+    const Input in = parseInput(dict);
+
+    if (in.Nr > 1)
+        throw std::runtime_error("r-z cases are not served");
+
+    if (solver) solver->reset(in);
+    else solver = std::make_unique<Solver>(in);
+
+    Solver& s = *solver;
+
+    // Steps 0 ... time_steps, as the file driver, landing on the
+    // breakpoints of a schedule
+    schedule::Table schedule;
+    int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    if (!in.schedule_file.empty()) {
+        schedule = schedule::Table(in.schedule_file, in, s);
+        time_steps = schedule.steps(0.0, in.dt_user, in.simulation_time) - 1;
+    }
+
+    for (int n = 0; n <= time_steps; ++n) {
+
+        if (!schedule.empty()) {
+            s.dt = schedule.step(s.time_total, in.dt_user, in.simulation_time);
+            schedule.apply(s, s.time_total, s.time_total + s.dt);
+        }
+
+        s.step();
+    }
+
+    std::vector<double> values;
+
+    for (const Get& g : job.get) {
+
+        if (g.field > 3)
+            throw std::runtime_error("field must be 0 (u), 1 (p), 2 (T) or 3 (rho)");
+
+        const heap::vector<double>& x = g.field == 0 ? s.u_v : g.field == 1 ? s.p_v : g.field == 2 ? s.T_v : s.rho_v;
+
+        if (g.z < 0.0) values.insert(values.end(), x.begin(), x.end());
+        else values.push_back(s.probe(x, g.z));
+    }
+
+    return values;
+}
+
+// Decodes the requests of one connection until it is closed
+void read_requests(std::shared_ptr<Connection> c, Queue& queue) {
+
+    for (;;) {
+
+        std::uint32_t size = 0;
+        if (!read_all(c->fd, &size, sizeof(size))) return;
+
+        if (size < sizeof(std::uint32_t) || size > max_frame) {
+            respond_error(*c, 0, "bad frame size " + std::to_string(size));
+            return;
+        }
+
+        std::vector<char> frame(size);
+        if (!read_all(c->fd, frame.data(), size)) return;
+
+        Job job;
+        job.connection = c;
+
+        try {
+            Reader r(frame);
+            job.id = r.get<std::uint32_t>();
+
+            const int n_set = r.get<std::uint16_t>();
+            for (int k = 0; k < n_set; ++k) {
+                std::string key = r.text();
+                job.set.emplace_back(std::move(key), r.text());
+            }
+
+            const int n_get = r.get<std::uint16_t>();
+            for (int k = 0; k < n_get; ++k) {
+                Get g;
+                g.field = r.get<std::uint8_t>();
+                g.z = r.get<double>();
+                job.get.push_back(g);
+            }
+
+            if (!r.done())
+                throw std::runtime_error("trailing bytes in request");
+        }
+        catch (const std::exception& e) {
+            respond_error(*c, job.id, e.what());
+            continue;
+        }
+
+        queue.push(std::move(job));
+    }
+}
+}
+
+int run(const std::string& socketPath, const std::string& baseFile, int workers) {
+
+    const Dict base = readKeyValues(baseFile);
+    const Input in = parseInput(base);                      // Fails here on a broken base case
+    affinity::configure(affinity::policy(in.affinity));
+    heap::configure(heapSettings(in));                      // For every worker; a request may not change them
+
+    workers = workers > 0 ? workers : omp_get_num_procs();
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Socket path too long: " + socketPath);
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        throw std::runtime_error("Cannot create a UNIX socket");
+
+    unlink(socketPath.c_str());                             // Left behind by a killed daemon
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot listen on " + socketPath);
+    }
+
+    listen_fd = fd;
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::cout << "Serving " << baseFile << " on " << socketPath << " with " << workers << " workers" << std::endl;
+    if (affinity::current() != affinity::Policy::none) affinity::report(std::cout);
+
+    Queue queue;
+    std::atomic<long long> served{ 0 };
+    std::atomic<long long> failed{ 0 };
+
+    // Workers: one warm solver each, run serially; the concurrency is
+    // across requests. A worker is pinned before its solver is built, so
+    // that numa_placement = local puts the solver on the worker's node.
+    std::vector<std::thread> pool;
+    for (int w = 0; w < workers; ++w) {
+        pool.emplace_back([&, w] {
+
+            omp_set_num_threads(1);
+            affinity::pin_worker(w);
+            std::unique_ptr<Solver> solver;
+            Job job;
+
+            while (queue.pop(job)) {
+
+                try {
+                    const std::vector<double> values = execute(base, job, solver);
+                    respond(*job.connection, job.id, 0, values.data(), static_cast<std::uint32_t>(values.size()), sizeof(double));
+                    ++served;
+                }
+                catch (const std::exception& e) {
+                    respond_error(*job.connection, job.id, e.what());
+                    ++failed;
+                }
+
+                job = Job();                                // Releases the connection
+            }
+        });
+    }
+
+    // Readers: one thread per connection, joined when it has finished
+    // (at the next accept) or at shutdown
+    struct Reader {
+        std::thread thread;
+        std::weak_ptr<Connection> connection;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<Reader> readers;
+
+    for (;;) {
+
+        const int client = accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (Reader& r : readers)
+            if (*r.done) r.thread.join();
+        readers.erase(std::remove_if(readers.begin(), readers.end(),
+            [](const Reader& r) { return !r.thread.joinable(); }), readers.end());
+
+        auto c = std::make_shared<Connection>(client);
+        auto done = std::make_shared<std::atomic<bool>>(false);
+
+        readers.push_back({ std::thread([c, done, &queue] {
+            read_requests(c, queue);
+            *done = true;
+        }), c, done });
+    }
+
+    // Shutdown: no new requests, finish the queued ones
+    for (const Reader& r : readers)
+        if (auto c = r.connection.lock()) shutdown(c->fd, SHUT_RD);
+    for (Reader& r : readers)
+        r.thread.join();
+
+    queue.close();
+    for (std::thread& t : pool) t.join();
+
+    listen_fd = -1;
+    close(fd);
+    unlink(socketPath.c_str());
+
+    std::cout << "Served " << served << " requests, " << failed << " failed" << std::endl;
+    return 0;
+}
+}
+
+#else
+
+namespace service {
+
+int run(const std::string&, const std::string&, int) {
+    std::cerr << "The solver service needs UNIX domain sockets (Linux)" << std::endl;
+    return 1;
+}
+}
+
+#endif
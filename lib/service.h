@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+namespace service {
+
+    // Solver daemon: rhoPISO --serve <socket> <base input file> [workers].
+    //
+    // Listens on a UNIX stream socket. Every request is a 1D case given as
+    // overrides of the base input; it is run from its initial state to
+    // simulation_time, and the response carries the requested probe values
+    // and fields. A client may pipeline any number of requests on one
+    // connection: they are executed concurrently by `workers` threads, each
+    // with one warm Solver that is reset() for every case, and the responses
+    // come back as they finish, matched by id. SIGINT or SIGTERM stops the
+    // daemon after the queued requests.
+    //
+    // Frames, native byte order, a u32 byte count of the rest first:
+    //
+    //   request:  u32 size, u32 id,
+    //             u16 n_set, n_set x (u16 length, key, u16 length, value),
+    //             u16 n_get, n_get x (u8 field, f64 z)
+    //   response: u32 size, u32 id, i32 status, u32 count,
+    //             status 0: count x f64 values; else count bytes of message
+    //
+    // Keys and values are input file entries as text. A get is field 0 u,
+    // 1 p, 2 T or 3 rho, linearly interpolated between cell centres at z [m],
+    // or the N cell values if z < 0; the values of all gets are concatenated.
+    int run(const std::string& socketPath, const std::string& baseFile, int workers);
+}
@@ -0,0 +1,801 @@
+#include "solver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <omp.h>
+
+#include "stencil.h"
+#include "tdma.h"
+
+namespace {
+
+// Momentum residual of the memory-lean mode from the stored off-diagonals
+// and the velocity correction u' since the predictor solve [N/m2]
+template <typename R>
+double lean_residual(const R* a, const R* c, const R* du, const heap::vector<double>& bVU,
+    const heap::vector<double>& area, int N, bool parallel)
+{
+    double res = 0.0;
+
+    #pragma omp parallel for if (parallel) reduction(max:res)
+    for (int i = 1; i < N - 1; ++i) {
+        const double r = static_cast<double>(a[i]) * du[i - 1] + bVU[i] * du[i] + static_cast<double>(c[i]) * du[i + 1];
+        res = std::max(res, std::fabs(r) / area[i]);
+    }
+
+    return res;
+}
+
+template <typename R>
+void lean_keep(R* a, R* c, R* du, const heap::vector<double>& aU, const heap::vector<double>& cU, int N) {
+
+    for (int i = 0; i < N; ++i) {
+        a[i] = static_cast<R>(aU[i]);
+        c[i] = static_cast<R>(cU[i]);
+        du[i] = 0;
+    }
+}
+
+// Implicit under-relaxation of the interior rows of b x = d by alpha,
+// around the current x
+void relax(heap::vector<double>& b, heap::vector<double>& d, const heap::vector<double>& x, double alpha, int N, bool parallel) {
+
+    #pragma omp parallel for if (parallel)
+    for (int i = 1; i < N - 1; ++i) {
+        b[i] /= alpha;
+        d[i] += (1.0 - alpha) * b[i] * x[i];
+    }
+}
+
+// Mass flow out of the pipe through its end face, with the face velocity
+// of the neighbouring cell's equations [kg/s]
+double end_flow(const Solver& s, const heap::vector<double>& u, const heap::vector<double>& bU, bool last) {
+
+    using namespace stencil;
+
+    const int f = last ? s.N - 1 : 1;
+    const auto u_face = face_average(field(u))
+        + s.rhie_chow_on_off_v * rhie_chow(field(&s.p_storage_v[1]), field(s.area) / field(bU));   // [m/s]
+
+    const double uf = u_face(Row<0>(), f);
+    const double phi = (uf >= 0.0 ? s.rho_v[f - 1] : s.rho_v[f]) * uf * s.area_face[f];          // [kg/s]
+
+    return last ? phi : -phi;
+}
+}
+
+void Solver::Relaxation::update(double residual, double tolerance) {
+
+    if (adaptive && last > 0.0) {
+        if (residual <= tolerance || residual < 0.5 * last) alpha = std::min(1.0, 1.2 * alpha);
+        else if (residual > last) alpha = std::max(0.1, 0.7 * alpha);
+    }
+    last = residual;
+}
+
+Solver::Solver(const Input& in) {
+    reset(in);
+}
+
+void Solver::reset(const Input& in) {
+
+    // State a previous case left behind
+    time_total = 0.0;
+    step_budget = 0.0;
+    best_effort = false;
+    outer_cost = 0.0;
+    inner_cost = 0.0;
+
+    continuity_residual = momentum_residual = temperature_residual = 1.0;
+    u_error_v = p_error_v = rho_error_v = 1.0;
+    outer_v = inner_v = 0;
+
+    // Page size and NUMA placement of the large arrays allocated below;
+    // throws if another case of this process set different ones
+    heap::configure(heapSettings(in));
+
+    N = in.N;
+    L = in.L;
+    dz = L / N;
+
+    dt = in.dt_user;
+
+    tot_outer_v = in.piso_outer_iter;
+    tot_inner_v = in.piso_inner_iter;
+    outer_tol_v = in.piso_outer_tol;
+    inner_tol_v = in.piso_inner_tol;
+    rhie_chow_on_off_v = in.rhie_chow_on_off_v;
+
+    deterministic = in.deterministic;
+    parallel_v = N >= 1024;
+    tdma_parts = tdma::partitions(N, deterministic, in.tdma_chunks);
+    tdma_simd_rows = in.tdma_simd_rows == 0 ? tdma::simd_min_rows
+        : in.tdma_simd_rows < 0 ? std::numeric_limits<int>::max() : in.tdma_simd_rows;
+    tdma_simd_max_rows = in.tdma_simd_max_rows == 0 ? tdma::simd_max_rows
+        : in.tdma_simd_max_rows < 0 ? std::numeric_limits<int>::max() : in.tdma_simd_max_rows;
+    coupling = in.coupling == "jacobi" ? Coupling::jacobi : Coupling::gauss_seidel;
+    pressure_work_inner = in.pressure_work == "inner";
+
+    algorithm = in.algorithm == "simplec" ? Algorithm::simplec
+        : in.algorithm == "pimple" ? Algorithm::pimple : Algorithm::piso;
+
+    // Adaptive factors start from 0.7
+    relax_u = { in.relax_u < 0.0 ? 0.7 : in.relax_u, in.relax_u < 0.0 };
+    relax_T = { in.relax_T < 0.0 ? 0.7 : in.relax_T, in.relax_T < 0.0 };
+    relax_p = { in.relax_p < 0.0 ? 0.7 : in.relax_p, in.relax_p < 0.0 };
+    linear_solves = 0;
+
+    area.assign(N, 1.0);
+    area_face.assign(N + 1, 1.0);
+
+    for (int i = 0; i < N; ++i) area[i] = crossSection(in, (i + 0.5) * dz);
+    for (int i = 0; i <= N; ++i) area_face[i] = crossSection(in, i * dz);
+
+    eos_density = in.eos_density < 0 ? hasCrossSection(in) : in.eos_density == 1;
+
+    mu = in.mu;
+    Rv = in.Rv;
+    k = in.k;
+    cp = in.cp;
+
+    u_v.assign(N, in.u_initial);
+    T_v.assign(N, in.T_initial);
+    p_v.assign(N, in.p_initial);
+    rho_v.assign(N, in.rho_initial);
+
+    u_v_old = u_v;
+    T_v_old = T_v;
+    p_v_old = p_v;
+    rho_v_old = rho_v;
+
+    p_prime_v.assign(N, 0.0);
+    p_storage_v.assign(N + 2, 0.0);
+
+    // p_storage_v initialization
+    for (int i = 0; i < N; ++i)
+        p_storage_v[i + 1] = p_v[i];
+
+    p_storage_v[0] = p_v[0];
+    p_storage_v[N + 1] = p_v[N - 1];
+
+    memory_lean = in.memory_lean;
+    lean_float = in.memory_lean && in.lean_float;
+
+    if (!memory_lean) T_v_prev.assign(N, 0.0);
+
+    S_m.assign(N, 0.0);
+    S_u.assign(N, 0.0);
+    S_h.assign(N, 0.0);
+
+    // Source vectors definition
+    for (int i = 0; i < N; ++i) {
+
+        const int zone = sourceZone(in, (i + 0.5) * dz);
+
+        if (zone != 0) {
+            S_m[i] = zone * in.S_m_cell;
+            S_h[i] = zone * in.S_h_cell;
+        }
+    }
+
+    u_inlet_value = in.u_inlet_value;
+    u_outlet_value = in.u_outlet_value;
+    u_inlet_bc = in.u_inlet_bc;
+    u_outlet_bc = in.u_outlet_bc;
+
+    T_inlet_value = in.T_inlet_value;
+    T_outlet_value = in.T_outlet_value;
+    T_inlet_bc = in.T_inlet_bc;
+    T_outlet_bc = in.T_outlet_bc;
+
+    p_inlet_value = in.p_inlet_value;
+    p_outlet_value = in.p_outlet_value;
+    p_inlet_bc = in.p_inlet_bc;
+    p_outlet_bc = in.p_outlet_bc;
+
+    inlet_lumped = lumped::Component(in.inlet_lumped, in.T_initial);
+    outlet_lumped = lumped::Component(in.outlet_lumped, in.T_initial);
+
+    tdma_work.reserve(N, tdma_parts);
+
+    bVU.assign(N, rho_v[0] * dz / dt + 2 * mu / dz);
+    for (int i = 0; i < N; ++i) bVU[i] *= area[i];
+
+    if (algorithm == Algorithm::simplec) bVU_c = bVU;
+
+    aVP.assign(N, 0.0);
+    bVP.assign(N, 0.0);
+    cVP.assign(N, 0.0);
+    dVP.assign(N, 0.0);
+
+    // A warm solver may come from a case of the other mode: the lean
+    // buffer not in use is released, not left at that case's length
+    if (memory_lean) {
+        if (lean_float) {
+            lean_f.assign(3 * static_cast<std::size_t>(N), 0.0f);
+            lean_d = heap::vector<double>();
+        }
+        else {
+            lean_d.assign(3 * static_cast<std::size_t>(N), 0.0);
+            lean_f = heap::vector<float>();
+        }
+    }
+    else {
+        lean_d = heap::vector<double>();
+        lean_f = heap::vector<float>();
+
+        rho_new.assign(N, 0.0);
+        u_lag.assign(N, 0.0);
+        bVU_lag.assign(N, 0.0);
+        tdma_work_T.reserve(N, tdma_parts);
+
+        aVU.assign(N, 0.0);
+        cVU.assign(N, 0.0);
+        dVU.assign(N, 0.0);
+
+        aVT.assign(N, 0.0);
+        bVT.assign(N, 0.0);
+        cVT.assign(N, 0.0);
+        dVT.assign(N, 0.0);
+    }
+
+    for (int i = 0; i < N; i++) { rho_v[i] = std::max(1e-6, p_v[i] / (Rv * T_v[i])); }
+}
+
+std::size_t Solver::memory_bytes() const {
+
+    std::size_t bytes = lean_f.capacity() * sizeof(float);
+
+    for (const heap::vector<double>* v : {
+        &area, &area_face, &u_v, &T_v, &p_v, &rho_v, &u_v_old, &T_v_old, &p_v_old, &rho_v_old,
+        &p_prime_v, &p_storage_v, &T_v_prev, &rho_new, &u_lag, &bVU_lag, &S_m, &S_u, &S_h,
+        &bVU_c, &aVU, &bVU, &cVU, &dVU, &aVP, &bVP, &cVP, &dVP, &aVT, &bVT, &cVT, &dVT, &lean_d })
+        bytes += v->capacity() * sizeof(double);
+
+    for (const tdma::Workspace* w : { &tdma_work, &tdma_work_T }) {
+        for (const heap::vector<double>* v : { &w->c_star, &w->y, &w->g, &w->h, &w->A, &w->B, &w->C, &w->D, &w->X, &w->C_star, &w->lanes })
+            bytes += v->capacity() * sizeof(double);
+        bytes += w->start.capacity() * sizeof(int);
+    }
+
+    return bytes;
+}
+
+std::size_t Solver::coefficient_bytes() const {
+
+    std::size_t bytes = lean_f.capacity() * sizeof(float);
+
+    for (const heap::vector<double>* v : {
+        &bVU_c, &aVU, &bVU, &cVU, &dVU, &aVP, &bVP, &cVP, &dVP, &aVT, &bVT, &cVT, &dVT, &lean_d })
+        bytes += v->capacity() * sizeof(double);
+
+    return bytes;
+}
+
+double Solver::probe(const heap::vector<double>& x, double z) const {
+
+    const double c = std::min(std::max(z / dz - 0.5, 0.0), N - 1.0);
+    const int i = std::min(static_cast<int>(c), N - 2);
+    const double w = c - i;
+
+    return (1.0 - w) * x[i] + w * x[i + 1];
+}
+
+void Solver::step() {
+
+    double* p_padded_v = &p_storage_v[1];           // Pointer to the real nodes of the padded pressure storage [Pa]
+
+    u_error_v = 1.0;
+    outer_v = 0;
+
+    momentum_residual = 1.0;
+    temperature_residual = 1.0;
+
+    relax_u.last = relax_T.last = relax_p.last = 0.0;
+
+    // Momentum diagonal of the pressure correction
+    const bool simplec = algorithm == Algorithm::simplec;
+    const heap::vector<double>& bP = simplec ? bVU_c : bVU;
+
+    // Deadline of this step, if it has a budget
+    const double deadline = step_budget > 0.0 ? omp_get_wtime() + step_budget : 0.0;
+    best_effort = false;
+
+    // Density predictor, in p_prime_v in the memory-lean mode
+    heap::vector<double>& rho_pred = memory_lean ? p_prime_v : rho_new;
+    rho_pred = rho_v;
+
+    #pragma omp parallel for if (parallel_v)
+    for (int i = 1; i < N - 1; ++i) {
+
+        // Same face fluxes as the pressure corrector when the density is on the EOS
+        const double rc_l = !eos_density ? 0.0 : -0.5 * (area[i - 1] / bVU[i - 1] + area[i] / bVU[i]) / 4.0 *
+            (p_padded_v[i - 2] - 3.0 * p_padded_v[i - 1] + 3.0 * p_padded_v[i] - p_padded_v[i + 1]);    // [m/s]
+        const double rc_r = !eos_density ? 0.0 : -0.5 * (area[i + 1] / bVU[i + 1] + area[i] / bVU[i]) / 4.0 *
+            (p_padded_v[i - 1] - 3.0 * p_padded_v[i] + 3.0 * p_padded_v[i + 1] - p_padded_v[i + 2]);    // [m/s]
+
+        const double u_l_face = 0.5 * (u_v[i - 1] + u_v[i]) + rhie_chow_on_off_v * rc_l;
+        const double u_r_face = 0.5 * (u_v[i] + u_v[i + 1]) + rhie_chow_on_off_v * rc_r;
+
+        const double rho_l = (u_l_face >= 0.0) ? rho_v[i - 1] : rho_v[i];
+        const double rho_r = (u_r_face >= 0.0) ? rho_v[i] : rho_v[i + 1];
+
+        const double phi_l = rho_l * u_l_face * area_face[i];       // kg/s
+        const double phi_r = rho_r * u_r_face * area_face[i + 1];   // kg/s
+
+        rho_pred[i] =
+            rho_v_old[i]
+            - (dt / dz) * (phi_r - phi_l) / area[i]
+            + dt * S_m[i];
+    }
+
+    rho_v = rho_pred;
+    
+
+    // SIMPLEC has one corrector per outer iteration, so the outer loop also
+    // converges continuity
+    while (outer_v < tot_outer_v && (momentum_residual > outer_tol_v || temperature_residual > outer_tol_v * 100
+        || (simplec && continuity_residual > inner_tol_v))) {
+
+        // Stop before an outer iteration (with one inner) that would not fit
+        if (deadline > 0.0 && outer_v > 0 && omp_get_wtime() + outer_cost + inner_cost > deadline) {
+            best_effort = true;
+            break;
+        }
+
+        const double outer_start = deadline > 0.0 ? omp_get_wtime() : 0.0;
+
+        if (coupling == Coupling::jacobi) {
+
+            // Energy on the previous outer iterate of u, concurrently with momentum
+            u_lag = u_v;
+            bVU_lag = bVU;
+
+            #pragma omp parallel num_threads(std::min(2, omp_get_max_threads()))
+            #pragma omp single
+            {
+                #pragma omp task
+                momentum_predictor();
+
+                #pragma omp task
+                temperature_solver(u_lag, bVU_lag);
+            }
+        }
+        else {
+            momentum_predictor();
+            temperature_solver(u_v, bVU);
+        }
+
+        linear_solves += 2;
+
+        if (deadline > 0.0) outer_cost = std::max(omp_get_wtime() - outer_start, cost_decay * outer_cost);
+
+        if (eos_density)
+            for (int i = 0; i < N; i++) { rho_v[i] = std::max(1e-6, p_v[i] / (Rv * T_v[i])); }
+
+        rho_error_v = 1.0;
+        p_error_v = 1.0;
+        inner_v = 0;
+
+        continuity_residual = 1.0;
+
+        const int inner_max = simplec ? 1 : tot_inner_v;
+
+        while (inner_v < inner_max && continuity_residual > inner_tol_v) {
+
+            // At least one corrector per outer iteration, more while they fit
+            if (deadline > 0.0 && inner_v > 0 && omp_get_wtime() + inner_cost > deadline) {
+                best_effort = true;
+                break;
+            }
+
+            const double inner_start = deadline > 0.0 ? omp_get_wtime() : 0.0;
+
+            // -------------------------------------------------------
+            // CONTINUITY SATISFACTOR: assemble pressure correction
+            // -------------------------------------------------------
+
+            {
+                using namespace stencil;
+
+                const auto pp = field(p_padded_v);
+                const auto rho = field(rho_v), T = field(T_v), A = field(area), A_face = field(area_face);
+                const auto inv_b = A / field(bVU);                                                      // [m2s/kg]
+
+                const auto u_star = var<0>();
+                const auto phi = var<2>();
+
+                const auto mass_imbalance = (shift<1>(phi) - phi) + (rho - field(rho_v_old)) * dz / dt * A;  // [kg/s]
+
+                assemble(parallel_v, 1, N - 1, aVP.data(), bVP.data(), cVP.data(), dVP.data(),
+                    faces(
+                        face_average(field(u_v)) + rhie_chow_on_off_v * rhie_chow(pp, inv_b),         // Face velocity [m/s]
+                        upwind(u_star, 1.0 / (Rv * T)) * u_star * A_face,                               // Pressure convection [m s]
+                        upwind(u_star, rho) * u_star * A_face,                                          // Mass flux [kg/s]
+                        face_average(rho * (A / field(bP))) / dz * A_face),                             // Pressure diffusion [m s]
+                    diffusion(var<3>()),
+                    convection(var<1>()),
+                    implicit(1.0 / (Rv * T) * dz / dt * A),                                            // [m s]
+                    source(field(S_m) * dz * A),                                                        // [kg/s]
+                    sink(mass_imbalance));
+
+                // BCs on p_prime
+                boundary(p_inlet_bc, 0.0, 1.0, 0, false, aVP.data(), bVP.data(), cVP.data(), dVP.data());
+                boundary(p_outlet_bc, 0.0, 1.0, N - 1, true, aVP.data(), bVP.data(), cVP.data(), dVP.data());
+
+                // Lumped mass components, condensed into the end rows. The
+                // end face flux follows p' through the velocity corrector of
+                // the neighbour cell and the Rhie-Chow term, together about
+                // 3/4 rho A_face A / b per pascal across the face.
+                for (const bool last : { false, true }) {
+
+                    lumped::Component& c = last ? outlet_lumped : inlet_lumped;
+                    if (!c.carries_mass()) continue;
+
+                    const int i = last ? N - 1 : 0, f = last ? N - 1 : 1;
+                    const double D = 0.75 * 0.5 * (area[f - 1] / bP[f - 1] + area[f] / bP[f])
+                        * rho_v[last ? N - 2 : 1] * area_face[f];                                       // [m s]
+
+                    c.pressure_row(end_flow(*this, u_v, bVU, last), D, p_v[i], p_v_old[i], rho_v[i], area_face[f], dt, Rv,
+                        i, last, aVP.data(), bVP.data(), cVP.data(), dVP.data());
+                }
+            }
+
+            tdma::solve_partitioned(aVP, bVP, cVP, dVP, p_prime_v, tdma_work, tdma_parts, tdma_simd_rows, tdma_simd_max_rows);
+            ++linear_solves;
+
+            if (inlet_lumped.carries_mass()) inlet_lumped.pressure_solved(p_prime_v[0], p_prime_v[1]);
+            if (outlet_lumped.carries_mass()) outlet_lumped.pressure_solved(p_prime_v[N - 1], p_prime_v[N - 2]);
+
+            // -------------------------------------------------------
+            // PRESSURE CORRECTOR
+            // -------------------------------------------------------
+
+            p_error_v = 0.0;
+
+            const double alpha_p = relax_p.alpha;
+
+            #pragma omp parallel for if (parallel_v) reduction(max:p_error_v)
+            for (int i = 0; i < N; ++i) {
+
+                const double p_prev = p_v[i];
+                p_v[i] += alpha_p * p_prime_v[i];
+
+                p_storage_v[i + 1] = p_v[i];
+                p_error_v = std::max(p_error_v, std::fabs(p_v[i] - p_prev));
+            }
+
+            // BCs on pressure; a lumped end keeps its corrected pressure
+            if (inlet_lumped.carries_mass()) {
+
+                p_storage_v[0] = p_v[0];
+            }
+            else if (p_inlet_bc == 0) {                         // Dirichlet BC
+
+                p_v[0] = p_inlet_value;
+                p_storage_v[0] = p_inlet_value;
+            }
+            else if (p_inlet_bc == 1) {                         // Neumann BC
+
+                p_v[0] = p_v[1];
+                p_storage_v[0] = p_storage_v[1];
+            }
+
+            if (outlet_lumped.carries_mass()) {
+
+                p_storage_v[N + 1] = p_v[N - 1];
+            }
+            else if (p_outlet_bc == 0) {                         // Dirichlet BC
+
+                p_v[N - 1] = p_outlet_value;
+                p_storage_v[N + 1] = p_outlet_value;
+            }
+            else if (p_outlet_bc == 1) {                         // Neumann BC
+
+                p_v[N - 1] = p_v[N - 2];
+                p_storage_v[N + 1] = p_storage_v[N];
+            }
+
+            // -------------------------------------------------------
+            // VELOCITY CORRECTOR
+            // -------------------------------------------------------
+
+            u_error_v = 0.0;
+
+            // Velocity correction since the predictor, for the memory-lean residual
+            double* du_d = memory_lean && !lean_float ? lean_d.data() + 2 * static_cast<std::size_t>(N) : nullptr;
+            float* du_f = lean_float ? lean_f.data() + 2 * static_cast<std::size_t>(N) : nullptr;
+
+            #pragma omp parallel for if (parallel_v) reduction(max:u_error_v)
+            for (int i = 1; i < N - 1; ++i) {
+
+                const double u_prev = u_v[i];
+                u_v[i] -= (p_prime_v[i + 1] - p_prime_v[i - 1]) * area[i] / (2.0 * bP[i]);
+                u_error_v = std::max(u_error_v, std::fabs(u_v[i] - u_prev));
+
+                if (du_d) du_d[i] += u_v[i] - u_prev;
+                else if (du_f) du_f[i] += static_cast<float>(u_v[i] - u_prev);
+            }
+
+            // -------------------------------------------------------
+            // DENSITY CORRECTOR
+            // -------------------------------------------------------
+
+            rho_error_v = 0.0;
+
+            #pragma omp parallel for if (parallel_v) reduction(max:rho_error_v)
+            for (int i = 0; i < N; ++i) {
+                const double rho_prev = rho_v[i];
+                rho_v[i] += p_prime_v[i] / (Rv * T_v[i]);
+                rho_error_v = std::max(rho_error_v, std::fabs(rho_v[i] - rho_prev));
+            }
+
+            // -------------------------------------------------------
+            // TEMPERATURE CORRECTOR
+            // -------------------------------------------------------
+
+            if (pressure_work_inner) {
+
+                // Pressure work of p' [W], after the density corrector so
+                // that it sees the T of the p' equation
+                #pragma omp parallel for if (parallel_v)
+                for (int i = 1; i < N - 1; ++i) {
+                    dVT[i] = p_prime_v[i] / dt * dz * area[i]
+                        + u_v[i] * (p_prime_v[i + 1] - p_prime_v[i - 1]) * 0.5 * area[i];
+                }
+                dVT[0] = dVT[N - 1] = 0.0;
+
+                tdma::solve_partitioned(aVT, bVT, cVT, dVT, T_v_prev, tdma_work_T, tdma_parts, tdma_simd_rows, tdma_simd_max_rows);
+                ++linear_solves;
+
+                #pragma omp parallel for if (parallel_v)
+                for (int i = 0; i < N; ++i) T_v[i] += T_v_prev[i];
+            }
+
+            // -------------------------------------------------------
+            // CONTINUITY RESIDUAL CALCULATION
+            // -------------------------------------------------------
+
+            continuity_residual = 0.0;
+
+            #pragma omp parallel for if (parallel_v) reduction(max:continuity_residual)
+            for (int i = 1; i < N - 1; ++i) {
+                continuity_residual = std::max(continuity_residual, std::fabs(dVP[i]) / area[i]);
+            }
+
+            // Mass balance of the lumped components
+            if (inlet_lumped.carries_mass()) continuity_residual = std::max(continuity_residual, std::fabs(dVP[0]) / area[0]);
+            if (outlet_lumped.carries_mass()) continuity_residual = std::max(continuity_residual, std::fabs(dVP[N - 1]) / area[N - 1]);
+
+            if (inner_v == 0) relax_p.update(continuity_residual, inner_tol_v);
+
+            if (deadline > 0.0) inner_cost = std::max(omp_get_wtime() - inner_start, cost_decay * inner_cost);
+
+            inner_v++;
+        }
+
+        // -------------------------------------------------------
+        // MOMENTUM RESIDUAL CALCULATION
+        // -------------------------------------------------------
+
+        momentum_residual = 0.0;
+
+        if (lean_float) {
+            const float* l = lean_f.data();
+            momentum_residual = lean_residual(l, l + N, l + 2 * N, bVU, area, N, parallel_v);
+        }
+        else if (memory_lean) {
+            const double* l = lean_d.data();
+            momentum_residual = lean_residual(l, l + N, l + 2 * N, bVU, area, N, parallel_v);
+        }
+        else {
+            #pragma omp parallel for if (parallel_v) reduction(max:momentum_residual)
+            for (int i = 1; i < N - 1; ++i) {
+                momentum_residual = std::max(momentum_residual, std::fabs(aVU[i] * u_v[i - 1] + bVU[i] * u_v[i] + cVU[i] * u_v[i + 1] - dVU[i]) / area[i]);
+            }
+        }
+
+        relax_u.update(momentum_residual, outer_tol_v);
+        relax_T.update(temperature_residual, outer_tol_v * 100);
+
+        outer_v++;
+    }
+
+    // for (int i = 0; i < N; i++) { rho_v[i] = std::max(1e-6, p_v[i] / (Rv * T_v[i])); }
+
+    inlet_lumped.advance(T_v[0], dt);
+    outlet_lumped.advance(T_v[N - 1], dt);
+
+    // Saving old variables
+    u_v_old = u_v;
+    p_v_old = p_v;
+    rho_v_old = rho_v;
+    T_v_old = T_v;
+
+    time_total += dt;
+}
+
+void Solver::momentum_predictor() {
+
+    using namespace stencil;
+
+    const double* p_padded_v = &p_storage_v[1];
+
+    // The shared workspace in the memory-lean mode
+    heap::vector<double>& aU = memory_lean ? aVP : aVU;
+    heap::vector<double>& cU = memory_lean ? cVP : cVU;
+    heap::vector<double>& dU = memory_lean ? dVP : dVU;
+
+    // ===========================================================
+    // MOMENTUM PREDICTOR
+    // ===========================================================
+
+    const auto pp = field(p_padded_v);
+    const auto u = field(u_v), rho = field(rho_v), p = field(p_v), A = field(area), A_face = field(area_face);
+    const auto u_face = var<0>();
+
+    // A / bVU of the previous outer iteration for Rhie-Chow. The rows write
+    // bVU while the faces read it at the neighbouring cells, so the faces
+    // take a copy, in p_prime_v, dead until the solve below: every row sees
+    // the same coefficients whatever thread assembles it.
+    heap::vector<double>& inv_b = p_prime_v;
+
+    #pragma omp parallel for if (parallel_v)
+    for (int i = 0; i < N; ++i) inv_b[i] = area[i] / bVU[i];
+
+    // Pressure flux and pressure-area source p dA/dz together: -A dp/dz,
+    // so that a fluid at rest in a tapered duct stays at rest
+    assemble(parallel_v, 1, N - 1, aU.data(), bVU.data(), cU.data(), dU.data(),
+        faces(
+            face_average(u) + rhie_chow_on_off_v * rhie_chow(pp, field(inv_b)),                // Face velocity (average + RhieChow) [m/s]
+            upwind(u_face, rho) * u_face * A_face),                                             // Upwind mass flux [kg/s]
+        source(-0.5 * A * (shift<1>(p) - shift<-1>(p))),                                        // [N]
+        convection(var<1>()),
+        transient(rho * dz / dt * A, field(rho_v_old) * field(u_v_old) * dz / dt * A),
+        diffusion((4.0 / 3.0) * mu / dz * A_face),                                              // [kg/s]
+        source(field(S_u) * dz * A));                                                           // [N]
+
+    /// Diffusion coefficients for the first and last node to define BCs
+    const double D_first = (4.0 / 3.0) * mu / dz;
+    const double D_vast = (4.0 / 3.0) * mu / dz;
+
+    /// Velocity BCs needed variables for the first node
+    const double u_r_face_first = 0.5 * (u_v[1]);
+    const double rho_r_first = (u_r_face_first >= 0) ? rho_v[0] : rho_v[1];
+    const double F_r_first = rho_r_first * u_r_face_first;
+
+    /// Velocity BCs needed variables for the last node
+    const double u_l_face_last = 0.5 * (u_v[N - 2]);
+    const double rho_l_last = (u_l_face_last >= 0) ? rho_v[N - 2] : rho_v[N - 1];
+    const double F_l_last = rho_l_last * u_l_face_last;
+
+    /// BC rows scaled by the end cell areas, like the interior rows
+    const double diag_first = (rho_v[0] * dz / dt + 2 * D_first + F_r_first) * area[0];
+    const double diag_last = (rho_v[N - 1] * dz / dt + 2 * D_vast - F_l_last) * area[N - 1];
+
+    boundary(u_inlet_bc, u_inlet_value, diag_first, 0, false, aU.data(), bVU.data(), cU.data(), dU.data());
+    boundary(u_outlet_bc, u_outlet_value, diag_last, N - 1, true, aU.data(), bVU.data(), cU.data(), dU.data());
+
+    // Relaxed u from the solution in p_prime_v, dead until the corrector;
+    // bVU stays the diagonal of the momentum equation, so Rhie-Chow and
+    // the converged solution do not depend on the factor
+    const double alpha = relax_u.alpha;
+    heap::vector<double>& u_solved = alpha < 1.0 ? p_prime_v : u_v;
+
+    tdma::solve_partitioned(aU, bVU, cU, dU, u_solved, tdma_work, tdma_parts, tdma_simd_rows, tdma_simd_max_rows);
+
+    // SIMPLEC coefficients, bVU in the boundary rows
+    if (algorithm == Algorithm::simplec) {
+
+        #pragma omp parallel for if (parallel_v)
+        for (int i = 1; i < N - 1; ++i) {
+            const double b = bVU[i] + aU[i] + cU[i];
+            bVU_c[i] = b > 0.0 ? b : bVU[i];
+        }
+        bVU_c[0] = bVU[0];
+        bVU_c[N - 1] = bVU[N - 1];
+    }
+
+    // Off-diagonals for the momentum residual, which p' and energy would overwrite
+    if (lean_float) lean_keep(lean_f.data(), lean_f.data() + N, lean_f.data() + 2 * N, aU, cU, N);
+    else if (memory_lean) lean_keep(lean_d.data(), lean_d.data() + N, lean_d.data() + 2 * N, aU, cU, N);
+
+    if (alpha < 1.0) {
+
+        // The velocity correction since the predictor starts at the part
+        // of the solution left out
+        double* du_d = memory_lean && !lean_float ? lean_d.data() + 2 * static_cast<std::size_t>(N) : nullptr;
+        float* du_f = lean_float ? lean_f.data() + 2 * static_cast<std::size_t>(N) : nullptr;
+
+        #pragma omp parallel for if (parallel_v)
+        for (int i = 1; i < N - 1; ++i) {
+            u_v[i] += alpha * (u_solved[i] - u_v[i]);
+
+            if (du_d) du_d[i] = u_v[i] - u_solved[i];
+            else if (du_f) du_f[i] = static_cast<float>(u_v[i] - u_solved[i]);
+        }
+        u_v[0] = u_solved[0];
+        u_v[N - 1] = u_solved[N - 1];
+    }
+}
+
+void Solver::temperature_solver(const heap::vector<double>& u, const heap::vector<double>& bU) {
+
+    using namespace stencil;
+
+    const double* p_padded_v = &p_storage_v[1];
+
+    // The shared workspace in the memory-lean mode
+    heap::vector<double>& aT = memory_lean ? aVP : aVT;
+    heap::vector<double>& bT = memory_lean ? bVP : bVT;
+    heap::vector<double>& cT = memory_lean ? cVP : cVT;
+    heap::vector<double>& dT = memory_lean ? dVP : dVT;
+
+    // ===============================================================
+    // TEMPERATURE SOLVER
+    // ===============================================================
+
+    // Energy equation for T (implicit), upwind convection, central diffusion
+    const auto pp = field(p_padded_v);
+    const auto U = field(u), rho = field(rho_v), p = field(p_v), A = field(area), A_face = field(area_face);
+
+    const auto u_face = var<0>();
+
+    const auto dp_dt = (p - field(p_v_old)) / dt * dz * A;                                      // [W]
+    const auto dpdz_up = U * (shift<1>(p) - shift<-1>(p)) * 0.5 * A;                            // [W]
+    const auto viscous_dissipation = 4.0 / 3.0 * 0.25 * mu
+        * ((shift<1>(U) - U) * (shift<1>(U) - U) + (U + shift<-1>(U)) * (U + shift<-1>(U))) / dz * A;  // [W]
+
+    assemble(parallel_v, 1, N - 1, aT.data(), bT.data(), cT.data(), dT.data(),
+        faces(
+            face_average(U) + rhie_chow_on_off_v * rhie_chow(pp, A / field(bU)),               // Face velocity [m/s]
+            upwind(u_face, rho) * u_face * A_face * cp),                                        // Upwind heat capacity flux [W/K]
+        convection(var<1>()),
+        diffusion(k / dz * A_face),                                                             // [W/K]
+        transient(rho * cp * dz / dt * A, field(rho_v_old) * cp * dz / dt * A * field(T_v_old)),
+        source(dp_dt),
+        source(dpdz_up),
+        source(viscous_dissipation),
+        source(field(S_h) * dz * A));                                                           // [W]
+
+    if (relax_T.alpha < 1.0) relax(bT, dT, T_v, relax_T.alpha, N, parallel_v);
+
+    // BCs on temperature
+    boundary(T_inlet_bc, T_inlet_value, 1.0, 0, false, aT.data(), bT.data(), cT.data(), dT.data());
+    boundary(T_outlet_bc, T_outlet_value, 1.0, N - 1, true, aT.data(), bT.data(), cT.data(), dT.data());
+
+    // Lumped components, condensed into the end rows
+    for (const bool last : { false, true }) {
+
+        lumped::Component& c = last ? outlet_lumped : inlet_lumped;
+        if (c.kind() == lumped::Kind::none) continue;
+
+        const int i = last ? N - 1 : 0, f = last ? N - 1 : 1;
+        const double q = end_flow(*this, u, bU, last);                                          // [kg/s]
+
+        c.energy_row(q, cp * std::fabs(q), k / dz * area_face[f], dt, i, last, aT.data(), bT.data(), cT.data(), dT.data());
+    }
+
+    // The new temperature goes to p_prime_v in the memory-lean mode, so that
+    // the residual needs no copy of the old one
+    heap::vector<double>& T_new = memory_lean ? p_prime_v : T_v;
+
+    if (!memory_lean) T_v_prev = T_v;
+    tdma::solve_partitioned(aT, bT, cT, dT, T_new, memory_lean ? tdma_work : tdma_work_T, tdma_parts, tdma_simd_rows, tdma_simd_max_rows);
+
+    const heap::vector<double>& T_old_iter = memory_lean ? T_v : T_v_prev;
+
+    // -------------------------------------------------------
+    // TEMPERATURE RESIDUAL CALCULATION
+    // -------------------------------------------------------
+
+    temperature_residual = 0.0;
+
+    #pragma omp parallel for if (parallel_v) reduction(max:temperature_residual)
+    for (int i = 1; i < N - 1; ++i) {
+        temperature_residual = std::max(temperature_residual, std::fabs(T_new[i] - T_old_iter[i]));
+    }
+
+    if (memory_lean) T_v = T_new;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <vector>
+
+#include "heap.h"
+#include "input.h"
+#include "lumped.h"
+#include "tdma.h"
+
+// =======================================================================
+//                                SOLVER
+// =======================================================================
+
+// Pressure-based compressible PISO solver for the 1D vapor core. The whole
+// state is public: drivers read the fields for output and may change the
+// time step, controls, sources and boundary values between two steps.
+struct Solver {
+
+    // Order of the momentum and energy solves within an outer iteration
+    enum class Coupling {
+        gauss_seidel,   // Energy after momentum, on the new velocity
+        jacobi          // Energy on the previous outer iterate, both solved concurrently
+    };
+
+    // Pressure-velocity algorithm
+    enum class Algorithm {
+        piso,           // Correctors to inner_tol_v every outer iteration, no relaxation
+        simplec,        // One corrector per outer iteration, consistent coefficients
+        pimple          // Correctors to inner_tol_v, relaxed outer iterations
+    };
+
+    // Under-relaxation factor of u, T or p, fixed or adapted after every
+    // outer iteration from the residual of its equation: raised by 20%
+    // (up to 1) while the residual is within its tolerance or falls below
+    // half the previous one, lowered by 30% (down to 0.1) when it grows,
+    // kept otherwise. The factor carries over to the next step, the
+    // residual history does not.
+    struct Relaxation {
+        double alpha = 1.0;                         // Current factor [-]
+        bool   adaptive = false;                    // Adapted from the residual [-]
+        double last = 0.0;                          // Residual of the previous outer iteration, 0 for none
+
+        void update(double residual, double tolerance);
+    };
+
+    explicit Solver(const Input& in);
+
+    // Starts over from the initial state of `in`, as the constructor does,
+    // but in the arrays already held: a case of no more cells than before
+    // is set up without a heap allocation
+    void reset(const Input& in);
+
+    // Heap memory held by the fields, coefficients and TDMA workspaces [B]
+    std::size_t memory_bytes() const;
+
+    // The part of it in coefficient arrays, including the lean residual
+    // arrays [B]. Only those are float with lean_float; the shared
+    // workspace aVP..dVP and bVU stay double, as the TDMA solves need.
+    std::size_t coefficient_bytes() const;
+
+    // Field x at position z [m]: linear between cell centres, constant
+    // beyond the first and last centre
+    double probe(const heap::vector<double>& x, double z) const;
+
+    // Advances the solution by one time step of size dt. Does no I/O and,
+    // after the constructor, no heap allocation.
+    void step();
+
+    // Stages of an outer iteration. The energy equation takes the velocity
+    // and momentum diagonal it is assembled with, so that in Jacobi coupling
+    // it can run on lagged copies while momentum updates u_v and bVU.
+    void momentum_predictor();
+    void temperature_solver(const heap::vector<double>& u, const heap::vector<double>& bU);
+
+    int    N = 0;                                   // Number of cells [-]
+    double L = 0.0;                                 // Length of the domain [m]
+    double dz = 0.0;                                // Cell size [m]
+
+    // Quasi-1D cross-section. Every flux is multiplied by its face area and
+    // every volume term by the cell area, so the equations are in [kg/s],
+    // [N] and [W]; a plain 1D case is the unit area.
+    heap::vector<double> area;                      // Cross-section of every cell [m2]
+    heap::vector<double> area_face;                 // Cross-section of face i, west of cell i [m2]
+
+    // With eos_density the density is put back on p / (Rv T) after every
+    // energy solve and predicted with the corrector's Rhie-Chow fluxes.
+    // Otherwise mass piling up in a converging section only raises rho and
+    // never reaches the pressure that should accelerate the flow.
+    bool   eos_density = false;                     // Density on the equation of state [-]
+
+    double dt = 0.0;                                // Time step [s]
+    double time_total = 0.0;                        // Simulated time [s]
+
+    int    tot_outer_v = 0;                         // PISO outer iterations [-]
+    int    tot_inner_v = 0;                         // PISO inner iterations [-]
+    double outer_tol_v = 0.0;                       // PISO outer tolerance [-]
+    double inner_tol_v = 0.0;                       // PISO inner tolerance [-]
+    bool   rhie_chow_on_off_v = true;               // RhieChow interpolation on/off (1/0) [-]
+
+    bool   deterministic = false;                   // Thread-count-independent results [-]
+    bool   parallel_v = false;                      // Worksharing only pays off on large meshes [-]
+    int    tdma_parts = 1;                          // TDMA partitions [-]
+    int    tdma_simd_rows = 0;                      // Smallest system solved by SIMD PCR [-]
+    int    tdma_simd_max_rows = 0;                  // Largest system solved by SIMD PCR [-]
+    Coupling coupling = Coupling::gauss_seidel;     // Momentum/energy ordering [-]
+
+    // Pressure work in the inner loop. The energy equation holds dp/dt and
+    // u dp/dz as sources from the pressure of its outer iteration; with
+    // pressure_work_inner every p' also corrects T through the same energy
+    // matrix, with the linearized pressure work as right-hand side:
+    //
+    //     (aT, bT, cT) T' = p' dz A / dt + u (p'_E - p'_W) A / 2
+    //
+    // and zero change in the boundary rows. The energy coefficients are
+    // kept for that, so it needs memory_lean off; dVT and T_v_prev, dead
+    // between two energy solves, hold the right-hand side and T'. Viscous
+    // dissipation, of second order in the velocity correction, stays lagged.
+    bool   pressure_work_inner = false;             // Temperature corrected with every p' [-]
+
+    // SIMPLEC and PIMPLE. SIMPLEC solves one p' per outer iteration, which
+    // then also runs until the continuity residual is below inner_tol_v,
+    // and corrects with the momentum diagonal less its neighbours,
+    // bVU + aVU + cVU (bVU_c), in place of bVU: in the p' diffusion and the
+    // velocity corrector. Where that sum is not positive, bVU is used.
+    // Rhie-Chow keeps bVU, so that all algorithms converge to the same
+    // solution. PIMPLE keeps the PISO correctors and coefficients. Both
+    // relax the interior of u explicitly, u += alpha (u_solved - u), so
+    // that bVU stays the momentum diagonal; T implicitly, b / alpha with
+    // (1 - alpha) b T added to the right-hand side; and p explicitly,
+    // p += alpha p', while u and rho take the whole p'.
+    Algorithm algorithm = Algorithm::piso;          // Pressure-velocity algorithm [-]
+    Relaxation relax_u, relax_T, relax_p;           // Under-relaxation of u, T and p [-]
+    heap::vector<double> bVU_c;                     // SIMPLEC momentum diagonal less the neighbours
+    long long linear_solves = 0;                    // TDMA solves since the start [-]
+
+    // Memory-lean mode. Momentum, energy and p' are assembled one after the
+    // other into aVP..dVP; only bVU, which Rhie-Chow and the correctors
+    // need, is kept apart. The density predictor and the energy solve use
+    // p_prime_v, dead between two correctors, as scratch. The momentum
+    // residual is evaluated as aVU u'_W + bVU u'_P + cVU u'_E, where u' is the
+    // velocity correction since the predictor solve; aVU, cVU and u' are
+    // kept in lean_d, or in lean_f when lean_float is set.
+    bool   memory_lean = false;                     // Shared coefficient workspace [-]
+    bool   lean_float = false;                      // Momentum residual arrays in float [-]
+    heap::vector<double> lean_d;                    // aVU, cVU and u', N each
+    heap::vector<float> lean_f;                     // aVU, cVU and u' in float, N each
+
+    // Real-time budget: with step_budget > 0 an iteration is only started if
+    // the longest recent one of its kind still fits before the deadline. The
+    // cost estimates are maxima that decay by cost_decay per iteration, so a
+    // one-off preemption is forgotten after a few dozen iterations. At least
+    // one outer and one inner iteration always run.
+    double step_budget = 0.0;                       // Wall time allowed for one step, 0 for none [s]
+    double cost_decay = 0.9;                        // Decay of the iteration cost estimates [-]
+    bool   best_effort = false;                     // Last step stopped at its budget unconverged [-]
+    double outer_cost = 0.0;                        // Recent longest momentum + energy stage [s]
+    double inner_cost = 0.0;                        // Recent longest pressure corrector [s]
+
+    double mu = 0.0;                                // Dynamic viscosity [kg/(m s)]
+    double Rv = 0.0;                                // Specific gas constant for water vapor [J/(kg K)]
+    double k = 0.0;                                 // Thermal conductivity [W/(m K)]
+    double cp = 0.0;                                // Specific heat capacity at constant pressure [J/(kg K)]
+
+    heap::vector<double> u_v;                       // Velocity field [m/s]
+    heap::vector<double> T_v;                       // Temperature field [K]
+    heap::vector<double> p_v;                       // Pressure field [Pa]
+    heap::vector<double> rho_v;                     // Density field [kg/m3]
+
+    heap::vector<double> u_v_old;                   // Previous time step velocity [m/s]
+    heap::vector<double> T_v_old;                   // Previous time step temperature [K]
+    heap::vector<double> p_v_old;                   // Previous time step pressure [Pa]
+    heap::vector<double> rho_v_old;                 // Previous time step density [kg/m3]
+
+    heap::vector<double> p_prime_v;                 // Pressure correction [Pa]
+    heap::vector<double> p_storage_v;               // Padded pressure storage for RhieChow [Pa]
+
+    heap::vector<double> T_v_prev;                  // Previous iteration temperature for convergence check [K]
+
+    heap::vector<double> rho_new;                   // Density predictor [kg/m3]
+    heap::vector<double> u_lag;                     // Velocity seen by energy in Jacobi coupling [m/s]
+    heap::vector<double> bVU_lag;                   // Momentum diagonal seen by energy in Jacobi coupling
+
+    heap::vector<double> S_m;                       // Volumetric mass source [kg/(m3 s)]
+    heap::vector<double> S_u;                       // Volumetric momentum source [N/m3]
+    heap::vector<double> S_h;                       // Volumetric heat source [W/m3]
+
+    double u_inlet_value = 0.0;                     // Inlet velocity [m/s]
+    double u_outlet_value = 0.0;                    // Outlet velocity [m/s]
+    bool   u_inlet_bc = false;                      // Inlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   u_outlet_bc = false;                     // Outlet velocity BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    double T_inlet_value = 0.0;                     // Inlet temperature [K]
+    double T_outlet_value = 0.0;                    // Outlet temperature [K]
+    bool   T_inlet_bc = false;                      // Inlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   T_outlet_bc = false;                     // Outlet temperature BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    double p_inlet_value = 0.0;                     // Inlet pressure [Pa]
+    double p_outlet_value = 0.0;                    // Outlet pressure [Pa]
+    bool   p_inlet_bc = false;                      // Inlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+    bool   p_outlet_bc = false;                     // Outlet pressure BC type (Dirichlet: 0.0, Neumann: 1.0) [-]
+
+    // Lumped components at the ends (lumped.h). A plenum or orifice takes
+    // over the pressure and temperature rows of its end, a condenser the
+    // temperature row; the component's unknown is condensed into that row.
+    lumped::Component inlet_lumped;                 // Component at z = 0
+    lumped::Component outlet_lumped;                // Component at z = L
+
+    heap::vector<double> aVU;                       // Lower tridiagonal coefficient for velocity
+    heap::vector<double> bVU;                       // Central tridiagonal coefficient for velocity
+    heap::vector<double> cVU;                       // Upper tridiagonal coefficient for velocity
+    heap::vector<double> dVU;                       // Known vector coefficient for velocity
+
+    heap::vector<double> aVP;                       // Lower tridiagonal coefficient for pressure
+    heap::vector<double> bVP;                       // Central tridiagonal coefficient for pressure
+    heap::vector<double> cVP;                       // Upper tridiagonal coefficient for pressure
+    heap::vector<double> dVP;                       // Known vector coefficient for pressure
+
+    heap::vector<double> aVT;                       // Lower tridiagonal coefficient for temperature
+    heap::vector<double> bVT;                       // Central tridiagonal coefficient for temperature
+    heap::vector<double> cVT;                       // Upper tridiagonal coefficient for temperature
+    heap::vector<double> dVT;                       // Known vector coefficient for temperature
+
+    tdma::Workspace tdma_work;                      // Scratch arrays of the momentum and p' solves
+    tdma::Workspace tdma_work_T;                    // Scratch arrays of the energy solve
+
+    // Convergence metrics of the last step
+    double continuity_residual = 1.0;
+    double momentum_residual = 1.0;
+    double temperature_residual = 1.0;
+
+    double u_error_v = 1.0;
+    int outer_v = 0;
+
+    double p_error_v = 1.0;
+    double rho_error_v = 1.0;
+    int inner_v = 0;
+};
@@ -0,0 +1,384 @@
+#include "statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace statistics {
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+const char* const field_names[4] = { "u", "p", "T", "rho" };
+
+const heap::vector<double>& field(const Solver& s, char f) {
+    return f == 'u' ? s.u_v : f == 'p' ? s.p_v : f == 'T' ? s.T_v : s.rho_v;
+}
+
+std::string label(const Probe& p) {
+    std::ostringstream os;
+    os << (p.field == 'r' ? std::string("rho") : std::string(1, p.field)) << "@" << p.z;
+    return os.str();
+}
+
+const char* unit(char f) {
+    return f == 'u' ? "m/s" : f == 'p' ? "Pa" : f == 'T' ? "K" : "kg/m3";
+}
+
+// In place, radix 2; twiddle[k] = exp(-2 pi i k / n) for k < n / 2
+void fft(std::vector<std::complex<double>>& x, const std::vector<std::complex<double>>& twiddle) {
+
+    const std::size_t n = x.size();
+
+    for (std::size_t i = 1, j = 0; i < n; ++i) {
+        std::size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(x[i], x[j]);
+    }
+
+    for (std::size_t len = 2; len <= n; len <<= 1) {
+
+        const std::size_t half = len / 2, stride = n / len;
+
+        for (std::size_t i = 0; i < n; i += len)
+            for (std::size_t k = 0; k < half; ++k) {
+                const std::complex<double> t = twiddle[k * stride] * x[i + k + half];
+                x[i + k + half] = x[i + k] - t;
+                x[i + k] += t;
+            }
+    }
+}
+}
+
+Fields::Fields(int N) : N_(N), state_(1 + 16 * static_cast<std::size_t>(N), 0.0) {
+
+    const double inf = std::numeric_limits<double>::infinity();
+    std::fill(state_.begin() + 1 + 8 * N, state_.begin() + 1 + 12 * N, inf);
+    std::fill(state_.begin() + 1 + 12 * N, state_.end(), -inf);
+}
+
+void Fields::add(const Solver& s, double w) {
+
+    const int N = N_;
+    const double f = w / (state_[0] += w);
+
+    double* mean = &state_[1];
+    double* m2 = mean + 4 * N;
+    double* lo = m2 + 4 * N;
+    double* hi = lo + 4 * N;
+
+    const bool parallel = s.parallel_v;
+
+    for (int q = 0; q < 4; ++q) {
+
+        const heap::vector<double>& x = field(s, "upTr"[q]);
+        const int o = q * N;
+
+        #pragma omp parallel for if (parallel)
+        for (int i = 0; i < N; ++i) {
+
+            const double v = x[i];
+            const double d = v - mean[o + i];
+
+            mean[o + i] += f * d;
+            m2[o + i] += w * d * (v - mean[o + i]);
+            lo[o + i] = std::min(lo[o + i], v);
+            hi[o + i] = std::max(hi[o + i], v);
+        }
+    }
+}
+
+void Fields::write(const std::filesystem::path& file, double dz) const {
+
+    std::ofstream csv(file);
+
+    csv << "z";
+    for (const char* name : field_names)
+        csv << "," << name << "_mean," << name << "_rms," << name << "_min," << name << "_max";
+    csv << "\n" << std::setprecision(10);
+
+    const int N = N_;
+    const double W = std::max(state_[0], 1e-300);
+    const double* mean = &state_[1];
+    const double* m2 = mean + 4 * N;
+    const double* lo = m2 + 4 * N;
+    const double* hi = lo + 4 * N;
+
+    for (int i = 0; i < N; ++i) {
+        csv << (i + 0.5) * dz;
+        for (int q = 0; q < 4; ++q) {
+            const int j = q * N + i;
+            csv << "," << mean[j] << "," << std::sqrt(std::max(m2[j], 0.0) / W) << "," << lo[j] << "," << hi[j];
+        }
+        csv << "\n";
+    }
+}
+
+void Fields::set_state(const std::vector<double>& state) {
+
+    if (state.size() != state_.size())
+        throw std::runtime_error("Checkpoint statistics are for another mesh");
+    state_ = state;
+}
+
+std::vector<Probe> probes(const std::string& list) {
+
+    std::vector<Probe> v;
+    std::stringstream ss(list);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.empty()) continue;
+
+        const auto at = item.find('@');
+        if (at == std::string::npos)
+            throw std::runtime_error("spectrum_probes are field@z, got: " + item);
+
+        const std::string f = item.substr(0, at);
+
+        Probe p;
+        if (f == "u" || f == "p" || f == "T") p.field = f[0];
+        else if (f == "rho") p.field = 'r';
+        else throw std::runtime_error("spectrum_probes field must be u, p, T or rho, got: " + f);
+
+        p.z = std::stod(item.substr(at + 1));
+        v.push_back(p);
+    }
+
+    return v;
+}
+
+Spectrum::Spectrum(const Probe& p, int window, double h)
+    : probe_(p), h_(h), buffer_(window, 0.0), due_(window), hann_(window), work_(window), twiddle_(window / 2),
+    power_(window / 2 + 1, 0.0) {
+
+    // Periodic Hann: its transform has exactly three nonzero bins
+    for (int n = 0; n < window; ++n) hann_[n] = 0.5 * (1.0 - std::cos(2.0 * pi * n / window));
+    for (int k = 0; k < window / 2; ++k) twiddle_[k] = std::polar(1.0, -2.0 * pi * k / window);
+}
+
+void Spectrum::add(double t, double x) {
+
+    if (t_last_ < 0.0) {
+        t0_ = t_last_ = t;
+        x_last_ = x;
+    }
+
+    const int W = window();
+
+    // Samples up to t, on the grid t0 + k h; the tolerance keeps a sample
+    // that rounding puts a hair past the step end from slipping a step
+    for (double ts; (ts = t0_ + samples_ * h_) <= t + 1e-9 * h_; ) {
+
+        const double w = t > t_last_ ? std::min(std::max((ts - t_last_) / (t - t_last_), 0.0), 1.0) : 1.0;
+        const double v = x_last_ + w * (x - x_last_);
+
+        buffer_[samples_ % W] = v;
+        sum_ += v;
+        ++samples_;
+
+        if (--due_ == 0) {
+            transform();
+            due_ = W / 2;
+        }
+    }
+
+    t_last_ = t;
+    x_last_ = x;
+}
+
+void Spectrum::transform() {
+
+    const int W = window();
+    const long long oldest = samples_ % W;
+
+    // Least-squares line through the window, about its centre c, so that
+    // a drifting signal does not leak its trend into the low bins
+    const double c = 0.5 * (W - 1);
+    double mean = 0.0, slope = 0.0, var = 0.0;
+
+    for (int n = 0; n < W; ++n) {
+        const double v = buffer_[(oldest + n) % W];
+        mean += v;
+        slope += (n - c) * v;
+        var += (n - c) * (n - c);
+    }
+    mean /= W;
+    slope /= var;
+
+    for (int n = 0; n < W; ++n)
+        work_[n] = (buffer_[(oldest + n) % W] - mean - slope * (n - c)) * hann_[n];
+
+    fft(work_, twiddle_);
+
+    for (int k = 0; k <= W / 2; ++k) power_[k] += std::norm(work_[k]);
+    ++windows_;
+}
+
+std::vector<double> Spectrum::amplitude() const {
+
+    const int W = window();
+    std::vector<double> a(W / 2 + 1, 0.0);
+    if (windows_ == 0) return a;
+
+    // sum(hann) = W / 2
+    for (int k = 0; k <= W / 2; ++k)
+        a[k] = (k == 0 || k == W / 2 ? 1.0 : 2.0) * std::sqrt(power_[k] / windows_) / (0.5 * W);
+
+    return a;
+}
+
+std::vector<Peak> Spectrum::peaks(int count) const {
+
+    const std::vector<double> a = amplitude();
+    std::vector<int> maxima;
+
+    for (int k = 1; k + 1 < static_cast<int>(a.size()); ++k)
+        if (a[k] > a[k - 1] && a[k] >= a[k + 1]) maxima.push_back(k);
+
+    std::sort(maxima.begin(), maxima.end(), [&a](int i, int j) { return a[i] > a[j]; });
+    if (static_cast<int>(maxima.size()) > count) maxima.resize(count);
+
+    std::vector<Peak> peaks;
+
+    for (int k : maxima) {
+
+        const double l = std::log(std::max(a[k - 1], 1e-300));
+        const double c = std::log(a[k]);
+        const double r = std::log(std::max(a[k + 1], 1e-300));
+        const double curvature = l - 2.0 * c + r;
+        const double d = curvature < 0.0 ? std::min(std::max(0.5 * (l - r) / curvature, -0.5), 0.5) : 0.0;
+
+        Peak p;
+        p.frequency = (k + d) * resolution();
+        p.amplitude = std::exp(c - 0.25 * (l - r) * d);
+        peaks.push_back(p);
+    }
+
+    return peaks;
+}
+
+std::vector<double> Spectrum::state() const {
+
+    std::vector<double> s = { t0_, t_last_, x_last_, static_cast<double>(samples_), static_cast<double>(due_), sum_,
+        static_cast<double>(windows_) };
+    s.insert(s.end(), buffer_.begin(), buffer_.end());
+    s.insert(s.end(), power_.begin(), power_.end());
+    return s;
+}
+
+void Spectrum::set_state(const std::vector<double>& s) {
+
+    if (s.size() != 7 + buffer_.size() + power_.size())
+        throw std::runtime_error("Checkpoint spectrum is for another spectrum_window");
+
+    t0_ = s[0];
+    t_last_ = s[1];
+    x_last_ = s[2];
+    samples_ = static_cast<long long>(s[3]);
+    due_ = static_cast<int>(s[4]);
+    sum_ = s[5];
+    windows_ = static_cast<int>(s[6]);
+    std::copy(s.begin() + 7, s.begin() + 7 + buffer_.size(), buffer_.begin());
+    std::copy(s.begin() + 7 + buffer_.size(), s.end(), power_.begin());
+}
+
+Recorder::Recorder(const Input& in, const Solver& s)
+    : start_(in.statistics_start), peaks_(in.spectrum_peaks), fields_on_(in.statistics) {
+
+    if (fields_on_) fields_ = Fields(s.N);
+
+    // Sampled at dt_user, the step the run is set up with
+    for (const Probe& p : probes(in.spectrum_probes))
+        spectra_.emplace_back(p, in.spectrum_window, in.dt_user);
+}
+
+void Recorder::sample(const Solver& s) {
+
+    // Steps that end after start_, a step straddling it counting whole
+    if (s.time_total <= start_) return;
+
+    if (fields_on_) fields_.add(s, s.dt);
+
+    for (Spectrum& sp : spectra_)
+        sp.add(s.time_total, s.probe(field(s, sp.probe().field), sp.probe().z));
+}
+
+void Recorder::write(const std::filesystem::path& dir, const Solver& s, std::ostream& os) const {
+
+    if (fields_on_) {
+        fields_.write(dir / "statistics.csv", s.dz);
+        os << "Statistics over " << fields_.time() << " s from t = " << start_ << " s written to "
+            << (dir / "statistics.csv").string() << std::endl;
+    }
+
+    if (spectra_.empty()) return;
+
+    std::ofstream csv(dir / "spectrum.csv");
+    csv << "frequency";
+    for (const Spectrum& sp : spectra_) csv << "," << label(sp.probe());
+    csv << "\n" << std::setprecision(10);
+
+    std::vector<std::vector<double>> a;
+    for (const Spectrum& sp : spectra_) a.push_back(sp.amplitude());
+
+    for (std::size_t k = 0; k < a[0].size(); ++k) {
+        csv << k * spectra_[0].resolution();
+        for (const std::vector<double>& ak : a) csv << "," << ak[k];
+        csv << "\n";
+    }
+
+    for (const Spectrum& sp : spectra_) {
+
+        const char f = sp.probe().field;
+        os << "Spectrum " << label(sp.probe()) << ": ";
+
+        if (sp.windows() == 0) {
+            os << "fewer than " << sp.window() << " samples, no window transformed" << std::endl;
+            continue;
+        }
+
+        os << sp.windows() << (sp.windows() == 1 ? " window" : " windows") << " of " << sp.window() << ", "
+            << sp.resolution() << " Hz bins, mean " << sp.mean() << " " << unit(f);
+
+        for (const Peak& p : sp.peaks(peaks_))
+            os << "; " << p.frequency << " Hz, " << p.amplitude << " " << unit(f);
+        os << std::endl;
+    }
+
+    os << "Spectra written to " << (dir / "spectrum.csv").string() << std::endl;
+}
+
+void Recorder::save(std::vector<checkpoint::Field>& fields) const {
+
+    if (fields_on_)
+        fields.push_back({ "statistics", fields_.state().data(), fields_.state().size() });
+
+    saved_.clear();
+    for (const Spectrum& sp : spectra_) saved_.push_back(sp.state());
+
+    for (std::size_t k = 0; k < saved_.size(); ++k)
+        fields.push_back({ "spectrum_" + std::to_string(k), saved_[k].data(), saved_[k].size() });
+}
+
+void Recorder::restore(const checkpoint::Snapshot& snap) {
+
+    if (fields_on_ && snap.fields.count("statistics"))
+        fields_.set_state(snap.fields.at("statistics"));
+
+    for (std::size_t k = 0; k < spectra_.size(); ++k) {
+        const std::string name = "spectrum_" + std::to_string(k);
+        if (snap.fields.count(name)) spectra_[k].set_state(snap.fields.at(name));
+    }
+}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <complex>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "input.h"
+#include "solver.h"
+
+namespace statistics {
+
+    // Per-cell statistics of u, p, T and rho over time. Every step is a
+    // sample weighted by its dt, accumulated with the weighted Welford
+    // update (West 1979),
+    //
+    //     W += w,  d = x - mean,  mean += w / W d,  M2 += w d (x - mean)
+    //
+    // which does not lose the fluctuation to cancellation as sum(x^2) -
+    // W mean^2 would over a long run. rms = sqrt(M2 / W) is the RMS of the
+    // fluctuation about the mean.
+    class Fields {
+    public:
+        Fields() = default;
+        explicit Fields(int N);
+
+        void add(const Solver& s, double w);
+
+        double time() const { return state_.empty() ? 0.0 : state_[0]; }    // W [s]
+
+        // z, then mean, rms, min, max of u, p, T and rho; one line per cell
+        void write(const std::filesystem::path& file, double dz) const;
+
+        // [W, mean, M2, min, max], each of the last four u, p, T, rho x N
+        const std::vector<double>& state() const { return state_; }
+        void set_state(const std::vector<double>& state);
+
+    private:
+        int N_ = 0;
+        std::vector<double> state_;
+    };
+
+    // Probe signal: a field at a position
+    struct Probe {
+        char field = 'p';                   // u, p, T or r (rho)
+        double z = 0.0;                     // Position [m]
+    };
+
+    // "p@0.5, u@0.9"
+    std::vector<Probe> probes(const std::string& list);
+
+    struct Peak {
+        double frequency = 0.0;             // [Hz]
+        double amplitude = 0.0;             // Of the sinusoid, in the field's unit
+    };
+
+    // Streaming Welch spectrum of one probe signal. The signal is
+    // resampled at a fixed interval h by linear interpolation between the
+    // step ends, so shortened steps (schedule breakpoints, restarts) do
+    // not distort it. Every `window` samples, with half a window of overlap,
+    // the window less its least-squares line is multiplied by a Hann window
+    // and transformed (radix-2 FFT), and |X_k|^2 is accumulated. The single-sided
+    // amplitude spectrum 2 sqrt(mean |X_k|^2) / sum(hann) is the amplitude
+    // of a sinusoid on bin k. Memory and work per step are independent of
+    // the run length.
+    class Spectrum {
+    public:
+        Spectrum(const Probe& p, int window, double h);
+
+        // Value at the end of a step ending at t
+        void add(double t, double x);
+
+        int windows() const { return windows_; }
+        int window() const { return static_cast<int>(buffer_.size()); }
+        double resolution() const { return 1.0 / (h_ * buffer_.size()); }     // Bin spacing [Hz]
+        double mean() const { return samples_ > 0 ? sum_ / samples_ : 0.0; }  // Of all samples
+
+        // Bins 0 ... window / 2
+        std::vector<double> amplitude() const;
+
+        // The `count` largest local maxima, the frequency and amplitude
+        // interpolated by a parabola through the log amplitude of the peak
+        // bin and its neighbours (exact for a Gaussian, within a few % for
+        // the Hann main lobe)
+        std::vector<Peak> peaks(int count) const;
+
+        const Probe& probe() const { return probe_; }
+
+        // Resampler, ring buffer and accumulated power, for checkpoints
+        std::vector<double> state() const;
+        void set_state(const std::vector<double>& state);
+
+    private:
+        void transform();
+
+        Probe probe_;
+        double h_ = 0.0;                    // Sample interval [s]
+
+        double t_last_ = -1.0;              // End of the last step, < 0 before the first [s]
+        double x_last_ = 0.0;
+        double t0_ = 0.0;                   // First sample; sample k is at t0 + k h [s]
+
+        std::vector<double> buffer_;        // Last `window` samples, a ring
+        long long samples_ = 0;             // Taken in total [-]
+        int due_ = 0;                       // Samples to the next transform [-]
+        double sum_ = 0.0;                  // Of all samples
+
+        std::vector<double> hann_;
+        std::vector<std::complex<double>> work_;
+        std::vector<std::complex<double>> twiddle_;     // exp(-2 pi i k / window), k < window / 2
+        std::vector<double> power_;         // Sum of |X_k|^2 over the windows
+        int windows_ = 0;
+    };
+
+    // What the file driver accumulates from statistics_start on
+    class Recorder {
+    public:
+        Recorder(const Input& in, const Solver& s);
+
+        bool empty() const { return !fields_on_ && spectra_.empty(); }
+
+        // After every step
+        void sample(const Solver& s);
+
+        // statistics.csv and spectrum.csv into `dir`, and one line per
+        // probe with its dominant frequencies
+        void write(const std::filesystem::path& dir, const Solver& s, std::ostream& os) const;
+
+        // "statistics" and "spectrum_<k>" checkpoint fields; restore takes
+        // those present in the snapshot
+        void save(std::vector<checkpoint::Field>& fields) const;
+        void restore(const checkpoint::Snapshot& snap);
+
+    private:
+        double start_ = 0.0;                // [s]
+        int peaks_ = 3;                     // [-]
+        bool fields_on_ = false;
+        Fields fields_;
+        std::vector<Spectrum> spectra_;
+        mutable std::vector<std::vector<double>> saved_;    // Spectrum states while a checkpoint is written
+    };
+}
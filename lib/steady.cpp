@@ -0,0 +1,296 @@
+#include "steady.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "tdma.h"
+
+namespace steady {
+
+namespace {
+
+constexpr int reach = 2;                // Cells a residual reaches to each side
+constexpr int colours = vars * (2 * reach + 1);
+
+// Forward-mode dual number: a value and its derivative along one direction
+struct Dual {
+    double v = 0.0;
+    double d = 0.0;
+
+    Dual() = default;
+    Dual(double v, double d = 0.0) : v(v), d(d) {}
+};
+
+inline Dual operator+(Dual a, Dual b) { return { a.v + b.v, a.d + b.d }; }
+inline Dual operator-(Dual a, Dual b) { return { a.v - b.v, a.d - b.d }; }
+inline Dual operator-(Dual a) { return { -a.v, -a.d }; }
+inline Dual operator*(Dual a, Dual b) { return { a.v * b.v, a.d * b.v + a.v * b.d }; }
+inline Dual operator/(Dual a, Dual b) { return { a.v / b.v, (a.d * b.v - a.v * b.d) / (b.v * b.v) }; }
+
+inline double value(double x) { return x; }
+inline double value(const Dual& x) { return x.v; }
+
+// std::max(x, 0.0) of the assembly
+template <typename R>
+R positive(const R& x) { return value(x) > 0.0 ? x : R(0.0); }
+
+// Same arithmetic as Solver::step with old = new, so the time terms
+// cancel except inside bVU
+template <typename R>
+void evaluate(const Solver& s, const std::vector<R>& q, std::vector<R>& r, std::vector<R>& face) {
+
+    const int N = s.N;
+    const double dz = s.dz;
+    const double* A = s.area.data();
+    const double* Af = s.area_face.data();
+
+    const auto u = [&](int i) -> const R& { return q[vars * i]; };
+    const auto p = [&](int i) -> const R& { return q[vars * i + 1]; };
+    const auto T = [&](int i) -> const R& { return q[vars * i + 2]; };
+    const auto b = [&](int i) -> const R& { return q[vars * i + 3]; };
+    const auto rho = [&](int i) { return p(i) / (s.Rv * T(i)); };
+
+    // Padded pressure: the BC value beyond a Dirichlet end, the end cell
+    // beyond a Neumann one
+    const auto pad = [&](int j) -> R {
+        if (j < 0) return s.p_inlet_bc == 0 ? R(s.p_inlet_value) : p(0);
+        if (j >= N) return s.p_outlet_bc == 0 ? R(s.p_outlet_value) : p(N - 1);
+        return p(j);
+    };
+
+    // Mass fluxes of the faces f = 1 ... N-1, west of cell f [kg/s]
+    face.resize(N);
+
+    for (int f = 1; f < N; ++f) {
+
+        const R inv = 0.5 * (A[f - 1] / b(f - 1) + A[f] / b(f));
+        const R rc = -inv / 4.0 * (pad(f - 2) - 3.0 * pad(f - 1) + 3.0 * pad(f) - pad(f + 1));
+        const R uf = s.rhie_chow_on_off_v ? 0.5 * (u(f - 1) + u(f)) + rc : 0.5 * (u(f - 1) + u(f));
+
+        face[f] = (value(uf) >= 0.0 ? rho(f - 1) : rho(f)) * uf * Af[f];
+    }
+
+    for (int i = 1; i < N - 1; ++i) {
+
+        const R& Fl = face[i];
+        const R& Fr = face[i + 1];
+
+        // Momentum and the bVU it is assembled with
+        const double D_l = (4.0 / 3.0) * s.mu / dz * Af[i];
+        const double D_r = (4.0 / 3.0) * s.mu / dz * Af[i + 1];
+
+        const R time = rho(i) * dz / s.dt * A[i];
+        const R diag = positive(Fr) + positive(-Fl) + time + D_l + D_r;
+
+        r[vars * i + momentum] = (-positive(Fl) - D_l) * u(i - 1) + (diag - time) * u(i) + (-positive(-Fr) - D_r) * u(i + 1)
+            + 0.5 * A[i] * (p(i + 1) - p(i - 1)) - s.S_u[i] * dz * A[i];
+
+        r[vars * i + diagonal] = b(i) - diag;
+
+        // Continuity
+        r[vars * i + continuity] = Fr - Fl - s.S_m[i] * dz * A[i];
+
+        // Energy
+        const double K_l = s.k / dz * Af[i];
+        const double K_r = s.k / dz * Af[i + 1];
+
+        const R Cl = Fl * s.cp;
+        const R Cr = Fr * s.cp;
+
+        const R du_r = u(i + 1) - u(i);
+        const R su_l = u(i) + u(i - 1);
+        const R dissipation = 4.0 / 3.0 * 0.25 * s.mu * (du_r * du_r + su_l * su_l) / dz * A[i];
+
+        r[vars * i + energy] = (-K_l - positive(Cl)) * T(i - 1) + (positive(Cr) + positive(-Cl) + K_l + K_r) * T(i)
+            + (-K_r - positive(-Cr)) * T(i + 1)
+            - u(i) * (p(i + 1) - p(i - 1)) / 2.0 * A[i] - dissipation - s.S_h[i] * dz * A[i];
+    }
+
+    // Boundary rows: value or zero gradient, and the end cell bVU
+    const double D_end = (4.0 / 3.0) * s.mu / dz;
+
+    const auto ends = [&](int i, int j, bool u_bc, double u_value, bool p_bc, double p_value, bool T_bc, double T_value, double sign) {
+
+        r[vars * i + momentum] = u_bc == 0 ? u(i) - u_value : u(i) - u(j);
+        r[vars * i + continuity] = p_bc == 0 ? p(i) - p_value : p(i) - p(j);
+        r[vars * i + energy] = T_bc == 0 ? T(i) - T_value : T(i) - T(j);
+
+        const R uf = 0.5 * u(j);
+        const R F = ((value(uf) >= 0.0) == (sign > 0.0) ? rho(i) : rho(j)) * uf;
+
+        r[vars * i + diagonal] = b(i) - (rho(i) * dz / s.dt + 2.0 * D_end + sign * F) * A[i];
+    };
+
+    ends(0, 1, s.u_inlet_bc, s.u_inlet_value, s.p_inlet_bc, s.p_inlet_value, s.T_inlet_bc, s.T_inlet_value, 1.0);
+    ends(N - 1, N - 2, s.u_outlet_bc, s.u_outlet_value, s.p_outlet_bc, s.p_outlet_value, s.T_outlet_bc, s.T_outlet_value, -1.0);
+}
+
+std::size_t block_size() { return static_cast<std::size_t>(block) * block; }
+}
+
+std::vector<double> state(const Solver& s) {
+
+    std::vector<double> q(vars * s.N);
+
+    for (int i = 0; i < s.N; ++i) {
+        q[vars * i] = s.u_v[i];
+        q[vars * i + 1] = s.p_v[i];
+        q[vars * i + 2] = s.T_v[i];
+        q[vars * i + 3] = s.bVU[i];
+    }
+
+    return q;
+}
+
+void store(Solver& s, const std::vector<double>& q) {
+
+    for (int i = 0; i < s.N; ++i) {
+        s.u_v[i] = q[vars * i];
+        s.p_v[i] = q[vars * i + 1];
+        s.T_v[i] = q[vars * i + 2];
+        s.bVU[i] = q[vars * i + 3];
+        s.rho_v[i] = s.p_v[i] / (s.Rv * s.T_v[i]);
+    }
+
+    for (int i = 0; i < s.N; ++i) s.p_storage_v[i + 1] = s.p_v[i];
+    s.p_storage_v[0] = s.p_inlet_bc == 0 ? s.p_inlet_value : s.p_v[0];
+    s.p_storage_v[s.N + 1] = s.p_outlet_bc == 0 ? s.p_outlet_value : s.p_v[s.N - 1];
+
+    s.u_v_old = s.u_v;
+    s.p_v_old = s.p_v;
+    s.T_v_old = s.T_v;
+    s.rho_v_old = s.rho_v;
+}
+
+void residual(const Solver& s, const std::vector<double>& q, std::vector<double>& r) {
+
+    std::vector<double> face;
+    r.assign(vars * s.N, 0.0);
+    evaluate(s, q, r, face);
+}
+
+Norms norms(const Solver& s, const std::vector<double>& r) {
+
+    Norms n;
+
+    for (int i = 1; i < s.N - 1; ++i) {
+        n.momentum = std::max(n.momentum, std::fabs(r[vars * i + momentum]) / s.area[i]);
+        n.continuity = std::max(n.continuity, std::fabs(r[vars * i + continuity]) / s.area[i]);
+        n.energy = std::max(n.energy, std::fabs(r[vars * i + energy]) / s.area[i]);
+    }
+
+    return n;
+}
+
+Jacobian jacobian(const Solver& s, const std::vector<double>& q) {
+
+    const int N = s.N;
+    const int M = (N + 1) / 2;                          // Block rows
+    const std::size_t bb = block_size();
+
+    if (N < 5)
+        throw std::runtime_error("Steady Jacobian: at least 5 cells are needed");
+
+    Jacobian J;
+    J.N = N;
+    J.lower.assign(M * bb, 0.0);
+    J.diag.assign(M * bb, 0.0);
+    J.upper.assign(M * bb, 0.0);
+
+    std::vector<Dual> qd(vars * N), rd(vars * N), face;
+
+    for (int c = 0; c < colours; ++c) {
+
+        const int v = c % vars;
+        const int m = c / vars;
+
+        for (int k = 0; k < vars * N; ++k)
+            qd[k] = Dual(q[k], k % vars == v && (k / vars) % (2 * reach + 1) == m ? 1.0 : 0.0);
+
+        evaluate(s, qd, rd, face);
+
+        for (int i = 0; i < N; ++i) {
+
+            const int j = i - reach + ((m - (i - reach)) % (2 * reach + 1) + (2 * reach + 1)) % (2 * reach + 1);
+            if (j < 0 || j >= N) continue;
+
+            const int bi = i / 2;
+            const int bj = j / 2;
+            double* blk = bj < bi ? &J.lower[bi * bb] : bj == bi ? &J.diag[bi * bb] : &J.upper[bi * bb];
+
+            for (int e = 0; e < vars; ++e)
+                blk[(vars * (i % 2) + e) * block + vars * (j % 2) + v] = rd[vars * i + e].d;
+        }
+    }
+
+    // Odd N: the second cell of the last block is a dummy with x = 0
+    if (N % 2 == 1)
+        for (int e = vars; e < block; ++e) J.diag[(M - 1) * bb + e * block + e] = 1.0;
+
+    return J;
+}
+
+void solve(const Jacobian& J, std::vector<double>& d, bool transposed) {
+
+    const int M = (J.N + 1) / 2;
+    const std::size_t bb = block_size();
+
+    std::vector<double> a, b, c;
+
+    if (!transposed) {
+        a = J.lower;
+        b = J.diag;
+        c = J.upper;
+    }
+    else {
+        // Block row k of J^T holds upper[k-1]^T, diag[k]^T, lower[k+1]^T
+        a.assign(M * bb, 0.0);
+        b.assign(M * bb, 0.0);
+        c.assign(M * bb, 0.0);
+
+        for (int k = 0; k < M; ++k)
+            for (int x = 0; x < block; ++x)
+                for (int y = 0; y < block; ++y) {
+                    b[k * bb + x * block + y] = J.diag[k * bb + y * block + x];
+                    if (k > 0) a[k * bb + x * block + y] = J.upper[(k - 1) * bb + y * block + x];
+                    if (k < M - 1) c[k * bb + x * block + y] = J.lower[(k + 1) * bb + y * block + x];
+                }
+    }
+
+    const std::size_t n = vars * static_cast<std::size_t>(J.N);
+    d.resize(static_cast<std::size_t>(M) * block, 0.0);
+    tdma::solve_block(block, a, b, c, d);
+    d.resize(n);
+}
+
+// Steps until no field changes by more than `tol` of its largest magnitude
+// in one step; returns the steps taken, or -1 if `max_steps` ran out
+int settle(Solver& s, int max_steps, double tol) {
+
+    heap::vector<double> u, p, T;
+
+    for (int n = 1; n <= max_steps; ++n) {
+
+        u = s.u_v;
+        p = s.p_v;
+        T = s.T_v;
+        s.step();
+
+        double change = 0.0;
+        for (const auto& f : { std::make_pair(&u, &s.u_v), std::make_pair(&p, &s.p_v), std::make_pair(&T, &s.T_v) }) {
+
+            double scale = 1e-300, diff = 0.0;
+            for (int i = 0; i < s.N; ++i) {
+                scale = std::max(scale, std::fabs((*f.second)[i]));
+                diff = std::max(diff, std::fabs((*f.second)[i] - (*f.first)[i]));
+            }
+            change = std::max(change, diff / scale);
+        }
+
+        if (change <= tol) return n;
+    }
+
+    return -1;
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "solver.h"
+
+namespace steady {
+
+    // Steady discrete equations of the 1D solver, shared by the adjoint and
+    // the continuation driver.
+    //
+    // The unknowns of cell i are q[4i ...] = u, p, T and the momentum
+    // diagonal bVU, which the Rhie-Chow face velocities depend on; rho is
+    // p / (Rv T). The residuals are the solver's own momentum, continuity
+    // and energy rows with the time terms cancelled (old = new), the
+    // definition of bVU and the boundary rows, all with the sources,
+    // properties and boundary values the Solver holds. Every residual
+    // reaches two cells to each side (the Rhie-Chow pressure stencil), so
+    // with pairs of cells as blocks the Jacobian is block tridiagonal with
+    // 8 x 8 blocks.
+    constexpr int vars = 4;                     // u, p, T, bVU per cell
+    constexpr int block = 2 * vars;             // Two cells per block row
+
+    // Residual rows of a cell
+    enum Row { momentum = 0, continuity = 1, energy = 2, diagonal = 3 };
+
+    // q of the solver's current fields
+    std::vector<double> state(const Solver& s);
+
+    // Writes q back to the solver's fields, rho on the equation of state,
+    // and makes it the old time level
+    void store(Solver& s, const std::vector<double>& q);
+
+    // R(q) in the solver's units: momentum [N], continuity [kg/s], energy
+    // [W], bVU definition [kg/s]
+    void residual(const Solver& s, const std::vector<double>& q, std::vector<double>& r);
+
+    // Largest interior residuals per unit area: momentum [N/m2],
+    // continuity [kg/(m2 s)], energy [W/m2]
+    struct Norms {
+        double momentum = 0.0;
+        double continuity = 0.0;
+        double energy = 0.0;
+    };
+
+    Norms norms(const Solver& s, const std::vector<double>& r);
+
+    // dR/dq, exact: forward-mode dual numbers in 20 coloured sweeps (the
+    // columns (j, v) with equal j mod 5 never meet in a residual)
+    struct Jacobian {
+        int N = 0;                              // Cells [-]
+        std::vector<double> lower, diag, upper; // 8 x 8 blocks per block row, row-major
+    };
+
+    Jacobian jacobian(const Solver& s, const std::vector<double>& q);
+
+    // Solves J x = d, or J^T x = d, by block Thomas; d holds 4N values and
+    // is overwritten by x. J is left unchanged.
+    void solve(const Jacobian& J, std::vector<double>& d, bool transposed = false);
+
+    // Steps until no field changes by more than `tol` of its largest
+    // magnitude in one step; returns the steps taken, or -1 if `max_steps`
+    // ran out
+    int settle(Solver& s, int max_steps, double tol);
+}
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <omp.h>
+
+namespace stencil {
+
+    // Header-only expression templates for the tridiagonal rows of the
+    // 1D transport equations.
+    //
+    // An expression is built from cell fields, shifts and scalars with
+    // + - * / and evaluated lazily, in exactly the order written, at an
+    // index. Face quantities are expressions of the face index: face f lies
+    // between cells f - 1 and f, so cell i has face i to the west and face
+    // i + 1 to the east.
+    //
+    // A row is assembled from face variables and terms. The face variables
+    // (see faces) are evaluated at each face of the row, in order, and are
+    // read back with var<k>(); terms then add to the coefficients a (west),
+    // b (diagonal), c (east) and the right-hand side d, in the order they
+    // are listed. The accumulators start at -0.0, which x + -0.0 leaves
+    // exact, so a row comes out bit for bit as the same sum written by hand.
+    template <class F>
+    struct Expr {
+        F f;
+        template <class R>
+        double operator()(const R& row, int i) const { return f(row, i); }
+    };
+
+    template <class T> struct is_expr : std::false_type {};
+    template <class F> struct is_expr<Expr<F>> : std::true_type {};
+
+    template <class F>
+    Expr<F> make(F f) { return { f }; }
+
+    // Cell field x[i]
+    inline auto field(const double* x) { return make([x](const auto&, int i) { return x[i]; }); }
+
+    template <class V, class = decltype(std::declval<const V&>().data())>
+    auto field(const V& x) { return field(x.data()); }
+
+    // x[i + k]
+    template <int k, class E>
+    auto shift(const E& x) { return make([x](const auto& row, int i) { return x(row, i + k); }); }
+
+    // Face variable k of the row, at its west or east face
+    template <int k>
+    auto var() { return make([](const auto& row, int f) { return row.template face<k>(f); }); }
+
+    // -------------------------------------------------------------------
+    // Arithmetic: expression with expression, or with an arithmetic scalar
+    // -------------------------------------------------------------------
+
+    template <class A>
+    using if_expr = std::enable_if_t<is_expr<A>::value, int>;
+
+    template <class A, class B>
+    using if_exprs = std::enable_if_t<is_expr<A>::value && is_expr<B>::value, int>;
+
+    template <class A, class S>
+    using if_scalar = std::enable_if_t<is_expr<A>::value && std::is_arithmetic<S>::value, int>;
+
+#define STENCIL_OPERATOR(op)                                                                    \
+    template <class A, class B, if_exprs<A, B> = 0>                                             \
+    auto operator op(const A& x, const B& y) {                                                  \
+        return make([x, y](const auto& row, int i) { return x(row, i) op y(row, i); });         \
+    }                                                                                           \
+    template <class A, class S, if_scalar<A, S> = 0>                                            \
+    auto operator op(const A& x, S s) {                                                         \
+        const double y = s;                                                                     \
+        return make([x, y](const auto& row, int i) { return x(row, i) op y; });                 \
+    }                                                                                           \
+    template <class A, class S, if_scalar<A, S> = 0>                                            \
+    auto operator op(S s, const A& y) {                                                         \
+        const double x = s;                                                                     \
+        return make([x, y](const auto& row, int i) { return x op y(row, i); });                 \
+    }
+
+    STENCIL_OPERATOR(+)
+    STENCIL_OPERATOR(-)
+    STENCIL_OPERATOR(*)
+    STENCIL_OPERATOR(/)
+
+#undef STENCIL_OPERATOR
+
+    template <class A, if_expr<A> = 0>
+    auto operator-(const A& x) { return make([x](const auto& row, int i) { return -x(row, i); }); }
+
+    // -------------------------------------------------------------------
+    // Face interpolation
+    // -------------------------------------------------------------------
+
+    // The face operators below capture each operand once, whichever cells
+    // they read: a shared capture lets the compiler reuse a value, a
+    // division say, where two copies of the same expression would be
+    // evaluated twice.
+
+    // Linear interpolation to face f: 0.5 (x[f - 1] + x[f])
+    template <class E>
+    auto face_average(const E& x) {
+        return make([x](const auto& row, int f) { return 0.5 * (x(row, f - 1) + x(row, f)); });
+    }
+
+    // Rhie-Chow correction of the face velocity [m/s] from the padded
+    // pressure (pp[-1] and pp[N] are the ghost values) and A / b_U per cell
+    template <class P, class E>
+    auto rhie_chow(const P& pp, const E& inv_b) {
+        return make([pp, inv_b](const auto& row, int f) {
+            return -(0.5 * (inv_b(row, f - 1) + inv_b(row, f))) / 4.0
+                * (pp(row, f - 2) - 3.0 * pp(row, f - 1) + 3.0 * pp(row, f) - pp(row, f + 1));
+        });
+    }
+
+    // Value of x on the upstream side of face f for the face velocity u
+    template <class U, class E>
+    auto upwind(const U& u, const E& x) {
+        return make([u, x](const auto& row, int f) { return u(row, f) >= 0.0 ? x(row, f - 1) : x(row, f); });
+    }
+
+    // -------------------------------------------------------------------
+    // Face variables and terms of a row
+    // -------------------------------------------------------------------
+
+    template <class... E>
+    struct Faces {
+        std::tuple<E...> definitions;
+    };
+
+    // Face variables 0, 1, ... of an equation; a definition may read the
+    // variables before it
+    template <class... E>
+    Faces<E...> faces(const E&... definitions) { return { { definitions... } }; }
+
+    template <int K>
+    struct Row {
+        int i = 0;
+        std::array<double, K> west{}, east{};
+        double a = -0.0, b = -0.0, c = -0.0, d = -0.0;
+
+        template <int k>
+        double face(int f) const { return f == i ? west[k] : east[k]; }
+    };
+
+    // Upwind convection with the face flux F [kg/s, or W/K for energy]
+    template <class E>
+    struct Convection {
+        E F;
+        template <class R>
+        void add(R& r, int i) const {
+            const double w = F(r, i), e = F(r, i + 1);
+            r.a -= std::max(w, 0.0);
+            r.c -= std::max(-e, 0.0);
+            r.b += std::max(e, 0.0);
+            r.b += std::max(-w, 0.0);
+        }
+    };
+
+    // Central diffusion with the face conductance D
+    template <class E>
+    struct Diffusion {
+        E D;
+        template <class R>
+        void add(R& r, int i) const {
+            const double w = D(r, i), e = D(r, i + 1);
+            r.a -= w;
+            r.c -= e;
+            r.b += w;
+            r.b += e;
+        }
+    };
+
+    // Implicit diagonal term, e.g. the new-time part of a time derivative
+    template <class E>
+    struct Implicit {
+        E B;
+        template <class R>
+        void add(R& r, int i) const { r.b += B(r, i); }
+    };
+
+    // Explicit right-hand side term, added or (sink) subtracted
+    template <class E, bool sink>
+    struct Source {
+        E S;
+        template <class R>
+        void add(R& r, int i) const { if constexpr (sink) r.d -= S(r, i); else r.d += S(r, i); }
+    };
+
+    // Time derivative: B on the diagonal, D (the old time level) on the right
+    template <class B, class D>
+    struct Transient {
+        B new_part;
+        D old_part;
+        template <class R>
+        void add(R& r, int i) const { r.b += new_part(r, i); r.d += old_part(r, i); }
+    };
+
+    template <class E> Convection<E> convection(const E& F) { return { F }; }
+    template <class E> Diffusion<E> diffusion(const E& D) { return { D }; }
+    template <class E> Implicit<E> implicit(const E& B) { return { B }; }
+    template <class E> Source<E, false> source(const E& S) { return { S }; }
+    template <class E> Source<E, true> sink(const E& S) { return { S }; }
+    template <class B, class D> Transient<B, D> transient(const B& b, const D& d) { return { b, d }; }
+
+    // -------------------------------------------------------------------
+    // Assembly
+    // -------------------------------------------------------------------
+
+    // Face variables at face f into `side` (west or east) of the row, in
+    // order, so that each definition sees the ones before it
+    template <class D, class R, class S, std::size_t... k>
+    void evaluate(const D& defs, R& r, S& side, int f, std::index_sequence<k...>) {
+        ((side[k] = std::get<k>(defs)(r, f)), ...);
+    }
+
+    // Fills rows [begin, end) of a, b, c, d in one fused loop: per row the
+    // face variables at the east face, then the terms, then one store per
+    // coefficient. The east face of a row is the west face of the next, so
+    // every face is evaluated once, where the hand-written loops did it
+    // twice. A face definition must not read an array the loop writes: a
+    // row would then depend on whether the row before it was already
+    // stored, which threads do not keep. Such an equation reads a copy of
+    // the array instead (momentum's A / b_U, see momentum_predictor).
+    template <class... E, class... Terms>
+    void assemble(bool parallel, int begin, int end, double* a, double* b, double* c, double* d,
+        const Faces<E...>& face_vars, const Terms&... terms)
+    {
+        constexpr int K = sizeof...(E);
+        constexpr auto k = std::make_index_sequence<K>();
+
+        // Rows [lo, hi), starting from the west face of row lo
+        const auto rows = [&](int lo, int hi) {
+
+            // Copies that the compiler sees are not written by the row stores
+            const std::tuple<E...> defs = face_vars.definitions;
+            const std::tuple<Terms...> ts(terms...);
+
+            Row<K> r;
+            r.i = lo;
+            if (lo < hi) evaluate(defs, r, r.west, lo, k);
+
+            for (int i = lo; i < hi; ++i) {
+
+                r.i = i;
+                evaluate(defs, r, r.east, i + 1, k);
+
+                r.a = r.b = r.c = r.d = -0.0;
+                std::apply([&](const auto&... term) { (term.add(r, i), ...); }, ts);
+
+                a[i] = r.a; b[i] = r.b; c[i] = r.c; d[i] = r.d;
+                r.west = r.east;
+            }
+        };
+
+        if (!parallel) {
+            rows(begin, end);
+            return;
+        }
+
+        // Contiguous rows per thread
+        #pragma omp parallel
+        {
+            const int threads = omp_get_num_threads(), t = omp_get_thread_num();
+            rows(begin + static_cast<int>(static_cast<long long>(end - begin) * t / threads),
+                begin + static_cast<int>(static_cast<long long>(end - begin) * (t + 1) / threads));
+        }
+    }
+
+    // Boundary row i (0 or N - 1), scaled by `diag`: Dirichlet (bc 0)
+    // x[i] = value, Neumann (bc 1) x[i] equal to its neighbour; any other
+    // bc leaves the row alone
+    inline void boundary(int bc, double value, double diag, int i, bool last, double* a, double* b, double* c, double* d) {
+
+        if (bc == 0) {
+            a[i] = 0.0;
+            b[i] = diag;
+            c[i] = 0.0;
+            d[i] = b[i] * value;
+        }
+        else if (bc == 1) {
+            a[i] = last ? -diag : 0.0;
+            b[i] = +diag;
+            c[i] = last ? 0.0 : -diag;
+            d[i] = 0.0;
+        }
+    }
+}
@@ -0,0 +1,587 @@
+#include "surrogate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <omp.h>
+
+#include "affinity.h"
+#include "input.h"
+#include "solver.h"
+
+namespace fs = std::filesystem;
+
+namespace surrogate {
+
+namespace {
+
+using Dict = std::unordered_map<std::string, std::string>;
+using Key = std::vector<std::int64_t>;
+
+constexpr double key_scale = 1073741824.0;         // Nodes are multiples of 2^-30
+
+// Comma-separated list, trimmed
+std::vector<std::string> split(const std::string& s) {
+
+    std::vector<std::string> items;
+    std::stringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (!item.empty()) items.push_back(item);
+    }
+
+    return items;
+}
+
+std::vector<double> numbers(const std::string& s) {
+    std::vector<double> v;
+    for (const std::string& item : split(s)) v.push_back(std::stod(item));
+    return v;
+}
+
+// 1D hat of the node x of `level` at y
+double hat(int level, double x, double y) {
+
+    if (level == 1) return 1.0;
+
+    const double h = std::ldexp(1.0, 1 - level);
+    const double d = std::fabs(y - x);
+    return d < h ? 1.0 - d / h : 0.0;
+}
+
+// 1D children of the node x of `level`, at level + 1
+std::vector<double> children(int level, double x) {
+
+    if (level == 1) return { 0.0, 1.0 };
+    if (level == 2) return { x == 0.0 ? 0.25 : 0.75 };
+
+    const double h = std::ldexp(1.0, -level);
+    return { x - h, x + h };
+}
+
+Key key(const std::vector<double>& x) {
+    Key k;
+    for (double xd : x) k.push_back(std::llround(xd * key_scale));
+    return k;
+}
+
+std::string name(const Output& o) {
+    return o.field == 'r' ? "rho" : std::string(1, o.field);
+}
+
+// Larger of a and b, NaN if either is: std::max drops a NaN in b
+double worse(double a, double b) {
+    return std::isnan(a) || std::isnan(b) ? std::numeric_limits<double>::quiet_NaN() : std::max(a, b);
+}
+
+// One run of the base case with the parameters set to `values`; the
+// outputs in the order of the spec
+std::vector<double> run(const Dict& base, const Spec& spec, const std::vector<double>& values) {
+
+    Dict dict = base;
+
+    for (std::size_t d = 0; d < values.size(); ++d) {
+        std::ostringstream v;
+        v << std::setprecision(17) << values[d];
+        dict[spec.parameters[d]] = v.str();
+    }
+
+    const Input in = parseInput(dict);
+    Solver s(in);
+
+    const int time_steps = static_cast<int>(in.simulation_time / in.dt_user);
+    for (int n = 0; n <= time_steps; ++n)
+        s.step();
+
+    std::vector<double> f;
+
+    for (const Output& o : spec.outputs) {
+
+        const heap::vector<double>& x = o.field == 'u' ? s.u_v : o.field == 'p' ? s.p_v : o.field == 'T' ? s.T_v : s.rho_v;
+
+        if (o.z < 0.0) f.insert(f.end(), x.begin(), x.end());
+        else f.push_back(s.probe(x, o.z));
+    }
+
+    // A diverged run would put NaN surpluses into the model
+    if (!std::all_of(f.begin(), f.end(), [](double v) { return std::isfinite(v); }))
+        throw std::runtime_error("non-finite output at the end");
+
+    return f;
+}
+
+std::vector<double> physical(const Spec& spec, const std::vector<double>& y) {
+    std::vector<double> p(y.size());
+    for (std::size_t d = 0; d < y.size(); ++d)
+        p[d] = spec.lower[d] + y[d] * (spec.upper[d] - spec.lower[d]);
+    return p;
+}
+
+// Runs of a batch in parallel, one single-threaded solver per thread
+std::vector<std::vector<double>> run_all(const Dict& base, const Spec& spec, const std::vector<std::vector<double>>& y) {
+
+    std::vector<std::vector<double>> f(y.size());
+    std::vector<std::string> failure(y.size());
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int k = 0; k < static_cast<int>(y.size()); ++k) {
+        try {
+            f[k] = run(base, spec, physical(spec, y[k]));
+        }
+        catch (const std::exception& e) {
+            failure[k] = e.what();
+        }
+    }
+
+    // The failed points, in batch order, the first few in full
+    std::ostringstream failed;
+    int count = 0;
+
+    for (std::size_t k = 0; k < y.size(); ++k) {
+
+        if (failure[k].empty()) continue;
+
+        if (++count <= 3) {
+            const std::vector<double> p = physical(spec, y[k]);
+            failed << "\n  at";
+            for (std::size_t d = 0; d < p.size(); ++d)
+                failed << (d ? ", " : " ") << spec.parameters[d] << " = " << p[d];
+            failed << ": " << failure[k];
+        }
+    }
+
+    if (count > 0)
+        throw std::runtime_error("Surrogate: " + std::to_string(count) + " of " + std::to_string(y.size())
+            + " runs failed" + failed.str() + (count > 3 ? "\n  ..." : ""));
+
+    return f;
+}
+}
+
+Spec readSpec(const std::string& filename) {
+
+    Dict dict = readKeyValues(filename);
+    Spec spec;
+
+    for (const char* key : { "base_input", "parameters", "lower", "upper", "outputs" })
+        if (!dict.count(key))
+            throw std::runtime_error(std::string("Surrogate: missing key ") + key + " in " + filename);
+
+    spec.base_input = dict["base_input"];
+    spec.parameters = split(dict["parameters"]);
+    spec.lower = numbers(dict["lower"]);
+    spec.upper = numbers(dict["upper"]);
+
+    for (const std::string& item : split(dict["outputs"])) {
+
+        const auto at = item.find('@');
+        const std::string field = item.substr(0, at);
+
+        Output o;
+        if (field == "u" || field == "p" || field == "T") o.field = field[0];
+        else if (field == "rho") o.field = 'r';
+        else throw std::runtime_error("Surrogate: output field must be u, p, T or rho, got: " + field);
+
+        if (at != std::string::npos) o.z = std::stod(item.substr(at + 1));
+        spec.outputs.push_back(o);
+    }
+
+    if (dict.count("tolerance")) spec.tolerance = std::stod(dict["tolerance"]);
+    if (dict.count("max_level")) spec.max_level = std::stoi(dict["max_level"]);
+    if (dict.count("max_points")) spec.max_points = std::stoi(dict["max_points"]);
+    if (dict.count("validation_runs")) spec.validation_runs = std::stoi(dict["validation_runs"]);
+
+    const std::size_t d = spec.parameters.size();
+    if (d == 0 || spec.lower.size() != d || spec.upper.size() != d)
+        throw std::runtime_error("Surrogate: parameters, lower and upper must have the same length");
+    for (std::size_t k = 0; k < d; ++k)
+        if (!(spec.upper[k] > spec.lower[k]))
+            throw std::runtime_error("Surrogate: upper must exceed lower for " + spec.parameters[k]);
+    if (spec.outputs.empty())
+        throw std::runtime_error("Surrogate: no outputs");
+    if (d > max_dimensions)
+        throw std::runtime_error("Surrogate: at most " + std::to_string(max_dimensions) + " parameters");
+    if (spec.max_level < 1 || spec.max_level > 30)
+        throw std::runtime_error("Surrogate: max_level must be in [1, 30]");
+
+    return spec;
+}
+
+Model Model::build(const Spec& spec) {
+
+    return build(spec, readKeyValues(spec.base_input), std::cout);
+}
+
+Model Model::build(const Spec& spec, const std::unordered_map<std::string, std::string>& base, std::ostream& log) {
+
+    const int dims = static_cast<int>(spec.parameters.size());
+
+    // The runs of a batch go to the team threads (run_all), pinned to the
+    // slots of the base case's affinity policy
+    affinity::configure(affinity::policy(parseInput(base).affinity));
+    affinity::pin_team();
+    heap::configure(heapSettings(parseInput(base)));
+
+    Model m;
+    m.parameters_ = spec.parameters;
+    m.lower_ = spec.lower;
+    m.upper_ = spec.upper;
+
+    // Generation 0: the centre of the box
+    std::vector<Point> generation(1);
+    generation[0].level.assign(dims, 1);
+    generation[0].x.assign(dims, 0.5);
+
+    std::set<Key> known = { key(generation[0].x) };
+    std::vector<double> lo, hi;                     // Output range over all runs
+
+    for (int g = 0; !generation.empty(); ++g) {
+
+        const double start = omp_get_wtime();
+
+        std::vector<std::vector<double>> y;
+        for (const Point& p : generation) y.push_back(p.x);
+
+        const std::vector<std::vector<double>> f = run_all(base, spec, y);
+
+        if (g == 0) {
+            m.components_ = static_cast<int>(f[0].size());
+            lo = hi = f[0];
+
+            for (const Output& o : spec.outputs) {
+                if (o.z >= 0.0) {
+                    std::ostringstream label;
+                    label << name(o) << "@" << o.z;
+                    m.labels_.push_back(label.str());
+                }
+                else {
+                    for (int i = 0; i < parseInput(base).N; ++i)
+                        m.labels_.push_back(name(o) + "[" + std::to_string(i) + "]");
+                }
+            }
+        }
+
+        // Surpluses against the coarser grid: the hats of a generation
+        // vanish at the nodes of the others of the same level sum
+        std::vector<double> coarse(m.components_);
+        double worst = 0.0;
+
+        for (std::size_t k = 0; k < generation.size(); ++k) {
+
+            if (static_cast<int>(f[k].size()) != m.components_)
+                throw std::runtime_error("Surrogate: the number of outputs changed between runs");
+
+            m.interpolate(generation[k].x.data(), m.points_.size(), coarse.data(), nullptr);
+
+            generation[k].surplus.resize(m.components_);
+            for (int c = 0; c < m.components_; ++c) {
+                generation[k].surplus[c] = f[k][c] - coarse[c];
+                lo[c] = std::min(lo[c], f[k][c]);
+                hi[c] = std::max(hi[c], f[k][c]);
+            }
+        }
+
+        // Largest surplus relative to the output range, per point
+        std::vector<double> relative(generation.size(), 0.0);
+
+        for (std::size_t k = 0; k < generation.size(); ++k) {
+            for (int c = 0; c < m.components_; ++c) {
+                const double range = std::max(hi[c] - lo[c], 1.0e-12 * std::max(std::fabs(hi[c]), std::fabs(lo[c])));
+                relative[k] = worse(relative[k], range > 0.0 ? std::fabs(generation[k].surplus[c]) / range : 0.0);
+            }
+            worst = worse(worst, relative[k]);
+        }
+
+        const std::size_t first = m.points_.size();
+        m.points_.insert(m.points_.end(), generation.begin(), generation.end());
+
+        log << "Generation " << g << ": " << generation.size() << " runs in " << std::fixed << std::setprecision(2)
+            << omp_get_wtime() - start << " s, " << m.points_.size() << " points";
+        if (g > 0)
+            log << ", largest relative surplus " << std::scientific << worst;
+        log << std::defaultfloat << std::endl;
+
+        // Refinement: children of the points above the tolerance, the
+        // largest surpluses first while the point budget lasts
+        std::vector<std::size_t> order(generation.size());
+        for (std::size_t k = 0; k < order.size(); ++k) order[k] = k;
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return relative[a] > relative[b]; });
+
+        std::vector<Point> next;
+
+        for (std::size_t k : order) {
+
+            if (relative[k] <= spec.tolerance) break;
+
+            const Point& parent = m.points_[first + k];
+
+            for (int d = 0; d < dims; ++d) {
+
+                if (parent.level[d] >= spec.max_level) continue;
+
+                for (double xc : children(parent.level[d], parent.x[d])) {
+
+                    Point child;
+                    child.level = parent.level;
+                    child.x = parent.x;
+                    child.level[d] += 1;
+                    child.x[d] = xc;
+
+                    if (m.points_.size() + next.size() >= static_cast<std::size_t>(spec.max_points)) break;
+                    if (known.insert(key(child.x)).second) next.push_back(child);
+                }
+            }
+        }
+
+        generation = std::move(next);
+    }
+
+    // Leaves: no child on the grid
+    for (Point& p : m.points_) {
+        for (int d = 0; d < dims && p.leaf; ++d) {
+            if (p.level[d] >= 30) continue;
+            for (double xc : children(p.level[d], p.x[d])) {
+                std::vector<double> x = p.x;
+                x[d] = xc;
+                if (known.count(key(x))) p.leaf = false;
+            }
+        }
+    }
+
+    return m;
+}
+
+void Model::interpolate(const double* y, std::size_t count, double* out, double* error) const {
+
+    std::fill(out, out + components_, 0.0);
+    if (error) std::fill(error, error + components_, 0.0);
+
+    const int dims = dimensions();
+
+    for (std::size_t i = 0; i < count; ++i) {
+
+        const Point& p = points_[i];
+
+        double phi = 1.0;
+        for (int d = 0; d < dims && phi != 0.0; ++d)
+            phi *= hat(p.level[d], p.x[d], y[d]);
+
+        if (phi == 0.0) continue;
+
+        for (int c = 0; c < components_; ++c)
+            out[c] += phi * p.surplus[c];
+
+        if (error && p.leaf)
+            for (int c = 0; c < components_; ++c)
+                error[c] += phi * std::fabs(p.surplus[c]);
+    }
+}
+
+void Model::evaluate(const double* p, double* out, double* error) const {
+
+    double y[max_dimensions];
+    for (int d = 0; d < dimensions(); ++d)
+        y[d] = std::min(std::max((p[d] - lower_[d]) / (upper_[d] - lower_[d]), 0.0), 1.0);
+
+    interpolate(y, points_.size(), out, error);
+}
+
+void Model::save(const std::string& filename) const {
+
+    // load() could not read them back
+    for (const Point& p : points_)
+        if (!std::all_of(p.surplus.begin(), p.surplus.end(), [](double w) { return std::isfinite(w); }))
+            throw std::runtime_error("Surrogate: non-finite surplus, not writing " + filename);
+
+    std::ofstream out(filename);
+    if (!out)
+        throw std::runtime_error("Surrogate: cannot write " + filename);
+
+    const auto list = [&out](const char* key, const auto& items) {
+        out << key << " =";
+        for (std::size_t k = 0; k < items.size(); ++k) out << (k ? ", " : " ") << items[k];
+        out << "\n";
+    };
+
+    out << std::setprecision(17);
+    out << "# rhoPISO sparse-grid surrogate: per point the levels, the nodes in [0, 1],\n"
+        << "# the leaf flag and the surplus of every component\n";
+    list("parameters", parameters_);
+    list("lower", lower_);
+    list("upper", upper_);
+    list("components", labels_);
+    out << "points = " << points_.size() << "\n";
+
+    for (const Point& p : points_) {
+        for (int l : p.level) out << l << " ";
+        for (double x : p.x) out << x << " ";
+        out << p.leaf;
+        for (double w : p.surplus) out << " " << w;
+        out << "\n";
+    }
+}
+
+Model Model::load(const std::string& filename) {
+
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Surrogate: cannot open " + filename);
+
+    Model m;
+    std::string line;
+    std::size_t count = 0;
+
+    // Header up to the point count
+    while (std::getline(in, line)) {
+
+        if (line.empty() || line[0] == '#') continue;
+
+        const auto eq = line.find('=');
+        if (eq == std::string::npos) break;
+
+        std::string key = line.substr(0, eq);
+        key.erase(key.find_last_not_of(" \t") + 1);
+        const std::string value = line.substr(eq + 1);
+
+        if (key == "parameters") m.parameters_ = split(value);
+        else if (key == "lower") m.lower_ = numbers(value);
+        else if (key == "upper") m.upper_ = numbers(value);
+        else if (key == "components") m.labels_ = split(value);
+        else if (key == "points") { count = std::stoul(value); break; }
+    }
+
+    const int dims = m.dimensions();
+    m.components_ = static_cast<int>(m.labels_.size());
+
+    if (dims == 0 || dims > max_dimensions || m.lower_.size() != static_cast<std::size_t>(dims) || m.upper_.size() != static_cast<std::size_t>(dims))
+        throw std::runtime_error("Surrogate: bad header in " + filename);
+
+    m.points_.resize(count);
+
+    for (Point& p : m.points_) {
+
+        p.level.resize(dims);
+        p.x.resize(dims);
+        p.surplus.resize(m.components_);
+
+        for (int& l : p.level) in >> l;
+        for (double& x : p.x) in >> x;
+        in >> p.leaf;
+        for (double& w : p.surplus) in >> w;
+    }
+
+    if (!in)
+        throw std::runtime_error("Surrogate: truncated file " + filename);
+
+    return m;
+}
+
+int build(const std::string& specFile) {
+
+    const Spec spec = readSpec(specFile);
+    const Input base = readInput(spec.base_input);
+    if (base.threads > 0) omp_set_num_threads(base.threads);
+
+    std::cout << "Sparse-grid surrogate of " << spec.base_input << " over " << spec.parameters.size()
+        << " parameters, " << omp_get_max_threads() << " runs at a time" << std::endl;
+
+    const double start = omp_get_wtime();
+    Model m;
+    try {
+        m = Model::build(spec);
+    }
+    catch (const std::exception& e) {
+        // Failed runs leave no model to write
+        std::cerr << e.what() << "\nNo model written" << std::endl;
+        return 1;
+    }
+    const double wall = omp_get_wtime() - start;
+
+    const fs::path outputDir = fs::path("output") / "surrogate";
+    fs::create_directories(outputDir);
+    const fs::path file = outputDir / (fs::path(specFile).filename().string() + ".sg");
+    m.save(file.string());
+
+    std::cout << m.points() << " runs in " << wall << " s, model written to " << file.string() << std::endl;
+
+    if (spec.validation_runs <= 0) return 0;
+
+    // Check against runs at random points: actual error vs estimate
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    std::vector<std::vector<double>> y(spec.validation_runs, std::vector<double>(m.dimensions()));
+    for (auto& point : y)
+        for (double& v : point) v = unit(rng);
+
+    const Dict dict = readKeyValues(spec.base_input);
+    const std::vector<std::vector<double>> f = run_all(dict, spec, y);
+
+    std::vector<double> worst(m.components(), 0.0), estimate(m.components(), 0.0);
+    std::vector<double> out(m.components()), err(m.components());
+
+    for (std::size_t k = 0; k < y.size(); ++k) {
+
+        m.evaluate(physical(spec, y[k]).data(), out.data(), err.data());
+
+        for (int c = 0; c < m.components(); ++c) {
+            worst[c] = worse(worst[c], std::fabs(out[c] - f[k][c]));
+            estimate[c] = worse(estimate[c], err[c]);
+        }
+    }
+
+    std::cout << "\nValidation at " << y.size() << " random points (largest over the points)\n"
+        << std::setw(14) << "output" << std::setw(14) << "error" << std::setw(14) << "estimate" << "\n"
+        << std::scientific << std::setprecision(3);
+
+    const int shown = std::min(m.components(), 12);
+    for (int c = 0; c < shown; ++c)
+        std::cout << std::setw(14) << m.labels()[c] << std::setw(14) << worst[c] << std::setw(14) << estimate[c] << "\n";
+    if (shown < m.components())
+        std::cout << "(" << m.components() - shown << " more components)\n";
+    std::cout << std::defaultfloat;
+
+    return 0;
+}
+
+int query(const std::string& modelFile, const std::vector<double>& values) {
+
+    const Model m = Model::load(modelFile);
+
+    if (static_cast<int>(values.size()) != m.dimensions())
+        throw std::runtime_error("Surrogate: expected " + std::to_string(m.dimensions()) + " parameter values");
+
+    std::vector<double> out(m.components()), err(m.components());
+
+    // Timed over repeated evaluations, to show the cost of a query
+    const int repeats = 1000;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r)
+        m.evaluate(values.data(), out.data(), err.data());
+    const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+    for (int d = 0; d < m.dimensions(); ++d)
+        std::cout << m.parameters()[d] << " = " << values[d] << "\n";
+
+    std::cout << std::setprecision(8);
+    for (int c = 0; c < m.components(); ++c)
+        std::cout << m.labels()[c] << " = " << out[c] << "    # +- " << std::setprecision(2) << err[c] << std::setprecision(8) << "\n";
+
+    std::cout << "# " << m.points() << " points, " << std::setprecision(3) << us << " us per evaluation" << std::endl;
+
+    return 0;
+}
+}
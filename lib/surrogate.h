@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace surrogate {
+
+    // Parameters of a model at most [-]
+    constexpr int max_dimensions = 32;
+
+    // One output of a run: a field at a probe position, or the whole field
+    struct Output {
+        char field = 'T';                   // u, p, T or r (rho)
+        double z = -1.0;                    // Probe position, < 0 for all N cells [m]
+    };
+
+    // Build settings, read from a key = value file:
+    //
+    //   base_input = input/sources         case every run starts from
+    //   parameters = S_m_cell, mu, k       any numeric input keys
+    //   lower      = 0.5, 1.0e-5, 0.01     lower bounds
+    //   upper      = 2.0, 2.0e-5, 0.03     upper bounds
+    //   outputs    = T@0.5, p@0, u         field@z, or a field alone for its profile
+    //   tolerance  = 1e-3                  refine where |surplus| > tolerance * range
+    //   max_level  = 6                     finest 1D level [-]
+    //   max_points = 200                   runs in total [-]
+    //   validation_runs = 0                extra runs at random points, compared with the model
+    struct Spec {
+        std::string base_input;
+        std::vector<std::string> parameters;
+        std::vector<double> lower, upper;
+        std::vector<Output> outputs;
+        double tolerance = 1.0e-3;
+        int max_level = 6;
+        int max_points = 200;
+        int validation_runs = 0;
+    };
+
+    Spec readSpec(const std::string& filename);
+
+    // Piecewise-linear interpolant on a locally adaptive sparse grid with
+    // nested Clenshaw-Curtis nodes: the 1D node sets are {1/2}, {0, 1}, then
+    // the odd multiples of 2^-(l-1) at level l, each with a hat function of
+    // half-width 2^-(l-1) (level 1: the constant). A grid point is one level
+    // and node per parameter; its basis function is the product of the 1D
+    // hats, and its hierarchical surplus is the run's output minus the
+    // interpolant of the coarser points. The surpluses decay with the local
+    // smoothness of the response, so the surplus of the finest points is the
+    // error estimate, and points whose surplus is still large are refined.
+    class Model {
+    public:
+        // Adaptive build: the grid grows by one level sum per generation,
+        // from the children of the points whose surplus exceeds the
+        // tolerance. The runs of a generation are independent and run in
+        // parallel, one solver per thread. A run that fails or ends with a
+        // non-finite output stops the build, with the failed points.
+        static Model build(const Spec& spec);
+
+        // The same from the keys of the base case, reporting to `log`
+        static Model build(const Spec& spec, const std::unordered_map<std::string, std::string>& base, std::ostream& log);
+
+        // save() refuses a model with a non-finite surplus, which load()
+        // could not read back
+        static Model load(const std::string& filename);
+        void save(const std::string& filename) const;
+
+        int dimensions() const { return static_cast<int>(parameters_.size()); }
+        int components() const { return components_; }
+        int points() const { return static_cast<int>(points_.size()); }
+
+        const std::vector<std::string>& parameters() const { return parameters_; }
+        const std::vector<std::string>& labels() const { return labels_; }
+
+        // Outputs at parameter values p (input units, dimensions() of them).
+        // With `error`, the sum of |surplus| x basis over the leaves of the
+        // grid (points not refined) is added per component.
+        void evaluate(const double* p, double* out, double* error = nullptr) const;
+
+    private:
+        struct Point {
+            std::vector<int> level;         // 1D level per dimension [-]
+            std::vector<double> x;          // Node per dimension, in [0, 1]
+            std::vector<double> surplus;    // Hierarchical surplus per component
+            bool leaf = true;               // No child on the grid
+        };
+
+        // Interpolant at unit coordinates y, from points_[0, count)
+        void interpolate(const double* y, std::size_t count, double* out, double* error) const;
+
+        std::vector<std::string> parameters_;
+        std::vector<double> lower_, upper_;
+        std::vector<std::string> labels_;   // Name of every component
+        int components_ = 0;
+        std::vector<Point> points_;         // In order of level sum
+    };
+
+    // rhoPISO --surrogate-build <spec file>: builds the model, writes it to
+    // output/surrogate/<spec>.sg and reports every generation
+    int build(const std::string& specFile);
+
+    // rhoPISO --surrogate <model file> <value> ...: outputs with error estimates
+    int query(const std::string& modelFile, const std::vector<double>& values);
+}
@@ -1,35 +1,564 @@
 #include "tdma.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
 #include <stdexcept>
+#include <omp.h>
 
 namespace tdma {
 
-std::vector<double> solve(
-    const std::vector<double>& a,
-    const std::vector<double>& b,
-    const std::vector<double>& c,
-    const std::vector<double>& d)
+namespace {
+
+void check(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d)
 {
-    const int n = b.size();
+    const std::size_t n = b.size();
     if (a.size()!=n || c.size()!=n || d.size()!=n)
         throw std::runtime_error("TDMA: size mismatch");
+}
 
-    std::vector<double> c_star(n), d_star(n), x(n);
+template <typename T, typename A>
+void grow(std::vector<T, A>& v, std::size_t n) {
+    if (v.size() < n) v.resize(n);
+}
 
+// Thomas sweep on raw arrays; x holds d* during the forward sweep
+void thomas(int n, const double* a, const double* b, const double* c, const double* d,
+    double* x, double* c_star)
+{
     c_star[0] = c[0] / b[0];
-    d_star[0] = d[0] / b[0];
+    x[0] = d[0] / b[0];
 
     for (int i = 1; i < n; ++i) {
         const double m = b[i] - a[i] * c_star[i - 1];
         c_star[i] = c[i] / m;
-        d_star[i] = (d[i] - a[i] * d_star[i - 1]) / m;
+        x[i] = (d[i] - a[i] * x[i - 1]) / m;
     }
 
-    x[n - 1] = d_star[n - 1];
     for (int i = n - 2; i >= 0; --i)
-        x[i] = d_star[i] - c_star[i] * x[i + 1];
+        x[i] = x[i] - c_star[i] * x[i + 1];
+}
+
+// One parallel cyclic reduction level with stride s on rows [j0, j1) of a
+// tile: row j is combined with rows j - s and j + s
+template <bool Recip>
+inline void pcr_level(
+    const double* A0, const double* B0, const double* C0, const double* D0, const double* R0,
+    double* A1, double* B1, double* C1, double* D1, double* R1,
+    int s, int j0, int j1)
+{
+    #pragma omp simd
+    for (int j = j0; j < j1; ++j) {
+
+        const double alpha = -A0[j] * R0[j - s];
+        const double gamma = -C0[j] * R0[j + s];
+        const double beta = B0[j] + alpha * C0[j - s] + gamma * A0[j + s];
+
+        A1[j] = alpha * A0[j - s];
+        B1[j] = beta;
+        C1[j] = gamma * C0[j + s];
+        D1[j] = D0[j] + alpha * D0[j - s] + gamma * D0[j + s];
+
+        if (Recip) R1[j] = 1.0 / beta;
+    }
+}
+
+// In-place LU factorisation of the m x m block f with partial pivoting
+void lu(int m, double* f, int* pivot) {
+
+    for (int k = 0; k < m; ++k) {
+
+        int r = k;
+        for (int i = k + 1; i < m; ++i)
+            if (std::fabs(f[i * m + k]) > std::fabs(f[r * m + k])) r = i;
+
+        if (f[r * m + k] == 0.0)
+            throw std::runtime_error("Block TDMA: singular pivot block");
+
+        pivot[k] = r;
+        if (r != k)
+            for (int j = 0; j < m; ++j) std::swap(f[k * m + j], f[r * m + j]);
+
+        for (int i = k + 1; i < m; ++i) {
+            const double l = f[i * m + k] /= f[k * m + k];
+            for (int j = k + 1; j < m; ++j) f[i * m + j] -= l * f[k * m + j];
+        }
+    }
+}
+
+// x = F^-1 x for the n columns of the m x n block x
+void lu_solve(int m, const double* f, const int* pivot, double* x, int n) {
+
+    for (int k = 0; k < m; ++k)
+        if (pivot[k] != k)
+            for (int j = 0; j < n; ++j) std::swap(x[k * n + j], x[pivot[k] * n + j]);
+
+    for (int i = 1; i < m; ++i)
+        for (int k = 0; k < i; ++k)
+            for (int j = 0; j < n; ++j) x[i * n + j] -= f[i * m + k] * x[k * n + j];
+
+    for (int i = m - 1; i >= 0; --i) {
+        for (int k = i + 1; k < m; ++k)
+            for (int j = 0; j < n; ++j) x[i * n + j] -= f[i * m + k] * x[k * n + j];
+        for (int j = 0; j < n; ++j) x[i * n + j] /= f[i * m + i];
+    }
+}
+
+}
+
+void Workspace::reserve(int n, int parts) {
+
+    constexpr int W = simd_lanes;
+
+    grow(c_star, n);
+    grow(lanes, 2 * ((n + W - 1) / W * W + 2 * W));
+
+    if (parts > 1) {
+        grow(y, n);
+        grow(g, n);
+        grow(h, n);
+        grow(start, parts + 1);
+        for (auto* v : { &A, &B, &C, &D, &X, &C_star })
+            grow(*v, parts);
+    }
+}
+
+void solve(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d,
+    heap::vector<double>& x,
+    Workspace& w)
+{
+    check(a, b, c, d);
+
+    const int n = b.size();
+    x.resize(n);
+    grow(w.c_star, n);
+
+    thomas(n, a.data(), b.data(), c.data(), d.data(), x.data(), w.c_star.data());
+}
+
+heap::vector<double> solve(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d)
+{
+    Workspace w;
+    heap::vector<double> x;
+    solve(a, b, c, d, x, w);
+    return x;
+}
+
+
+void solve_pcr(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d,
+    heap::vector<double>& x,
+    Workspace& w)
+{
+    check(a, b, c, d);
+
+    const int n = b.size();
+
+    constexpr int W = simd_lanes;
+    constexpr int H = W - 1;                    // Halo of the PCR stencil
+    constexpr int T = 256;                      // Rows per tile
+    constexpr int S = T + 2 * H;                // Tile buffer length
+
+    // Rows padded to a multiple of W with identity rows; lane r owns rows
+    // j * W + r. C* and D* of the lane sweep are stored with W zero rows on
+    // either side so the recurrence needs no tests.
+    const int m = (n + W - 1) / W;
+    const int rows = m * W;
+
+    grow(w.lanes, 2 * (rows + 2 * W));
+
+    double* Cs = w.lanes.data() + W;
+    double* Ds = Cs + rows + 2 * W;
+
+    std::fill(Cs - W, Cs, 0.0);
+    std::fill(Ds - W, Ds, 0.0);
+    std::fill(Cs + rows, Cs + rows + W, 0.0);
+    std::fill(Ds + rows, Ds + rows + W, 0.0);
+
+    // Two sets of tile coefficients (A, B, C, D, 1/B), swapped at every level
+    alignas(64) double tile[2][5][S];
+
+    for (int t0 = 0; t0 < rows; t0 += T) {
+
+        const int len = std::min(T, rows - t0);
+        const int first = t0 - H;               // Row of tile index 0
+
+        double* A = tile[0][0];
+        double* B = tile[0][1];
+        double* C = tile[0][2];
+        double* D = tile[0][3];
+        double* R = tile[0][4];
+
+        // Original coefficients, identity rows outside [0, n)
+        const int lo = std::max(first, 0);
+        const int hi = std::min(first + len + 2 * H, n);
+
+        std::fill(A, A + S, 0.0);
+        std::fill(B, B + S, 1.0);
+        std::fill(C, C + S, 0.0);
+        std::fill(D, D + S, 0.0);
+
+        if (lo < hi) {
+            std::copy(a.begin() + lo, a.begin() + hi, A + (lo - first));
+            std::copy(b.begin() + lo, b.begin() + hi, B + (lo - first));
+            std::copy(c.begin() + lo, c.begin() + hi, C + (lo - first));
+            std::copy(d.begin() + lo, d.begin() + hi, D + (lo - first));
+        }
+
+        if (lo == 0) A[-first] = 0.0;
+        if (hi == n && n - 1 >= lo) C[n - 1 - first] = 0.0;
+
+        #pragma omp simd
+        for (int j = 0; j < len + 2 * H; ++j)
+            R[j] = 1.0 / B[j];
+
+        // PCR levels with strides 1, 2, ..., W/2, each one narrowing the
+        // halo by its stride: afterwards row i is coupled to rows i +- W only
+        int p = 0;
+        int h = H;
+
+        for (int s = 1; s < W; s *= 2) {
+
+            const double* A0 = tile[p][0];
+            const double* B0 = tile[p][1];
+            const double* C0 = tile[p][2];
+            const double* D0 = tile[p][3];
+            const double* R0 = tile[p][4];
+
+            double* A1 = tile[1 - p][0];
+            double* B1 = tile[1 - p][1];
+            double* C1 = tile[1 - p][2];
+            double* D1 = tile[1 - p][3];
+            double* R1 = tile[1 - p][4];
+
+            h -= s;
+
+            // The last level's reciprocals are not needed
+            if (2 * s < W)
+                pcr_level<true>(A0, B0, C0, D0, R0, A1, B1, C1, D1, R1, s, H - h, H + len + h);
+            else
+                pcr_level<false>(A0, B0, C0, D0, R0, A1, B1, C1, D1, R1, s, H - h, H + len + h);
+
+            p = 1 - p;
+        }
+
+        A = tile[p][0];
+        B = tile[p][1];
+        C = tile[p][2];
+        D = tile[p][3];
+
+        // Forward sweep of the W interleaved systems, one per lane
+        for (int q = 0; q < len; q += W) {
+
+            #pragma omp simd
+            for (int r = 0; r < W; ++r) {
+
+                const int i = t0 + q + r;
+                const int j = H + q + r;
+                const double inv = 1.0 / (B[j] - A[j] * Cs[i - W]);
+
+                Cs[i] = C[j] * inv;
+                Ds[i] = (D[j] - A[j] * Ds[i - W]) * inv;
+            }
+        }
+    }
+
+    for (int row = rows - W; row >= 0; row -= W) {
+
+        #pragma omp simd
+        for (int r = 0; r < W; ++r)
+            Ds[row + r] -= Cs[row + r] * Ds[row + r + W];
+    }
+
+    x.assign(Ds, Ds + n);
+}
+
+heap::vector<double> solve_pcr(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d)
+{
+    Workspace w;
+    heap::vector<double> x;
+    solve_pcr(a, b, c, d, x, w);
+    return x;
+}
+
+void solve_partitioned(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d,
+    heap::vector<double>& x,
+    Workspace& w,
+    int parts,
+    int simd_rows,
+    int simd_max)
+{
+    check(a, b, c, d);
+
+    const int n = b.size();
+
+    // Every block needs at least one interior row besides its interface row
+    parts = std::min(parts, n / 2);
+    if (parts <= 1) {
+        if (n >= simd_rows && n <= simd_max) solve_pcr(a, b, c, d, x, w);
+        else solve(a, b, c, d, x, w);
+        return;
+    }
+
+    w.reserve(n, parts);
+    x.resize(n);
+
+    // Block k owns rows [start[k], start[k+1]); its last row is the interface
+    int* start = w.start.data();
+    for (int k = 0; k <= parts; ++k)
+        start[k] = static_cast<int>(static_cast<long long>(n) * k / parts);
+
+    // Interior rows of each block: x_i = y_i + g_i * X_{k-1} + h_i * X_k
+    double* c_star = w.c_star.data();
+    double* y = w.y.data();
+    double* g = w.g.data();
+    double* h = w.h.data();
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < parts; ++k) {
+
+        const int s = start[k];
+        const int e = start[k + 1] - 1;         // Interface row
+
+        // Forward elimination of the interior rows with three right-hand sides
+        for (int i = s; i < e; ++i) {
+
+            const double a_i = (i > s) ? a[i] : 0.0;
+            const double c_i = (i < e - 1) ? c[i] : 0.0;
 
+            const double g_rhs = (i == s && k > 0) ? -a[i] : 0.0;
+            const double h_rhs = (i == e - 1) ? -c[i] : 0.0;
+
+            const double c_prev = (i > s) ? c_star[i - 1] : 0.0;
+            const double y_prev = (i > s) ? y[i - 1] : 0.0;
+            const double g_prev = (i > s) ? g[i - 1] : 0.0;
+            const double h_prev = (i > s) ? h[i - 1] : 0.0;
+
+            const double m = b[i] - a_i * c_prev;
+            c_star[i] = c_i / m;
+            y[i] = (d[i] - a_i * y_prev) / m;
+            g[i] = (g_rhs - a_i * g_prev) / m;
+            h[i] = (h_rhs - a_i * h_prev) / m;
+        }
+
+        for (int i = e - 2; i >= s; --i) {
+            y[i] -= c_star[i] * y[i + 1];
+            g[i] -= c_star[i] * g[i + 1];
+            h[i] -= c_star[i] * h[i + 1];
+        }
+    }
+
+    // Interface system, assembled and solved serially in block order
+    double* A = w.A.data();
+    double* B = w.B.data();
+    double* C = w.C.data();
+    double* D = w.D.data();
+    double* X = w.X.data();
+
+    for (int k = 0; k < parts; ++k) {
+
+        const int e = start[k + 1] - 1;
+
+        A[k] = a[e] * g[e - 1];
+        B[k] = b[e] + a[e] * h[e - 1];
+        C[k] = 0.0;
+        D[k] = d[e] - a[e] * y[e - 1];
+
+        if (k < parts - 1) {
+            B[k] += c[e] * g[e + 1];
+            C[k] = c[e] * h[e + 1];
+            D[k] -= c[e] * y[e + 1];
+        }
+    }
+
+    thomas(parts, A, B, C, D, X, w.C_star.data());
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < parts; ++k) {
+
+        const int s = start[k];
+        const int e = start[k + 1] - 1;
+
+        const double X_l = (k > 0) ? X[k - 1] : 0.0;
+        const double X_r = X[k];
+
+        for (int i = s; i < e; ++i)
+            x[i] = y[i] + g[i] * X_l + h[i] * X_r;
+
+        x[e] = X_r;
+    }
+}
+
+heap::vector<double> solve_partitioned(
+    const heap::vector<double>& a,
+    const heap::vector<double>& b,
+    const heap::vector<double>& c,
+    const heap::vector<double>& d,
+    int parts,
+    int simd_rows,
+    int simd_max)
+{
+    Workspace w;
+    heap::vector<double> x;
+    solve_partitioned(a, b, c, d, x, w, parts, simd_rows, simd_max);
     return x;
 }
 
+void solve_block(int m, const std::vector<double>& a, std::vector<double>& b,
+    std::vector<double>& c, std::vector<double>& d)
+{
+    const std::size_t mm = static_cast<std::size_t>(m) * m;
+    const int n = static_cast<int>(d.size() / m);
+
+    if (a.size() != n * mm || b.size() != n * mm || c.size() != n * mm || d.size() != static_cast<std::size_t>(n) * m)
+        throw std::runtime_error("Block TDMA: size mismatch");
+
+    std::vector<int> pivot(m);
+
+    // Forward sweep: b_k -= a_k C*_{k-1}, d_k -= a_k d*_{k-1}, then
+    // C*_k = b_k^-1 c_k and d*_k = b_k^-1 d_k in place
+    for (int k = 0; k < n; ++k) {
+
+        double* bk = &b[k * mm];
+        double* dk = &d[static_cast<std::size_t>(k) * m];
+
+        if (k > 0) {
+            const double* ak = &a[k * mm];
+            const double* cs = &c[(k - 1) * mm];
+            const double* ds = dk - m;
+
+            for (int i = 0; i < m; ++i)
+                for (int l = 0; l < m; ++l) {
+                    const double f = ak[i * m + l];
+                    if (f == 0.0) continue;
+                    for (int j = 0; j < m; ++j) bk[i * m + j] -= f * cs[l * m + j];
+                    dk[i] -= f * ds[l];
+                }
+        }
+
+        lu(m, bk, pivot.data());
+        if (k < n - 1) lu_solve(m, bk, pivot.data(), &c[k * mm], m);
+        lu_solve(m, bk, pivot.data(), dk, 1);
+    }
+
+    // Back substitution: x_k = d*_k - C*_k x_{k+1}
+    for (int k = n - 2; k >= 0; --k) {
+
+        const double* cs = &c[k * mm];
+        double* xk = &d[static_cast<std::size_t>(k) * m];
+        const double* xn = xk + m;
+
+        for (int i = 0; i < m; ++i)
+            for (int j = 0; j < m; ++j) xk[i] -= cs[i * m + j] * xn[j];
+    }
+}
+
+int partitions(int n, bool deterministic, int chunks) {
+
+    const int max_parts = std::max(1, n / min_partition_rows);
+    const int parts = deterministic ? chunks : omp_get_max_threads();
+
+    return std::max(1, std::min(parts, max_parts));
+}
+
+int benchmark() {
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> rnd(-1.0, 1.0);
+
+    std::printf("TDMA benchmark, one thread, %d SIMD lanes (best of 5)\n", simd_lanes);
+    std::printf("%9s %14s %14s %8s %10s\n", "rows", "Thomas [ns]", "PCR [ns]", "ratio", "max diff");
+
+    // Longest run of consecutive sizes on which PCR wins
+    int from = 0, to = 0;
+    int run_from = 0;
+
+    // The solver keeps its workspace, so the solves are timed the same way
+    Workspace w;
+    heap::vector<double> x, y;
+
+    for (int n = 64; n <= (1 << 20); n *= 2) {
+
+        heap::vector<double> a(n), b(n), c(n), d(n);
+        for (int i = 0; i < n; ++i) {
+            a[i] = rnd(gen);
+            c[i] = rnd(gen);
+            b[i] = 3.0 + rnd(gen);
+            d[i] = rnd(gen);
+        }
+
+        // Grows the workspace and the solutions to this size
+        solve(a, b, c, d, x, w);
+        solve_pcr(a, b, c, d, y, w);
+
+        const int reps = std::max(3, (1 << 21) / n);
+        double best[2] = { 1e30, 1e30 };
+        volatile double sink = 0.0;             // Keeps the solves from being optimized out
+
+        for (int trial = 0; trial < 5; ++trial) {
+            for (int k = 0; k < 2; ++k) {
+
+                const double t0 = omp_get_wtime();
+                for (int r = 0; r < reps; ++r) {
+                    if (k == 0) solve(a, b, c, d, x, w);
+                    else solve_pcr(a, b, c, d, y, w);
+                    sink = sink + (k == 0 ? x : y)[n / 2];
+                }
+
+                best[k] = std::min(best[k], (omp_get_wtime() - t0) / reps / n * 1e9);
+            }
+        }
+
+        double diff = 0.0;
+        for (int i = 0; i < n; ++i)
+            diff = std::max(diff, std::abs(x[i] - y[i]));
+
+        std::printf("%9d %14.2f %14.2f %8.2f %10.1e\n", n, best[0], best[1], best[0] / best[1], diff);
+
+        if (best[1] < best[0]) {
+            if (run_from == 0) run_from = n;
+            if (from == 0 || n / run_from > to / from) {
+                from = run_from;
+                to = n;
+            }
+        }
+        else run_from = 0;
+    }
+
+    std::printf("Built-in range: ");
+    if (simd_min_rows == std::numeric_limits<int>::max()) std::printf("off\n");
+    else std::printf("%d to %d rows\n", simd_min_rows, simd_max_rows);
+
+    if (from > 0)
+        std::printf("PCR faster from %d to %d rows\n", from, to);
+    else
+        std::printf("PCR not faster at any size\n");
+
+    return 0;
+}
+
 }
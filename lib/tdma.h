@@ -1,12 +1,131 @@
 #pragma once
 
+#include <limits>
 #include <vector>
 
+#include "heap.h"
+
 namespace tdma {
-    std::vector<double> solve(
-        const std::vector<double>& a,
-        const std::vector<double>& b,
-        const std::vector<double>& c,
-        const std::vector<double>& d
+
+    // Below this many rows per partition the partitioned solver is not used
+    constexpr int min_partition_rows = 4096;
+
+    // Scratch arrays of the solvers. A caller that keeps one alive and uses
+    // the in-place overloads below solves without touching the heap once the
+    // arrays have grown to the system size.
+    struct Workspace {
+        heap::vector<double> c_star, y, g, h;           // Block sweeps
+        heap::vector<double> A, B, C, D, X, C_star;     // Interface system
+        std::vector<int> start;                         // First row of every block
+        heap::vector<double> lanes;                     // C* and D* of the PCR lane sweep
+
+        // Grows the arrays for a system of n rows split into `parts` blocks
+        void reserve(int n, int parts);
+    };
+
+    heap::vector<double> solve(
+        const heap::vector<double>& a,
+        const heap::vector<double>& b,
+        const heap::vector<double>& c,
+        const heap::vector<double>& d
+    );
+
+    void solve(
+        const heap::vector<double>& a,
+        const heap::vector<double>& b,
+        const heap::vector<double>& c,
+        const heap::vector<double>& d,
+        heap::vector<double>& x,
+        Workspace& w
+    );
+
+    // Lanes of the PCR-Thomas solver (eight doubles: one AVX-512 register,
+    // two AVX2 registers)
+    constexpr int simd_lanes = 8;
+
+    // Smallest and largest system handed to solve_pcr by solve_partitioned,
+    // from `rhoPISO --bench-tdma` with the instruction set of the build.
+    // Above the upper bound the lane sweep's eight streams through memory
+    // cost more than the division chain they hide. With SSE2 (two lanes per
+    // register) PCR does not beat Thomas at any size and is off.
+#if defined(__AVX512F__)
+    constexpr int simd_min_rows = 256;
+    constexpr int simd_max_rows = 1 << 18;
+#elif defined(__AVX2__)
+    constexpr int simd_min_rows = 256;
+    constexpr int simd_max_rows = 1 << 17;
+#else
+    constexpr int simd_min_rows = std::numeric_limits<int>::max();
+    constexpr int simd_max_rows = std::numeric_limits<int>::max();
+#endif
+
+    // Single-core PCR-Thomas hybrid. Three parallel cyclic reduction levels
+    // (strides 1, 2, 4) split the system into `simd_lanes` interleaved
+    // subsystems, which are then solved by Thomas in lockstep, one per SIMD
+    // lane. About twice the arithmetic of Thomas, but free of the serial
+    // division chain; see `simd_min_rows` for when it pays off.
+    heap::vector<double> solve_pcr(
+        const heap::vector<double>& a,
+        const heap::vector<double>& b,
+        const heap::vector<double>& c,
+        const heap::vector<double>& d
+    );
+
+    void solve_pcr(
+        const heap::vector<double>& a,
+        const heap::vector<double>& b,
+        const heap::vector<double>& c,
+        const heap::vector<double>& d,
+        heap::vector<double>& x,
+        Workspace& w
+    );
+
+    // Partitioned (two-level) Thomas solver. The rows are split into `parts`
+    // contiguous blocks, each block is eliminated independently (in parallel),
+    // the P x P interface system is solved serially in block order and the
+    // interiors are back-substituted in parallel. The arithmetic of every block
+    // depends only on `parts`, never on the number of threads, so the result is
+    // bit-identical for any thread count at fixed `parts`. With a single
+    // partition, systems of `simd_rows` to `simd_max` rows go to solve_pcr.
+    heap::vector<double> solve_partitioned(
+        const heap::vector<double>& a,
+        const heap::vector<double>& b,
+        const heap::vector<double>& c,
+        const heap::vector<double>& d,
+        int parts,
+        int simd_rows = simd_min_rows,
+        int simd_max = simd_max_rows
     );
-}
\ No newline at end of file
+
+    void solve_partitioned(
+        const heap::vector<double>& a,
+        const heap::vector<double>& b,
+        const heap::vector<double>& c,
+        const heap::vector<double>& d,
+        heap::vector<double>& x,
+        Workspace& w,
+        int parts,
+        int simd_rows = simd_min_rows,
+        int simd_max = simd_max_rows
+    );
+
+    // Times Thomas against the PCR-Thomas solver on one thread for 2^6 to
+    // 2^20 rows, both on a reused Workspace as in the solver, and prints the
+    // range in which PCR wins on this machine and build
+    int benchmark();
+
+    // Block tridiagonal system of n block rows with dense m x m blocks, all
+    // row-major and stored back to back: a, b and c hold the n sub-, main
+    // and super-diagonal blocks (a[0] and c[n - 1] are not used) and d the n
+    // right-hand sides of m values. Block Thomas with an LU factorisation of
+    // partial pivoting for every pivot block; b and c are overwritten by the
+    // factors and d by the solution. Throws on a singular pivot block.
+    void solve_block(int m, const std::vector<double>& a, std::vector<double>& b,
+        std::vector<double>& c, std::vector<double>& d);
+
+    // Number of partitions to use for a system of n rows. In deterministic
+    // mode it depends on n and the fixed chunk count only; otherwise it
+    // follows the number of OpenMP threads. Returns 1 (plain Thomas) for
+    // systems too small to be worth splitting.
+    int partitions(int n, bool deterministic, int chunks);
+}